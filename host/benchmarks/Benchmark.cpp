@@ -0,0 +1,617 @@
+// Benchmarks of the module hot paths against the fake DCM of the host stand-in
+// of NAOqi. Built once per robot, so that the costs are measured at the Pepper
+// and NAO sizes.
+//
+// 1. Per-call cost of the DCM callbacks and of the methods used by a controller
+// 2. Command and sensor exchange of a controller, through the bound methods
+//    and through the shared-memory channel
+// 3. End-to-end control loop at the DCM period (83 Hz) for both, with tail latencies
+// 4. Cost of the DCM time in the callbacks: DCMClock, as in the module, versus
+//    the DCMProxy::getTime call each callback made before. The proxy call
+//    latency of the robot can be modelled by the fake DCM (getTimeLatencyUs)
+// 5. Phase alignment of a controller with the DCM: polling the sensors at its
+//    own pace versus waitForNextCycle, latency from the sensors to the
+//    preprocess that sends the command computed from them
+//
+// Results are printed as JSON so that runs can be compared across commits, with
+// the same summary keys as utils/benchmark_rpc.py. Proxy calls are in-process:
+// they include the ALValue marshalling, not the network of a remote client.
+// The callbacks are run through the fake DCM, their times include its dispatch,
+// and for the postprocess the application of the queued commands.
+// Usage: Benchmark [calls] [cycles] [output.json] [getTimeLatencyUs]
+
+#include <alcommon/albroker.h>
+#include <alcommon/alproxy.h>
+#include <alproxies/dcmproxy.h>
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <errno.h>
+#include <sstream>
+#include <time.h>
+#include <unistd.h>
+
+#include "DCMClock.h"
+#include "FakeDCM.h"
+#include "NAORobotModule.h"
+#include "PepperRobotModule.h"
+#include "SharedMemoryChannel.h"
+#include "mc_naoqi_dcm.h"
+
+using namespace mc_naoqi_dcm;
+
+namespace
+{
+long long monotonicTimeNs()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+void sleepUntilNs(long long timeNs)
+{
+  struct timespec deadline;
+  deadline.tv_sec = timeNs / 1000000000LL;
+  deadline.tv_nsec = timeNs % 1000000000LL;
+  while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, 0) == EINTR)
+  {
+  }
+}
+
+/** Durations, summarised in microseconds */
+class Samples
+{
+public:
+  explicit Samples(size_t capacity)
+  {
+    values.reserve(capacity);
+  }
+
+  void add(long long durationNs)
+  {
+    values.push_back(durationNs * 1e-3);
+  }
+
+  std::vector<double> values;
+};
+
+/** Minimal JSON writer: nested objects of numbers and strings */
+class JsonWriter
+{
+public:
+  explicit JsonWriter(std::ostream & out) : out(out), depth(0), first(true)
+  {
+    out << std::fixed << std::setprecision(3);
+  }
+
+  void beginObject(const std::string & key = "")
+  {
+    if(depth)
+    {
+      newKey(key);
+    }
+    out << "{";
+    depth++;
+    first = true;
+  }
+
+  void endObject()
+  {
+    depth--;
+    out << "\n" << std::string(2 * depth, ' ') << "}";
+    first = false;
+  }
+
+  template<typename T>
+  void value(const std::string & key, const T & value)
+  {
+    newKey(key);
+    out << value;
+  }
+
+  void value(const std::string & key, const std::string & value)
+  {
+    newKey(key);
+    out << '"' << value << '"';
+  }
+
+  /** count, mean_us, p50_us, p99_us, p999_us and max_us */
+  void summary(const std::string & key, const Samples & samples)
+  {
+    std::vector<double> sorted(samples.values);
+    std::sort(sorted.begin(), sorted.end());
+    size_t n = sorted.size();
+    double sum = 0.0;
+    for(size_t i = 0; i < n; i++)
+    {
+      sum += sorted[i];
+    }
+    beginObject(key);
+    value("count", n);
+    value("mean_us", n ? sum / n : 0.0);
+    value("p50_us", percentile(sorted, 0.5));
+    value("p99_us", percentile(sorted, 0.99));
+    value("p999_us", percentile(sorted, 0.999));
+    value("max_us", n ? sorted.back() : 0.0);
+    endObject();
+  }
+
+private:
+  static double percentile(const std::vector<double> & sorted, double p)
+  {
+    if(sorted.empty())
+    {
+      return 0.0;
+    }
+    return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+  }
+
+  void newKey(const std::string & key)
+  {
+    out << (first ? "\n" : ",\n") << std::string(2 * depth, ' ') << '"' << key << "\": ";
+    first = false;
+  }
+
+  std::ostream & out;
+  unsigned int depth;
+  bool first;
+};
+
+struct Context
+{
+  Context(const boost::shared_ptr<AL::ALBroker> & broker)
+  : module(AL::ALModule::createModule<MCNAOqiDCM>(broker, "MCNAOqiDCM")), proxy(broker, "MCNAOqiDCM"),
+    dcm(broker->fakeDCM()), dcmProxy(broker)
+  {
+    dcmClock.synchronise(DCMClock::hostTime(), dcmProxy.getTime(0));
+  }
+
+  boost::shared_ptr<MCNAOqiDCM> module;
+  AL::ALProxy proxy;
+  boost::shared_ptr<AL::FakeDCM> dcm;
+  // the DCM time as read by the module, before and since DCMClock
+  AL::DCMProxy dcmProxy;
+  DCMClock dcmClock;
+  // joint commands within the limits
+  std::vector<float> targets;
+  std::string ledGroup;
+  AL::ALValue aliasCommand;
+};
+
+typedef void (*Call)(Context &);
+
+// the callbacks of the module, through the fake DCM
+void preProcess(Context & context)
+{
+  context.dcm->runPreProcess();
+}
+
+void postProcess(Context & context)
+{
+  context.dcm->runPostProcess();
+}
+
+void createAliasPrepareCommand(Context & context)
+{
+  context.module->benchmarkCreateAliasPrepareCommand(context.aliasCommand);
+}
+
+void getTime(Context & context)
+{
+  context.dcmProxy.getTime(0);
+}
+
+void clockNow(Context & context)
+{
+  context.dcmClock.now();
+}
+
+// the callbacks of one DCM cycle
+void callbacks(Context & context)
+{
+  preProcess(context);
+  postProcess(context);
+}
+
+// the callbacks of one DCM cycle with the getTime call each of them made before the DCMClock
+void callbacksWithGetTime(Context & context)
+{
+  getTime(context);
+  preProcess(context);
+  getTime(context);
+  postProcess(context);
+}
+
+void getSensors(Context & context)
+{
+  context.proxy.call<std::vector<float> >("getSensors");
+}
+
+void setJointAngles(Context & context)
+{
+  context.proxy.callVoid("setJointAngles", context.targets);
+}
+
+void setStiffness(Context & context)
+{
+  context.proxy.callVoid("setStiffness", 0.0f);
+}
+
+void setLeds(Context & context)
+{
+  context.proxy.callVoid("setLeds", context.ledGroup, 1.0f, 1.0f, 1.0f);
+}
+
+void runCycle(Context & context)
+{
+  context.dcm->runCycle();
+}
+
+// end the cycle and publish the command of the next one
+void runPostProcessAndCommand(Context & context)
+{
+  postProcess(context);
+  setJointAngles(context);
+}
+
+/** Time n calls, between (if any) runs after each call, untimed */
+Samples timeCalls(Context & context, Call call, Call between, unsigned int n)
+{
+  Samples samples(n);
+  for(unsigned int i = 0; i < n; i++)
+  {
+    long long start = monotonicTimeNs();
+    call(context);
+    samples.add(monotonicTimeNs() - start);
+    if(between)
+    {
+      between(context);
+    }
+  }
+  return samples;
+}
+
+/** Command and sensor exchange of a controller with the module */
+class Transport
+{
+public:
+  virtual ~Transport() {}
+
+  /** Wait for the sensors of a cycle after lastCycle, returns lastCycle on timeout */
+  virtual int waitForCycle(int lastCycle) = 0;
+
+  /** Send the joint commands and read the sensors */
+  virtual void exchange(const std::vector<float> & command, std::vector<float> & sensors) = 0;
+};
+
+/** Bound methods, as a NAOqi client */
+class ProxyTransport : public Transport
+{
+public:
+  explicit ProxyTransport(AL::ALProxy & proxy) : proxy(proxy) {}
+
+  int waitForCycle(int lastCycle)
+  {
+    AL::ALValue snapshot = proxy.call<AL::ALValue>("waitForNextCycle", lastCycle, 100);
+    return snapshot[2];
+  }
+
+  void exchange(const std::vector<float> & command, std::vector<float> & sensors)
+  {
+    proxy.callVoid("setJointAngles", command);
+    sensors = proxy.call<std::vector<float> >("getSensors");
+  }
+
+private:
+  AL::ALProxy & proxy;
+};
+
+/** SharedMemoryChannel client */
+class SharedMemoryTransport : public Transport
+{
+public:
+  explicit SharedMemoryTransport(const std::string & name)
+  {
+    channel.open(name);
+    values.resize(channel.numSensors());
+  }
+
+  int waitForCycle(int lastCycle)
+  {
+    channel.waitForCycle(static_cast<uint32_t>(lastCycle), 100);
+    int dcmTime;
+    uint32_t cycle;
+    if(!channel.readSensors(&values[0], dcmTime, cycle))
+    {
+      return lastCycle;
+    }
+    return static_cast<int>(cycle);
+  }
+
+  void exchange(const std::vector<float> & command, std::vector<float> & sensors)
+  {
+    channel.writeJointPositions(&command[0]);
+    sensors.resize(values.size());
+    int dcmTime;
+    uint32_t cycle;
+    channel.readSensors(&sensors[0], dcmTime, cycle);
+  }
+
+private:
+  SharedMemoryChannel channel;
+  std::vector<float> values;
+};
+
+/** Time n exchanges, each followed by a DCM cycle, untimed */
+Samples timeExchanges(Context & context, Transport & transport, unsigned int n)
+{
+  Samples samples(n);
+  std::vector<float> sensors;
+  for(unsigned int i = 0; i < n; i++)
+  {
+    long long start = monotonicTimeNs();
+    transport.exchange(context.targets, sensors);
+    samples.add(monotonicTimeNs() - start);
+    context.dcm->runCycle();
+  }
+  return samples;
+}
+
+/**
+ * A controller woken by every DCM cycle: step is the time from the wake-up to
+ * the end of the command and sensor exchange, period the time between two
+ * wake-ups
+ */
+void runLoop(JsonWriter & json, const std::string & name, Transport & transport, Context & context, unsigned int cycles)
+{
+  Samples step(cycles);
+  Samples period(cycles);
+  std::vector<float> sensors;
+  unsigned int skipped = 0;
+  unsigned int timeouts = 0;
+  long long previous = 0;
+  // the first snapshot may date from before the transport was enabled
+  int last = transport.waitForCycle(transport.waitForCycle(-1));
+  for(unsigned int i = 0; i < cycles; i++)
+  {
+    int cycle = transport.waitForCycle(last);
+    long long woken = monotonicTimeNs();
+    if(cycle == last)
+    {
+      timeouts++;
+      continue;
+    }
+    skipped += cycle - last - 1;
+    last = cycle;
+    transport.exchange(context.targets, sensors);
+    step.add(monotonicTimeNs() - woken);
+    if(previous)
+    {
+      period.add(woken - previous);
+    }
+    previous = woken;
+  }
+  json.beginObject(name);
+  json.summary("step", step);
+  json.summary("period", period);
+  json.value("skipped_cycles", skipped);
+  json.value("timeouts", timeouts);
+  json.endObject();
+}
+/** Host times of the fake DCM callbacks, preallocated: recorded from the DCM thread */
+struct CallbackTimes
+{
+  explicit CallbackTimes(size_t capacity)
+  {
+    preProcess.reserve(capacity);
+    postProcess.reserve(capacity);
+  }
+
+  void atPreProcess()
+  {
+    if(preProcess.size() < preProcess.capacity())
+    {
+      preProcess.push_back(monotonicTimeNs());
+    }
+  }
+
+  void atPostProcess()
+  {
+    if(postProcess.size() < postProcess.capacity())
+    {
+      postProcess.push_back(monotonicTimeNs());
+    }
+  }
+
+  std::vector<long long> preProcess;
+  std::vector<long long> postProcess;
+};
+
+/**
+ * A controller computing a command from the latest sensors for half a
+ * period: latency is the time from the postprocess that read the sensors to
+ * the preprocess that sends the command. polling reads them at the DCM period
+ * of its own clock, 1% slow as an unsynchronised clock drifts through every
+ * phase of the DCM cycle, and misses the next preprocess when it reads late
+ * in the cycle. lockstep waits for every cycle with waitForNextCycle.
+ */
+void runPhase(JsonWriter & json, const std::string & name, Context & context, unsigned int cycles, bool lockstep)
+{
+  const unsigned int periodUs = RobotModule::defaultDcmPeriod;
+  CallbackTimes times(2 * cycles + 16);
+  // before the module preprocess: a command published earlier is sent by it
+  ProcessSignalConnection preProcessConnection =
+      context.dcm->atPreProcess(boost::bind(&CallbackTimes::atPreProcess, &times));
+  context.proxy.callVoid("startLoop");
+  // after the module postprocess: its snapshot is published
+  ProcessSignalConnection postProcessConnection =
+      context.dcm->atPostProcess(boost::bind(&CallbackTimes::atPostProcess, &times));
+  // cycle counter of the module for the first postprocess time
+  context.dcm->runCycle();
+  int firstCycle = context.proxy.call<AL::ALValue>("waitForNextCycle", -1, 0)[2];
+
+  context.dcm->start(periodUs, periodUs / 4);
+  // published commands, with the cycle of the sensors they were computed from
+  std::vector<std::pair<int, long long> > commands;
+  commands.reserve(cycles);
+  unsigned int stale = 0;
+  unsigned int skipped = 0;
+  int last = firstCycle;
+  long long tick = monotonicTimeNs();
+  for(unsigned int i = 0; i < cycles; i++)
+  {
+    int cycle;
+    if(lockstep)
+    {
+      cycle = context.proxy.call<AL::ALValue>("waitForNextCycle", last, 100)[2];
+    }
+    else
+    {
+      tick += periodUs * 1010LL;
+      sleepUntilNs(tick);
+      // returns at once, as getSensors, with the cycle counter
+      cycle = context.proxy.call<AL::ALValue>("waitForNextCycle", -1, 0)[2];
+    }
+    // the sensors of the last command again, or a timeout
+    if(cycle == last)
+    {
+      stale++;
+      continue;
+    }
+    skipped += cycle - last - 1;
+    last = cycle;
+    sleepUntilNs(monotonicTimeNs() + periodUs * 500LL);
+    setJointAngles(context);
+    commands.push_back(std::make_pair(cycle, monotonicTimeNs()));
+  }
+  context.dcm->stop();
+  context.proxy.callVoid("stopLoop");
+  preProcessConnection.disconnect();
+  postProcessConnection.disconnect();
+
+  Samples latency(commands.size());
+  for(size_t i = 0; i < commands.size(); i++)
+  {
+    size_t sensors = commands[i].first - firstCycle;
+    std::vector<long long>::const_iterator sent =
+        std::upper_bound(times.preProcess.begin(), times.preProcess.end(), commands[i].second);
+    if(sensors < times.postProcess.size() && sent != times.preProcess.end())
+    {
+      latency.add(*sent - times.postProcess[sensors]);
+    }
+  }
+  json.beginObject(name);
+  json.summary("latency", latency);
+  json.value("stale_reads", stale);
+  json.value("skipped_cycles", skipped);
+  json.endObject();
+}
+} // namespace
+
+int main(int argc, char ** argv)
+{
+  unsigned int calls = argc > 1 ? std::atoi(argv[1]) : 10000;
+  unsigned int cycles = argc > 2 ? std::atoi(argv[2]) : 1000;
+  std::string outPath = argc > 3 ? argv[3] : "";
+  unsigned int getTimeLatencyUs = argc > 4 ? std::atoi(argv[4]) : 0;
+
+  boost::shared_ptr<AL::ALBroker> broker(new AL::ALBroker());
+  Context context(broker);
+#ifdef PEPPER
+  PepperRobotModule robot;
+#else
+  NAORobotModule robot;
+#endif
+  context.targets.resize(robot.actuators.size());
+  for(size_t i = 0; i < context.targets.size(); i++)
+  {
+    context.targets[i] = 0.5f * (robot.actuatorLowerLimits[i] + robot.actuatorUpperLimits[i]);
+  }
+  context.ledGroup = robot.rgbLedGroups.front().groupName;
+
+  std::ostringstream results;
+  JsonWriter json(results);
+  json.beginObject();
+  json.value("robot", context.proxy.call<std::string>("getRobotName"));
+  json.value("joints", robot.actuators.size());
+  json.value("sensors", context.proxy.call<int>("numSensors"));
+
+  // 1. Per-call cost, the fake DCM cycles are run in this thread between the calls
+  context.proxy.callVoid("startLoop");
+  json.beginObject("calls");
+  setJointAngles(context);
+  json.summary("synchronisedDCMcallback", timeCalls(context, &preProcess, &runPostProcessAndCommand, calls));
+  json.summary("synchronisedDCMcallback_noCommand", timeCalls(context, &preProcess, &postProcess, calls));
+  json.summary("synchronisedSensorsCallback", timeCalls(context, &postProcess, &preProcess, calls));
+  json.summary("getSensors", timeCalls(context, &getSensors, &runCycle, calls));
+  json.summary("setJointAngles", timeCalls(context, &setJointAngles, &runCycle, calls));
+  json.summary("setStiffness", timeCalls(context, &setStiffness, &runCycle, calls));
+  json.summary("setLeds", timeCalls(context, &setLeds, &runCycle, calls));
+  json.summary("createAliasPrepareCommand", timeCalls(context, &createAliasPrepareCommand, 0, calls));
+  json.endObject();
+
+  // 2. Exchange of a controller step (setJointAngles + getSensors, or their shared-memory equivalent)
+  ProxyTransport proxyTransport(context.proxy);
+  std::ostringstream channelName;
+  channelName << "/mc_naoqi_dcm_benchmark_" << getpid();
+  context.proxy.callVoid("enableSharedMemoryChannel", channelName.str());
+  SharedMemoryTransport sharedMemoryTransport(channelName.str());
+  context.proxy.callVoid("disableSharedMemoryChannel");
+  json.beginObject("exchange");
+  json.summary("proxy", timeExchanges(context, proxyTransport, calls));
+  context.proxy.callVoid("enableSharedMemoryChannel", channelName.str());
+  json.summary("sharedMemory", timeExchanges(context, sharedMemoryTransport, calls));
+  context.proxy.callVoid("disableSharedMemoryChannel");
+  json.endObject();
+
+  // 3. End-to-end loop, the fake DCM runs from its timer thread with a jitter of a quarter period
+  unsigned int periodUs = RobotModule::defaultDcmPeriod;
+  context.dcm->start(periodUs, periodUs / 4);
+  json.beginObject("loop");
+  json.value("period_us", periodUs);
+  json.value("jitter_us", periodUs / 4);
+  runLoop(json, "proxy", proxyTransport, context, cycles);
+  context.proxy.callVoid("enableSharedMemoryChannel", channelName.str());
+  runLoop(json, "sharedMemory", sharedMemoryTransport, context, cycles);
+  context.proxy.callVoid("disableSharedMemoryChannel");
+  json.endObject();
+  context.dcm->stop();
+
+  // 4. DCM time in the callbacks, the fake DCM cycles are run in this thread again
+  context.dcm->setGetTimeLatency(getTimeLatencyUs);
+  json.beginObject("clock");
+  json.value("getTime_latency_us", getTimeLatencyUs);
+  json.summary("dcmProxy_getTime", timeCalls(context, &getTime, 0, calls));
+  json.summary("dcmClock_now", timeCalls(context, &clockNow, 0, calls));
+  json.summary("callbacks_dcmClock", timeCalls(context, &callbacks, &setJointAngles, calls));
+  json.summary("callbacks_getTime", timeCalls(context, &callbacksWithGetTime, &setJointAngles, calls));
+  json.endObject();
+  context.dcm->setGetTimeLatency(0);
+  context.proxy.callVoid("stopLoop");
+
+  // 5. Phase alignment, the fake DCM runs from its timer thread again
+  json.beginObject("phase");
+  json.value("period_us", periodUs);
+  runPhase(json, "polling", context, cycles, false);
+  runPhase(json, "lockstep", context, cycles, true);
+  json.endObject();
+
+  json.endObject();
+  std::cout << results.str() << std::endl;
+  if(!outPath.empty())
+  {
+    std::ofstream out(outPath.c_str());
+    out << results.str() << std::endl;
+    if(!out)
+    {
+      std::cerr << "Cannot write " << outPath << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,203 @@
+#pragma once
+#include <alcommon/almodulecore.h>
+#include <alvalue/alvalue.h>
+
+#include <boost/atomic.hpp>
+#include <boost/signals2/signal.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "FlightRecorder.h"
+
+namespace AL
+{
+/**
+ * @brief DCM of the host stand-in of NAOqi
+ *
+ * A cycle runs the preprocess callbacks, applies the commands whose time has
+ * come, then runs the postprocess callbacks. Cycles are run either by a timer
+ * thread (start()), or one at a time by the caller (runCycle()).
+ *
+ * Commands are applied without interpolation: each actuator key takes the
+ * value of its latest point whose time is reached. The robot is ideal: the
+ * sensor key of every actuator key ("/Actuator/Value" replaced by
+ * "/Sensor/Value") follows the actuator value.
+ *
+ * A flight recording can be replayed instead (replay()): the recorded sensor
+ * values replace the ones of the ideal robot, and the commands sent in
+ * response can be logged (startCommandLog()) and compared with the recorded
+ * ones (utils/compare_replay.py).
+ *
+ * Once the aliases are created, setAlias(), the fast access reads and the
+ * cycles never allocate, so that the allocations of the module callbacks
+ * can be checked on their own.
+ */
+class FakeDCM : public ALModuleCore
+{
+public:
+  // Points queued per key, setAlias drops the points beyond
+  static const unsigned int maxPointsPerKey = 1024;
+
+  FakeDCM();
+  ~FakeDCM();
+
+  ProcessSignalConnection atPreProcess(const boost::function<void()> & callback);
+  ProcessSignalConnection atPostProcess(const boost::function<void()> & callback);
+
+  /** DCMProxy::getTime: CLOCK_MONOTONIC in ms, plus offset */
+  int getTime(int offset);
+  /** DCMProxy::createAlias */
+  ALValue createAlias(const ALValue & alias);
+  /** DCMProxy::setAlias, time-separate commands only */
+  void setAlias(const ALValue & command);
+
+  /** Address of a memory value, created with the value 0 on first use, valid until destruction */
+  const float * memoryValue(const std::string & key);
+  float getMemoryValue(const std::string & key);
+  void setMemoryValue(const std::string & key, float value);
+  /** Read the values of memoryValue() pointers in one consistent set */
+  void readValues(const std::vector<const float *> & variables, std::vector<float> & values);
+
+  /**
+   * @brief Run the cycles from a timer thread
+   *
+   * @param periodUs Period of the cycles
+   * @param jitterUs Each cycle is delayed by a random time in [0, jitterUs],
+   * without shifting the next ones
+   */
+  void start(unsigned int periodUs, unsigned int jitterUs = 0);
+  void stop();
+  bool running() const;
+
+  /** Run one cycle in the calling thread, the timer thread must be stopped */
+  void runCycle();
+  /** Run the preprocess callbacks only */
+  void runPreProcess();
+  /** Apply the commands whose time has come, then run the postprocess callbacks */
+  void runPostProcess();
+
+  /**
+   * @brief Run one cycle per record of a flight recording in the calling thread
+   *
+   * The timer thread must be stopped. The recorded sensor values are written
+   * once the commands are applied, before the postprocess callbacks. The DCM
+   * time is the one of the fake DCM clock, as for the other cycles: it follows
+   * the recorded times only if realTime is true.
+   *
+   * @param sensorKeys Memory key of each recorded sensor
+   * @param realTime true to run the cycles at the recorded period, false to run them back to back
+   * @return Number of cycles run
+   */
+  unsigned int replay(const mc_naoqi_dcm::FlightRecording & recording,
+                      const std::vector<std::string> & sensorKeys,
+                      bool realTime);
+  /** Stop replay() after its current cycle, from another thread */
+  void stopReplay();
+
+  /**
+   * @brief Log the setAlias calls from now on, instead of only counting them
+   *
+   * The log is allocated here, setAlias does not allocate: the commands that
+   * do not fit in maxCommands, maxTimes or maxValues are not logged. During a
+   * replay the commands are logged with the recorded cycle, otherwise with
+   * cycles().
+   */
+  void startCommandLog(unsigned int maxCommands, unsigned int maxTimes, unsigned int maxValues);
+  void stopCommandLog();
+  /** Logged commands, and commands that did not fit in the log */
+  unsigned int loggedCommands();
+  unsigned int unloggedCommands();
+  /**
+   * @brief Write the logged commands as CSV, for utils/compare_replay.py
+   *
+   * One line per command: cycle, alias, ';'-separated times and ';'-separated
+   * values (key by key).
+   *
+   * @throws ALError if the file cannot be written
+   */
+  void saveCommandLog(const std::string & path);
+
+  /** Busy-wait this long in getTime, to model the cost of a proxy call */
+  void setGetTimeLatency(unsigned int latencyUs);
+
+  unsigned int cycles() const
+  {
+    return numCycles.load(boost::memory_order_relaxed);
+  }
+
+  /** setAlias calls */
+  unsigned int commands() const
+  {
+    return numCommands.load(boost::memory_order_relaxed);
+  }
+
+  /** setAlias calls of one alias */
+  unsigned int commands(const std::string & alias);
+
+  /** Points dropped because a key had maxPointsPerKey points queued */
+  unsigned int droppedPoints() const
+  {
+    return numDroppedPoints.load(boost::memory_order_relaxed);
+  }
+
+private:
+  struct Key
+  {
+    float * actuator;
+    float * sensor;
+    // queued points, in time order
+    std::vector<int> times;
+    std::vector<float> values;
+  };
+
+  // Command of the log, its times and values are stored in loggedTimes and loggedValues
+  struct LoggedCommand
+  {
+    unsigned int cycle;
+    // key of aliases
+    const std::string * alias;
+    size_t firstTime;
+    size_t firstValue;
+    unsigned int numTimes;
+    unsigned int numKeys;
+  };
+
+  void timerLoop(unsigned int periodUs, unsigned int jitterUs);
+  void logCommand(const std::string & alias, const ALValue & times, const ALValue & values);
+  float * variable(const std::string & key);
+  void applyCommands(int dcmTime);
+  void queuePoint(Key & key, int time, float value);
+
+  // memory, aliases and keys
+  boost::mutex mutex;
+  // std::map: the addresses of the values are stable
+  std::map<std::string, float> memory;
+  std::map<std::string, Key> keys;
+  std::map<std::string, std::vector<Key *> > aliases;
+  std::map<std::string, unsigned int> aliasCommands;
+  // command log, the vectors are reserved by startCommandLog
+  bool logging;
+  std::vector<LoggedCommand> commandLog;
+  std::vector<int> loggedTimes;
+  std::vector<float> loggedValues;
+  unsigned int numUnlogged;
+  // recorded cycle of the replayed record, -1 outside of a replay
+  long long replayCycle;
+
+  boost::signals2::signal<void()> preProcess;
+  boost::signals2::signal<void()> postProcess;
+
+  boost::thread timer;
+  boost::atomic<unsigned int> getTimeLatency;
+  boost::atomic<unsigned int> numCycles;
+  boost::atomic<unsigned int> numCommands;
+  boost::atomic<unsigned int> numDroppedPoints;
+  boost::atomic<bool> timerRunning;
+  boost::atomic<bool> replaying;
+};
+
+} // namespace AL
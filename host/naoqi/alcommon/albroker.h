@@ -0,0 +1,52 @@
+#pragma once
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include <map>
+#include <string>
+
+namespace AL
+{
+class ALModuleCore;
+class ALProxy;
+class ALMemoryProxy;
+class DCMProxy;
+class FakeDCM;
+
+/**
+ * @brief Host stand-in of the NAOqi ALBroker
+ *
+ * Owns the fake DCM (see FakeDCM.h), which also holds the memory read by
+ * ALMemoryProxy and ALMemoryFastAccess. Must be held by a shared_ptr.
+ */
+class ALBroker : public boost::enable_shared_from_this<ALBroker>
+{
+public:
+  ALBroker();
+  ~ALBroker();
+
+  boost::shared_ptr<DCMProxy> getDcmProxy();
+  boost::shared_ptr<ALMemoryProxy> getMemoryProxy();
+  boost::shared_ptr<ALProxy> getProxy(const std::string & module);
+
+  /** Make a module reachable by ALProxy, done by ALModule::createModule */
+  void registerModule(const boost::shared_ptr<ALModuleCore> & module);
+  /** Registered module, throws if there is none */
+  boost::shared_ptr<ALModuleCore> getModuleByName(const std::string & name);
+
+  /** Fake DCM of the host (not part of NAOqi) */
+  const boost::shared_ptr<FakeDCM> & fakeDCM() const
+  {
+    return dcm;
+  }
+
+private:
+  ALBroker(const ALBroker &);
+  ALBroker & operator=(const ALBroker &);
+
+  boost::shared_ptr<FakeDCM> dcm;
+  std::map<std::string, boost::weak_ptr<ALModuleCore> > modules;
+};
+
+} // namespace AL
@@ -0,0 +1,215 @@
+#pragma once
+#include <alvalue/alvalue.h>
+
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace AL
+{
+namespace detail
+{
+template<typename T>
+struct Decay
+{
+  typedef T type;
+};
+
+template<typename T>
+struct Decay<const T &>
+{
+  typedef T type;
+};
+
+/** Parameter of a bound method read from an ALValue */
+template<typename T>
+inline T fromALValue(const ALValue & value)
+{
+  return static_cast<const T &>(value);
+}
+
+// numbers coming from python may be either int or float
+template<>
+inline float fromALValue<float>(const ALValue & value)
+{
+  return value.isInt() ? static_cast<float>(static_cast<const int &>(value)) : static_cast<const float &>(value);
+}
+
+template<>
+inline std::vector<float> fromALValue<std::vector<float> >(const ALValue & value)
+{
+  return value;
+}
+
+template<>
+inline std::vector<int> fromALValue<std::vector<int> >(const ALValue & value)
+{
+  return value;
+}
+
+template<>
+inline std::vector<std::string> fromALValue<std::vector<std::string> >(const ALValue & value)
+{
+  return value;
+}
+
+/** Call a bound function object and wrap its result */
+template<typename Result>
+struct Call
+{
+  template<typename Function>
+  static ALValue invoke(const Function & function)
+  {
+    return ALValue(function());
+  }
+};
+
+template<>
+struct Call<void>
+{
+  template<typename Function>
+  static ALValue invoke(const Function & function)
+  {
+    function();
+    return ALValue();
+  }
+};
+
+void checkParameters(const ALValue & parameters, unsigned int count);
+
+#define AL_HOST_ARG(i, A) fromALValue<typename Decay<A>::type>(parameters[i])
+
+template<typename Method>
+struct Invoker;
+
+template<typename C, typename R>
+struct Invoker<R (C::*)()>
+{
+  typedef C Class;
+
+  static ALValue call(C * object, R (C::*method)(), const ALValue & parameters)
+  {
+    checkParameters(parameters, 0);
+    return Call<R>::invoke(boost::bind(method, object));
+  }
+};
+
+template<typename C, typename R>
+struct Invoker<R (C::*)() const>
+{
+  typedef C Class;
+
+  static ALValue call(C * object, R (C::*method)() const, const ALValue & parameters)
+  {
+    checkParameters(parameters, 0);
+    return Call<R>::invoke(boost::bind(method, object));
+  }
+};
+
+template<typename C, typename R, typename A1>
+struct Invoker<R (C::*)(A1)>
+{
+  typedef C Class;
+
+  static ALValue call(C * object, R (C::*method)(A1), const ALValue & parameters)
+  {
+    checkParameters(parameters, 1);
+    return Call<R>::invoke(boost::bind(method, object, AL_HOST_ARG(0, A1)));
+  }
+};
+
+template<typename C, typename R, typename A1>
+struct Invoker<R (C::*)(A1) const>
+{
+  typedef C Class;
+
+  static ALValue call(C * object, R (C::*method)(A1) const, const ALValue & parameters)
+  {
+    checkParameters(parameters, 1);
+    return Call<R>::invoke(boost::bind(method, object, AL_HOST_ARG(0, A1)));
+  }
+};
+
+template<typename C, typename R, typename A1, typename A2>
+struct Invoker<R (C::*)(A1, A2)>
+{
+  typedef C Class;
+
+  static ALValue call(C * object, R (C::*method)(A1, A2), const ALValue & parameters)
+  {
+    checkParameters(parameters, 2);
+    return Call<R>::invoke(boost::bind(method, object, AL_HOST_ARG(0, A1), AL_HOST_ARG(1, A2)));
+  }
+};
+
+template<typename C, typename R, typename A1, typename A2, typename A3>
+struct Invoker<R (C::*)(A1, A2, A3)>
+{
+  typedef C Class;
+
+  static ALValue call(C * object, R (C::*method)(A1, A2, A3), const ALValue & parameters)
+  {
+    checkParameters(parameters, 3);
+    return Call<R>::invoke(boost::bind(method, object, AL_HOST_ARG(0, A1), AL_HOST_ARG(1, A2), AL_HOST_ARG(2, A3)));
+  }
+};
+
+template<typename C, typename R, typename A1, typename A2, typename A3, typename A4>
+struct Invoker<R (C::*)(A1, A2, A3, A4)>
+{
+  typedef C Class;
+
+  static ALValue call(C * object, R (C::*method)(A1, A2, A3, A4), const ALValue & parameters)
+  {
+    checkParameters(parameters, 4);
+    return Call<R>::invoke(boost::bind(method, object, AL_HOST_ARG(0, A1), AL_HOST_ARG(1, A2), AL_HOST_ARG(2, A3),
+                                       AL_HOST_ARG(3, A4)));
+  }
+};
+
+template<typename C, typename R, typename A1, typename A2, typename A3, typename A4, typename A5>
+struct Invoker<R (C::*)(A1, A2, A3, A4, A5)>
+{
+  typedef C Class;
+
+  static ALValue call(C * object, R (C::*method)(A1, A2, A3, A4, A5), const ALValue & parameters)
+  {
+    checkParameters(parameters, 5);
+    return Call<R>::invoke(boost::bind(method, object, AL_HOST_ARG(0, A1), AL_HOST_ARG(1, A2), AL_HOST_ARG(2, A3),
+                                       AL_HOST_ARG(3, A4), AL_HOST_ARG(4, A5)));
+  }
+};
+
+#undef AL_HOST_ARG
+} // namespace detail
+
+/** Method of a module called with its parameters packed in an ALValue array */
+class ALFunctorBase
+{
+public:
+  virtual ~ALFunctorBase() {}
+  virtual ALValue call(const ALValue & parameters) = 0;
+};
+
+template<typename C, typename Method>
+class ALFunctor : public ALFunctorBase
+{
+public:
+  ALFunctor(C * object, Method method) : object(object), method(method) {}
+
+  ALValue call(const ALValue & parameters)
+  {
+    return detail::Invoker<Method>::call(object, method, parameters);
+  }
+
+private:
+  C * object;
+  Method method;
+};
+
+template<typename C, typename Method>
+boost::shared_ptr<ALFunctorBase> createFunctor(C * object, Method method)
+{
+  return boost::shared_ptr<ALFunctorBase>(new ALFunctor<C, Method>(object, method));
+}
+
+} // namespace AL
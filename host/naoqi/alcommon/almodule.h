@@ -0,0 +1,86 @@
+#pragma once
+#include <alcommon/alfunctor.h>
+#include <alcommon/almodulecore.h>
+#include <alvalue/alvalue.h>
+#include <qi/log.hpp>
+
+#include <map>
+#include <vector>
+
+namespace AL
+{
+/**
+ * @brief Host stand-in of the NAOqi ALModule
+ *
+ * Methods bound with BIND_METHOD can be called by name through an ALProxy,
+ * with their parameters converted from ALValue as the NAOqi RPC layer does.
+ * There is no network: the call runs in the calling thread.
+ */
+class ALModule : public ALModuleCore
+{
+public:
+  ALModule(const boost::shared_ptr<ALBroker> & broker, const std::string & name) : ALModuleCore(broker, name) {}
+  virtual ~ALModule() {}
+
+  /** Construct and initialise a module and register it to the broker, as the NAOqi module loader does */
+  template<typename T>
+  static boost::shared_ptr<T> createModule(const boost::shared_ptr<ALBroker> & broker, const std::string & name)
+  {
+    boost::shared_ptr<T> module(new T(broker, name));
+    static_cast<ALModule &>(*module).init();
+    registerModule(broker, module);
+    return module;
+  }
+
+  virtual void init() {}
+  virtual void exit() {}
+
+  void setModuleDescription(const std::string & description)
+  {
+    moduleDescription = description;
+  }
+
+  const std::string & getModuleDescription() const
+  {
+    return moduleDescription;
+  }
+
+  /** Start the description of the next bound method */
+  void functionName(const std::string & method, const std::string &, const std::string &)
+  {
+    currentMethod = method;
+  }
+
+  void addParam(const std::string &, const std::string &) {}
+
+  void setReturn(const std::string &, const std::string &) {}
+
+  /** Names of the bound methods, in binding order */
+  const std::vector<std::string> & getMethodList() const
+  {
+    return methodNames;
+  }
+
+  virtual ALValue execute(const std::string & method, const ALValue & parameters);
+
+protected:
+  template<typename Method>
+  void bindMethod(Method method)
+  {
+    typedef typename detail::Invoker<Method>::Class Class;
+    methods[currentMethod] = createFunctor(static_cast<Class *>(this), method);
+    methodNames.push_back(currentMethod);
+  }
+
+private:
+  static void registerModule(const boost::shared_ptr<ALBroker> & broker, const boost::shared_ptr<ALModuleCore> & module);
+
+  std::string moduleDescription;
+  std::string currentMethod;
+  std::map<std::string, boost::shared_ptr<ALFunctorBase> > methods;
+  std::vector<std::string> methodNames;
+};
+
+} // namespace AL
+
+#define BIND_METHOD(method) bindMethod(&method)
@@ -0,0 +1,61 @@
+#pragma once
+#include <alerror/alerror.h>
+#include <alvalue/alvalue.h>
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/signals2/connection.hpp>
+
+#include <string>
+
+// Connection returned by atPreProcess/atPostProcess, disconnect() detaches the callback
+typedef boost::signals2::connection ProcessSignalConnection;
+
+namespace AL
+{
+class ALBroker;
+
+/** Host stand-in of the NAOqi ALModuleCore */
+class ALModuleCore
+{
+public:
+  ALModuleCore(const boost::shared_ptr<ALBroker> & broker, const std::string & name) : broker(broker), name(name) {}
+  virtual ~ALModuleCore() {}
+
+  const std::string & getName() const
+  {
+    return name;
+  }
+
+  boost::shared_ptr<ALBroker> getParentBroker() const
+  {
+    return broker;
+  }
+
+  /** Call a bound method, parameters packed in an array */
+  virtual ALValue execute(const std::string & method, const ALValue &)
+  {
+    throw ALERROR(name, method, "Unknown method");
+  }
+
+  /** Called before the DCM computes the orders sent to the chestboard, only implemented by the DCM */
+  virtual ProcessSignalConnection atPreProcess(const boost::function<void()> &)
+  {
+    throw ALERROR(name, "atPreProcess", "Not a process module");
+  }
+
+  /** Called after the DCM updated ALMemory with the values read from the chestboard, only implemented by the DCM */
+  virtual ProcessSignalConnection atPostProcess(const boost::function<void()> &)
+  {
+    throw ALERROR(name, "atPostProcess", "Not a process module");
+  }
+
+private:
+  ALModuleCore(const ALModuleCore &);
+  ALModuleCore & operator=(const ALModuleCore &);
+
+  boost::shared_ptr<ALBroker> broker;
+  std::string name;
+};
+
+} // namespace AL
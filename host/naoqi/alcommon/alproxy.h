@@ -0,0 +1,114 @@
+#pragma once
+#include <alcommon/alfunctor.h>
+#include <alcommon/almodulecore.h>
+#include <alvalue/alvalue.h>
+
+namespace AL
+{
+/**
+ * @brief Host stand-in of the generic NAOqi ALProxy
+ *
+ * Calls the methods bound by the modules registered to the broker, and
+ * ALLauncher.isModulePresent. Parameters and results go through ALValue as
+ * with NAOqi, but the call runs in the calling thread.
+ */
+class ALProxy
+{
+public:
+  ALProxy(const boost::shared_ptr<ALBroker> & broker, const std::string & module);
+
+  template<typename Result>
+  Result call(const std::string & method)
+  {
+    return result<Result>(genericCall(method, ALValue(std::vector<int>())));
+  }
+
+  template<typename Result, typename A1>
+  Result call(const std::string & method, const A1 & a1)
+  {
+    ALValue parameters;
+    parameters.arrayPush(a1);
+    return result<Result>(genericCall(method, parameters));
+  }
+
+  template<typename Result, typename A1, typename A2>
+  Result call(const std::string & method, const A1 & a1, const A2 & a2)
+  {
+    ALValue parameters;
+    parameters.arrayPush(a1);
+    parameters.arrayPush(a2);
+    return result<Result>(genericCall(method, parameters));
+  }
+
+  template<typename Result, typename A1, typename A2, typename A3>
+  Result call(const std::string & method, const A1 & a1, const A2 & a2, const A3 & a3)
+  {
+    ALValue parameters;
+    parameters.arrayPush(a1);
+    parameters.arrayPush(a2);
+    parameters.arrayPush(a3);
+    return result<Result>(genericCall(method, parameters));
+  }
+
+  void callVoid(const std::string & method)
+  {
+    genericCall(method, ALValue(std::vector<int>()));
+  }
+
+  template<typename A1>
+  void callVoid(const std::string & method, const A1 & a1)
+  {
+    ALValue parameters;
+    parameters.arrayPush(a1);
+    genericCall(method, parameters);
+  }
+
+  template<typename A1, typename A2>
+  void callVoid(const std::string & method, const A1 & a1, const A2 & a2)
+  {
+    ALValue parameters;
+    parameters.arrayPush(a1);
+    parameters.arrayPush(a2);
+    genericCall(method, parameters);
+  }
+
+  template<typename A1, typename A2, typename A3>
+  void callVoid(const std::string & method, const A1 & a1, const A2 & a2, const A3 & a3)
+  {
+    ALValue parameters;
+    parameters.arrayPush(a1);
+    parameters.arrayPush(a2);
+    parameters.arrayPush(a3);
+    genericCall(method, parameters);
+  }
+
+  template<typename A1, typename A2, typename A3, typename A4>
+  void callVoid(const std::string & method, const A1 & a1, const A2 & a2, const A3 & a3, const A4 & a4)
+  {
+    ALValue parameters;
+    parameters.arrayPush(a1);
+    parameters.arrayPush(a2);
+    parameters.arrayPush(a3);
+    parameters.arrayPush(a4);
+    genericCall(method, parameters);
+  }
+
+  /** Call with the parameters already packed in an array */
+  ALValue genericCall(const std::string & method, const ALValue & parameters);
+
+  /** Module behind the proxy */
+  boost::shared_ptr<ALModuleCore> getModule() const;
+
+private:
+  template<typename Result>
+  static Result result(const ALValue & value)
+  {
+    return detail::fromALValue<Result>(value);
+  }
+
+  boost::shared_ptr<ALBroker> broker;
+  std::string moduleName;
+  boost::shared_ptr<ALModuleCore> module;
+};
+
+} // namespace AL
@@ -0,0 +1,52 @@
+#pragma once
+#include <exception>
+#include <string>
+
+namespace AL
+{
+/** Host stand-in of the NAOqi ALError */
+class ALError : public std::exception
+{
+public:
+  ALError(const std::string & module, const std::string & method, const std::string & description)
+  : moduleName(module), methodName(method), errorDescription(description),
+    message(module + "::" + method + " " + description)
+  {
+  }
+  virtual ~ALError() throw() {}
+
+  virtual const char * what() const throw()
+  {
+    return message.c_str();
+  }
+
+  std::string toString() const
+  {
+    return message;
+  }
+
+  const std::string & getModuleName() const
+  {
+    return moduleName;
+  }
+
+  const std::string & getFunctionName() const
+  {
+    return methodName;
+  }
+
+  const std::string & getDescription() const
+  {
+    return errorDescription;
+  }
+
+private:
+  std::string moduleName;
+  std::string methodName;
+  std::string errorDescription;
+  std::string message;
+};
+
+} // namespace AL
+
+#define ALERROR(module, method, description) AL::ALError(module, method, description)
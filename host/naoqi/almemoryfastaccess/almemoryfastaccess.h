@@ -0,0 +1,31 @@
+#pragma once
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+#include <vector>
+
+namespace AL
+{
+class ALBroker;
+class FakeDCM;
+
+/** Host stand-in of the NAOqi ALMemoryFastAccess, reading the memory of the fake DCM */
+class ALMemoryFastAccess
+{
+public:
+  ALMemoryFastAccess() {}
+
+  /** Missing keys are created with the value 0 */
+  void ConnectToVariables(const boost::shared_ptr<ALBroker> & broker,
+                          const std::vector<std::string> & keys,
+                          bool notify = false);
+
+  /** Read the connected keys, does not allocate if values already has the right size */
+  void GetValues(std::vector<float> & values);
+
+private:
+  boost::shared_ptr<FakeDCM> dcm;
+  std::vector<const float *> variables;
+};
+
+} // namespace AL
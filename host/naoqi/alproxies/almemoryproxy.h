@@ -0,0 +1,32 @@
+#pragma once
+#include <alvalue/alvalue.h>
+
+#include <boost/shared_ptr.hpp>
+
+namespace AL
+{
+class ALBroker;
+class FakeDCM;
+
+/**
+ * @brief Host stand-in of the NAOqi ALMemoryProxy
+ *
+ * Memory values are floats. Event subscriptions are accepted but no event
+ * is ever raised.
+ */
+class ALMemoryProxy
+{
+public:
+  explicit ALMemoryProxy(const boost::shared_ptr<ALBroker> & broker);
+
+  ALValue getData(const std::string & key);
+  void insertData(const std::string & key, const float & value);
+
+  void subscribeToEvent(const std::string & event, const std::string & module, const std::string & callback);
+  void unsubscribeToEvent(const std::string & event, const std::string & module);
+
+private:
+  boost::shared_ptr<FakeDCM> dcm;
+};
+
+} // namespace AL
@@ -0,0 +1,24 @@
+#pragma once
+#include <qi/log.hpp>
+
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+
+namespace AL
+{
+class ALBroker;
+
+/** Host stand-in of the NAOqi ALTextToSpeechProxy, the text is logged */
+class ALTextToSpeechProxy
+{
+public:
+  explicit ALTextToSpeechProxy(const boost::shared_ptr<ALBroker> &) {}
+
+  void say(const std::string & text)
+  {
+    qiLogInfo("ALTextToSpeech") << text << std::endl;
+  }
+};
+
+} // namespace AL
@@ -0,0 +1,30 @@
+#pragma once
+#include <alvalue/alvalue.h>
+
+#include <boost/shared_ptr.hpp>
+
+namespace AL
+{
+class ALBroker;
+class FakeDCM;
+
+/** Host stand-in of the NAOqi DCMProxy, forwarding to the fake DCM of the broker */
+class DCMProxy
+{
+public:
+  explicit DCMProxy(const boost::shared_ptr<ALBroker> & broker);
+
+  /** DCM time (ms) plus offset */
+  int getTime(const int & offset);
+
+  /** [aliasName, [memory keys]], returns the alias */
+  ALValue createAlias(const ALValue & alias);
+
+  /** [aliasName, updateType, "time-separate", 0, [times], [[values of key 0], ...]] */
+  void setAlias(const ALValue & command);
+
+private:
+  boost::shared_ptr<FakeDCM> dcm;
+};
+
+} // namespace AL
@@ -0,0 +1,27 @@
+#pragma once
+#include <althread/almutex.h>
+
+namespace AL
+{
+/** Host stand-in of the NAOqi ALCriticalSection: holds the mutex for its lifetime */
+class ALCriticalSection
+{
+public:
+  explicit ALCriticalSection(const boost::shared_ptr<ALMutex> & mutex) : mutex(mutex)
+  {
+    mutex->lock();
+  }
+
+  ~ALCriticalSection()
+  {
+    mutex->unlock();
+  }
+
+private:
+  ALCriticalSection(const ALCriticalSection &);
+  ALCriticalSection & operator=(const ALCriticalSection &);
+
+  boost::shared_ptr<ALMutex> mutex;
+};
+
+} // namespace AL
@@ -0,0 +1,34 @@
+#pragma once
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace AL
+{
+/** Host stand-in of the NAOqi ALMutex, locked with ALCriticalSection */
+class ALMutex
+{
+public:
+  static boost::shared_ptr<ALMutex> createALMutex()
+  {
+    return boost::shared_ptr<ALMutex>(new ALMutex());
+  }
+
+  void lock()
+  {
+    mutex.lock();
+  }
+
+  void unlock()
+  {
+    mutex.unlock();
+  }
+
+private:
+  ALMutex() {}
+  ALMutex(const ALMutex &);
+  ALMutex & operator=(const ALMutex &);
+
+  boost::mutex mutex;
+};
+
+} // namespace AL
@@ -0,0 +1,136 @@
+#pragma once
+#include <alerror/alerror.h>
+
+#include <string>
+#include <vector>
+
+namespace AL
+{
+/**
+ * @brief Host stand-in of the NAOqi ALValue
+ *
+ * Holds a bool, an int, a float, a string or an array of ALValue. Reading a
+ * value with the wrong type or out of range throws ALError, as NAOqi does.
+ * Assigning a number to an element that already holds a number never
+ * allocates, so that the preallocated DCM commands can be refilled by the
+ * real-time callback.
+ */
+class ALValue
+{
+public:
+  enum Type
+  {
+    TypeInvalid = 0,
+    TypeBool,
+    TypeInt,
+    TypeFloat,
+    TypeString,
+    TypeArray
+  };
+
+  ALValue() : type(TypeInvalid), boolValue(false), intValue(0), floatValue(0.0f) {}
+  ALValue(bool value) : type(TypeBool), boolValue(value), intValue(0), floatValue(0.0f) {}
+  ALValue(int value) : type(TypeInt), boolValue(false), intValue(value), floatValue(0.0f) {}
+  ALValue(unsigned int value) : type(TypeInt), boolValue(false), intValue(static_cast<int>(value)), floatValue(0.0f)
+  {
+  }
+  ALValue(float value) : type(TypeFloat), boolValue(false), intValue(0), floatValue(value) {}
+  // NAOqi stores doubles as floats
+  ALValue(double value) : type(TypeFloat), boolValue(false), intValue(0), floatValue(static_cast<float>(value)) {}
+  ALValue(const char * value) : type(TypeString), boolValue(false), intValue(0), floatValue(0.0f), stringValue(value) {}
+  ALValue(const std::string & value)
+  : type(TypeString), boolValue(false), intValue(0), floatValue(0.0f), stringValue(value)
+  {
+  }
+  ALValue(const std::vector<float> & values);
+  ALValue(const std::vector<int> & values);
+  ALValue(const std::vector<std::string> & values);
+
+  ALValue & operator=(bool value);
+  ALValue & operator=(int value);
+  ALValue & operator=(unsigned int value);
+  ALValue & operator=(float value);
+  ALValue & operator=(double value);
+  ALValue & operator=(const char * value);
+  ALValue & operator=(const std::string & value);
+
+  Type getType() const
+  {
+    return type;
+  }
+
+  bool isValid() const
+  {
+    return type != TypeInvalid;
+  }
+  bool isBool() const
+  {
+    return type == TypeBool;
+  }
+  bool isInt() const
+  {
+    return type == TypeInt;
+  }
+  bool isFloat() const
+  {
+    return type == TypeFloat;
+  }
+  bool isString() const
+  {
+    return type == TypeString;
+  }
+  bool isArray() const
+  {
+    return type == TypeArray;
+  }
+
+  /** Number of elements of an array, 0 for other types */
+  unsigned int getSize() const
+  {
+    return type == TypeArray ? static_cast<unsigned int>(arrayValue.size()) : 0;
+  }
+
+  /** Turn the value into an array of size elements, keeping the existing ones */
+  void arraySetSize(int size);
+  void arrayReserve(int size);
+  void arrayPush(const ALValue & value);
+  void clear();
+
+  ALValue & operator[](int i);
+  const ALValue & operator[](int i) const;
+
+  operator const bool &() const;
+  operator bool &();
+  operator const int &() const;
+  operator int &();
+  operator const float &() const;
+  operator float &();
+  operator const std::string &() const;
+  operator std::string &();
+  operator std::vector<float>() const;
+  operator std::vector<int>() const;
+  operator std::vector<std::string>() const;
+
+  bool operator==(const ALValue & other) const;
+  bool operator!=(const ALValue & other) const
+  {
+    return !(*this == other);
+  }
+
+  /** Human-readable representation, e.g. [1, 2.5, "a"] */
+  std::string toString() const;
+
+private:
+  void checkType(Type expected, const char * method) const;
+  // Change the type, keeping the allocated storage
+  void setType(Type newType);
+
+  Type type;
+  bool boolValue;
+  int intValue;
+  float floatValue;
+  std::string stringValue;
+  std::vector<ALValue> arrayValue;
+};
+
+} // namespace AL
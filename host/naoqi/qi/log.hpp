@@ -0,0 +1,8 @@
+#pragma once
+#include <iostream>
+
+// Host stand-in of the qi logging macros: every level goes to stderr
+#define qiLogDebug(category) std::cerr << "[D] " << category << ": "
+#define qiLogInfo(category) std::cerr << "[I] " << category << ": "
+#define qiLogWarning(category) std::cerr << "[W] " << category << ": "
+#define qiLogError(category) std::cerr << "[E] " << category << ": "
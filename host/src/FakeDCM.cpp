@@ -0,0 +1,489 @@
+#include "FakeDCM.h"
+
+#include <errno.h>
+#include <time.h>
+
+#include <fstream>
+
+namespace AL
+{
+
+namespace
+{
+long long monotonicTimeUs()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+void sleepUntil(long long timeUs)
+{
+  struct timespec deadline;
+  deadline.tv_sec = timeUs / 1000000LL;
+  deadline.tv_nsec = (timeUs % 1000000LL) * 1000;
+  while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, 0) == EINTR)
+  {
+  }
+}
+
+float toFloat(const ALValue & value)
+{
+  return value.isInt() ? static_cast<float>(static_cast<const int &>(value)) : static_cast<const float &>(value);
+}
+
+const std::string actuatorSuffix = "/Actuator/Value";
+const std::string sensorSuffix = "/Sensor/Value";
+} // namespace
+
+FakeDCM::FakeDCM()
+: ALModuleCore(boost::shared_ptr<ALBroker>(), "DCM"), logging(false), numUnlogged(0), replayCycle(-1),
+  getTimeLatency(0), numCycles(0), numCommands(0), numDroppedPoints(0), timerRunning(false), replaying(false)
+{
+}
+
+FakeDCM::~FakeDCM()
+{
+  stop();
+}
+
+ProcessSignalConnection FakeDCM::atPreProcess(const boost::function<void()> & callback)
+{
+  return preProcess.connect(callback);
+}
+
+ProcessSignalConnection FakeDCM::atPostProcess(const boost::function<void()> & callback)
+{
+  return postProcess.connect(callback);
+}
+
+int FakeDCM::getTime(int offset)
+{
+  long long now = monotonicTimeUs();
+  unsigned int latency = getTimeLatency.load(boost::memory_order_relaxed);
+  if(latency)
+  {
+    while(monotonicTimeUs() - now < latency)
+    {
+    }
+  }
+  return static_cast<int>(now / 1000) + offset;
+}
+
+ALValue FakeDCM::createAlias(const ALValue & alias)
+{
+  if(!alias.isArray() || alias.getSize() != 2 || !alias[0].isString() || !alias[1].isArray())
+  {
+    throw ALERROR(getName(), "createAlias", "Expected [aliasName, [memory keys]], got " + alias.toString());
+  }
+  boost::mutex::scoped_lock lock(mutex);
+  std::vector<Key *> & aliasKeys = aliases[alias[0]];
+  aliasKeys.clear();
+  aliasCommands[alias[0]] = 0;
+  for(unsigned int i = 0; i < alias[1].getSize(); i++)
+  {
+    const std::string & name = alias[1][i];
+    std::map<std::string, Key>::iterator it = keys.find(name);
+    if(it == keys.end())
+    {
+      Key & key = keys[name];
+      key.actuator = variable(name);
+      key.sensor = 0;
+      if(name.size() > actuatorSuffix.size()
+         && name.compare(name.size() - actuatorSuffix.size(), actuatorSuffix.size(), actuatorSuffix) == 0)
+      {
+        key.sensor = variable(name.substr(0, name.size() - actuatorSuffix.size()) + sensorSuffix);
+      }
+      key.times.reserve(maxPointsPerKey);
+      key.values.reserve(maxPointsPerKey);
+      it = keys.find(name);
+    }
+    aliasKeys.push_back(&it->second);
+  }
+  return alias;
+}
+
+void FakeDCM::setAlias(const ALValue & command)
+{
+  if(!command.isArray() || command.getSize() != 6 || !command[0].isString() || !command[1].isString()
+     || !command[2].isString() || !command[4].isArray() || !command[5].isArray())
+  {
+    throw ALERROR(getName(), "setAlias", "Expected a time-separate command, got " + command.toString());
+  }
+  const std::string & updateType = command[1];
+  if(static_cast<const std::string &>(command[2]) != "time-separate")
+  {
+    throw ALERROR(getName(), "setAlias", "Only time-separate commands are supported");
+  }
+  const ALValue & times = command[4];
+  const ALValue & values = command[5];
+
+  boost::mutex::scoped_lock lock(mutex);
+  std::map<std::string, std::vector<Key *> >::iterator alias = aliases.find(command[0]);
+  if(alias == aliases.end())
+  {
+    throw ALERROR(getName(), "setAlias", "Unknown alias " + static_cast<const std::string &>(command[0]));
+  }
+  std::vector<Key *> & aliasKeys = alias->second;
+  if(values.getSize() != aliasKeys.size())
+  {
+    throw ALERROR(getName(), "setAlias", "Wrong number of keys for alias " + alias->first);
+  }
+  for(size_t j = 0; j < aliasKeys.size(); j++)
+  {
+    if(values[j].getSize() != times.getSize())
+    {
+      throw ALERROR(getName(), "setAlias", "Wrong number of values for alias " + alias->first);
+    }
+  }
+  numCommands.fetch_add(1, boost::memory_order_relaxed);
+  aliasCommands.find(alias->first)->second++;
+  if(logging)
+  {
+    logCommand(alias->first, times, values);
+  }
+
+  for(size_t j = 0; j < aliasKeys.size(); j++)
+  {
+    Key & key = *aliasKeys[j];
+    if(updateType == "ClearAll")
+    {
+      key.times.clear();
+      key.values.clear();
+    }
+    else if(updateType == "ClearAfter" && times.getSize())
+    {
+      // drop the points at or after the first new one
+      int first = times[0];
+      size_t keep = 0;
+      while(keep < key.times.size() && key.times[keep] < first)
+      {
+        keep++;
+      }
+      key.times.resize(keep);
+      key.values.resize(keep);
+    }
+    else if(updateType == "ClearBefore" && times.getSize())
+    {
+      // drop the points before the last new one
+      int last = times[times.getSize() - 1];
+      size_t drop = 0;
+      while(drop < key.times.size() && key.times[drop] < last)
+      {
+        drop++;
+      }
+      key.times.erase(key.times.begin(), key.times.begin() + drop);
+      key.values.erase(key.values.begin(), key.values.begin() + drop);
+    }
+    else if(updateType != "Merge" && updateType != "ClearAfter" && updateType != "ClearBefore")
+    {
+      throw ALERROR(getName(), "setAlias", "Unknown update type " + updateType);
+    }
+    for(unsigned int k = 0; k < times.getSize(); k++)
+    {
+      queuePoint(key, times[k], toFloat(values[j][k]));
+    }
+  }
+}
+
+unsigned int FakeDCM::commands(const std::string & alias)
+{
+  boost::mutex::scoped_lock lock(mutex);
+  std::map<std::string, unsigned int>::const_iterator it = aliasCommands.find(alias);
+  return it == aliasCommands.end() ? 0 : it->second;
+}
+
+const float * FakeDCM::memoryValue(const std::string & key)
+{
+  boost::mutex::scoped_lock lock(mutex);
+  return variable(key);
+}
+
+float FakeDCM::getMemoryValue(const std::string & key)
+{
+  boost::mutex::scoped_lock lock(mutex);
+  return *variable(key);
+}
+
+void FakeDCM::setMemoryValue(const std::string & key, float value)
+{
+  boost::mutex::scoped_lock lock(mutex);
+  *variable(key) = value;
+}
+
+void FakeDCM::readValues(const std::vector<const float *> & variables, std::vector<float> & values)
+{
+  values.resize(variables.size());
+  boost::mutex::scoped_lock lock(mutex);
+  for(size_t i = 0; i < variables.size(); i++)
+  {
+    values[i] = *variables[i];
+  }
+}
+
+void FakeDCM::start(unsigned int periodUs, unsigned int jitterUs)
+{
+  stop();
+  timerRunning = true;
+  timer = boost::thread(&FakeDCM::timerLoop, this, periodUs, jitterUs);
+}
+
+void FakeDCM::stop()
+{
+  timerRunning = false;
+  timer.join();
+}
+
+bool FakeDCM::running() const
+{
+  return timerRunning;
+}
+
+void FakeDCM::runCycle()
+{
+  runPreProcess();
+  runPostProcess();
+}
+
+void FakeDCM::runPreProcess()
+{
+  preProcess();
+}
+
+void FakeDCM::runPostProcess()
+{
+  applyCommands(getTime(0));
+  postProcess();
+  numCycles.fetch_add(1, boost::memory_order_relaxed);
+}
+
+unsigned int FakeDCM::replay(const mc_naoqi_dcm::FlightRecording & recording,
+                             const std::vector<std::string> & sensorKeys,
+                             bool realTime)
+{
+  if(sensorKeys.size() != recording.sensorNames.size())
+  {
+    throw ALERROR(getName(), "replay", "Expected one memory key per recorded sensor");
+  }
+  std::vector<float *> variables(sensorKeys.size());
+  {
+    boost::mutex::scoped_lock lock(mutex);
+    for(size_t i = 0; i < sensorKeys.size(); i++)
+    {
+      variables[i] = variable(sensorKeys[i]);
+    }
+  }
+  replaying = true;
+  long long tick = monotonicTimeUs();
+  unsigned int replayed = 0;
+  for(; replayed < recording.sensors.size() && replaying; replayed++)
+  {
+    if(realTime)
+    {
+      tick += recording.dcmPeriodUs;
+      sleepUntil(tick);
+    }
+    {
+      boost::mutex::scoped_lock lock(mutex);
+      replayCycle = recording.cycles[replayed];
+    }
+    runPreProcess();
+    applyCommands(getTime(0));
+    {
+      // in place of the ideal robot
+      boost::mutex::scoped_lock lock(mutex);
+      const std::vector<float> & sensors = recording.sensors[replayed];
+      for(size_t i = 0; i < variables.size(); i++)
+      {
+        *variables[i] = sensors[i];
+      }
+    }
+    postProcess();
+    numCycles.fetch_add(1, boost::memory_order_relaxed);
+  }
+  {
+    boost::mutex::scoped_lock lock(mutex);
+    replayCycle = -1;
+  }
+  replaying = false;
+  return replayed;
+}
+
+void FakeDCM::stopReplay()
+{
+  replaying = false;
+}
+
+void FakeDCM::startCommandLog(unsigned int maxCommands, unsigned int maxTimes, unsigned int maxValues)
+{
+  boost::mutex::scoped_lock lock(mutex);
+  commandLog.clear();
+  loggedTimes.clear();
+  loggedValues.clear();
+  commandLog.reserve(maxCommands);
+  loggedTimes.reserve(maxTimes);
+  loggedValues.reserve(maxValues);
+  numUnlogged = 0;
+  logging = true;
+}
+
+void FakeDCM::stopCommandLog()
+{
+  boost::mutex::scoped_lock lock(mutex);
+  logging = false;
+}
+
+unsigned int FakeDCM::loggedCommands()
+{
+  boost::mutex::scoped_lock lock(mutex);
+  return commandLog.size();
+}
+
+unsigned int FakeDCM::unloggedCommands()
+{
+  boost::mutex::scoped_lock lock(mutex);
+  return numUnlogged;
+}
+
+void FakeDCM::saveCommandLog(const std::string & path)
+{
+  boost::mutex::scoped_lock lock(mutex);
+  std::ofstream out(path.c_str());
+  if(!out)
+  {
+    throw ALERROR(getName(), "saveCommandLog", "Cannot open " + path);
+  }
+  // enough digits to read the floats back exactly
+  out.precision(9);
+  out << "cycle,alias,times,values\n";
+  for(size_t i = 0; i < commandLog.size(); i++)
+  {
+    const LoggedCommand & command = commandLog[i];
+    out << command.cycle << ',' << *command.alias << ',';
+    for(unsigned int k = 0; k < command.numTimes; k++)
+    {
+      out << (k ? ";" : "") << loggedTimes[command.firstTime + k];
+    }
+    out << ',';
+    for(unsigned int k = 0; k < command.numKeys * command.numTimes; k++)
+    {
+      out << (k ? ";" : "") << loggedValues[command.firstValue + k];
+    }
+    out << '\n';
+  }
+  if(!out)
+  {
+    throw ALERROR(getName(), "saveCommandLog", "Cannot write " + path);
+  }
+}
+
+void FakeDCM::setGetTimeLatency(unsigned int latencyUs)
+{
+  getTimeLatency.store(latencyUs, boost::memory_order_relaxed);
+}
+
+void FakeDCM::timerLoop(unsigned int periodUs, unsigned int jitterUs)
+{
+  // deterministic jitter sequence
+  unsigned int seed = 1;
+  long long tick = monotonicTimeUs();
+  while(timerRunning)
+  {
+    tick += periodUs;
+    long long delay = 0;
+    if(jitterUs)
+    {
+      seed = seed * 1103515245u + 12345u;
+      delay = (seed >> 8) % (jitterUs + 1);
+    }
+    sleepUntil(tick + delay);
+    runCycle();
+    // restart the schedule after a long stall instead of running cycles back to back
+    long long now = monotonicTimeUs();
+    if(now > tick + periodUs)
+    {
+      tick = now;
+    }
+  }
+}
+
+float * FakeDCM::variable(const std::string & key)
+{
+  // operator[] inserts 0 for a new key
+  return &memory[key];
+}
+
+void FakeDCM::applyCommands(int dcmTime)
+{
+  boost::mutex::scoped_lock lock(mutex);
+  for(std::map<std::string, Key>::iterator it = keys.begin(); it != keys.end(); ++it)
+  {
+    Key & key = it->second;
+    size_t reached = 0;
+    while(reached < key.times.size() && key.times[reached] <= dcmTime)
+    {
+      reached++;
+    }
+    if(reached == 0)
+    {
+      continue;
+    }
+    *key.actuator = key.values[reached - 1];
+    if(key.sensor)
+    {
+      *key.sensor = *key.actuator;
+    }
+    key.times.erase(key.times.begin(), key.times.begin() + reached);
+    key.values.erase(key.values.begin(), key.values.begin() + reached);
+  }
+}
+
+void FakeDCM::logCommand(const std::string & alias, const ALValue & times, const ALValue & values)
+{
+  unsigned int numTimes = times.getSize();
+  unsigned int numKeys = values.getSize();
+  if(commandLog.size() == commandLog.capacity() || loggedTimes.size() + numTimes > loggedTimes.capacity()
+     || loggedValues.size() + numKeys * numTimes > loggedValues.capacity())
+  {
+    numUnlogged++;
+    return;
+  }
+  LoggedCommand command;
+  command.cycle = replayCycle >= 0 ? static_cast<unsigned int>(replayCycle) : cycles();
+  command.alias = &alias;
+  command.firstTime = loggedTimes.size();
+  command.firstValue = loggedValues.size();
+  command.numTimes = numTimes;
+  command.numKeys = numKeys;
+  commandLog.push_back(command);
+  for(unsigned int k = 0; k < numTimes; k++)
+  {
+    loggedTimes.push_back(times[k]);
+  }
+  for(unsigned int j = 0; j < numKeys; j++)
+  {
+    for(unsigned int k = 0; k < numTimes; k++)
+    {
+      loggedValues.push_back(toFloat(values[j][k]));
+    }
+  }
+}
+
+void FakeDCM::queuePoint(Key & key, int time, float value)
+{
+  if(key.times.size() == maxPointsPerKey)
+  {
+    numDroppedPoints.fetch_add(1, boost::memory_order_relaxed);
+    return;
+  }
+  // keep the points in time order, within the reserved capacity
+  size_t position = key.times.size();
+  while(position > 0 && key.times[position - 1] > time)
+  {
+    position--;
+  }
+  key.times.insert(key.times.begin() + position, time);
+  key.values.insert(key.values.begin() + position, value);
+}
+
+} // namespace AL
@@ -0,0 +1,148 @@
+#include <alcommon/albroker.h>
+#include <alcommon/alproxy.h>
+#include <almemoryfastaccess/almemoryfastaccess.h>
+#include <alproxies/almemoryproxy.h>
+#include <alproxies/dcmproxy.h>
+
+#include "FakeDCM.h"
+
+namespace AL
+{
+
+ALBroker::ALBroker() : dcm(new FakeDCM())
+{
+  registerModule(dcm);
+}
+
+ALBroker::~ALBroker() {}
+
+boost::shared_ptr<DCMProxy> ALBroker::getDcmProxy()
+{
+  return boost::shared_ptr<DCMProxy>(new DCMProxy(shared_from_this()));
+}
+
+boost::shared_ptr<ALMemoryProxy> ALBroker::getMemoryProxy()
+{
+  return boost::shared_ptr<ALMemoryProxy>(new ALMemoryProxy(shared_from_this()));
+}
+
+boost::shared_ptr<ALProxy> ALBroker::getProxy(const std::string & module)
+{
+  return boost::shared_ptr<ALProxy>(new ALProxy(shared_from_this(), module));
+}
+
+void ALBroker::registerModule(const boost::shared_ptr<ALModuleCore> & module)
+{
+  modules[module->getName()] = module;
+}
+
+boost::shared_ptr<ALModuleCore> ALBroker::getModuleByName(const std::string & name)
+{
+  std::map<std::string, boost::weak_ptr<ALModuleCore> >::iterator it = modules.find(name);
+  boost::shared_ptr<ALModuleCore> module;
+  if(it != modules.end())
+  {
+    module = it->second.lock();
+  }
+  if(!module)
+  {
+    throw ALERROR("ALBroker", "getModuleByName", "Module " + name + " is not available on the host");
+  }
+  return module;
+}
+
+ALProxy::ALProxy(const boost::shared_ptr<ALBroker> & broker, const std::string & module)
+: broker(broker), moduleName(module)
+{
+  // ALLauncher is emulated by the proxy itself
+  if(moduleName != "ALLauncher")
+  {
+    this->module = broker->getModuleByName(moduleName);
+  }
+}
+
+boost::shared_ptr<ALModuleCore> ALProxy::getModule() const
+{
+  if(!module)
+  {
+    throw ALERROR("ALProxy", "getModule", "Module " + moduleName + " is not local");
+  }
+  return module;
+}
+
+ALValue ALProxy::genericCall(const std::string & method, const ALValue & parameters)
+{
+  if(module)
+  {
+    return module->execute(method, parameters);
+  }
+  if(method == "isModulePresent" && parameters.getSize() == 1 && parameters[0].isString())
+  {
+    try
+    {
+      broker->getModuleByName(parameters[0]);
+      return ALValue(true);
+    }
+    catch(const ALError &)
+    {
+      return ALValue(false);
+    }
+  }
+  throw ALERROR("ALProxy", method, "ALLauncher." + method + " is not available on the host");
+}
+
+DCMProxy::DCMProxy(const boost::shared_ptr<ALBroker> & broker) : dcm(broker->fakeDCM()) {}
+
+int DCMProxy::getTime(const int & offset)
+{
+  return dcm->getTime(offset);
+}
+
+ALValue DCMProxy::createAlias(const ALValue & alias)
+{
+  return dcm->createAlias(alias);
+}
+
+void DCMProxy::setAlias(const ALValue & command)
+{
+  dcm->setAlias(command);
+}
+
+ALMemoryProxy::ALMemoryProxy(const boost::shared_ptr<ALBroker> & broker) : dcm(broker->fakeDCM()) {}
+
+ALValue ALMemoryProxy::getData(const std::string & key)
+{
+  return ALValue(dcm->getMemoryValue(key));
+}
+
+void ALMemoryProxy::insertData(const std::string & key, const float & value)
+{
+  dcm->setMemoryValue(key, value);
+}
+
+void ALMemoryProxy::subscribeToEvent(const std::string &, const std::string &, const std::string &) {}
+
+void ALMemoryProxy::unsubscribeToEvent(const std::string &, const std::string &) {}
+
+void ALMemoryFastAccess::ConnectToVariables(const boost::shared_ptr<ALBroker> & broker,
+                                            const std::vector<std::string> & keys,
+                                            bool)
+{
+  dcm = broker->fakeDCM();
+  variables.resize(keys.size());
+  for(size_t i = 0; i < keys.size(); i++)
+  {
+    variables[i] = dcm->memoryValue(keys[i]);
+  }
+}
+
+void ALMemoryFastAccess::GetValues(std::vector<float> & values)
+{
+  if(!dcm)
+  {
+    throw ALERROR("ALMemoryFastAccess", "GetValues", "Not connected");
+  }
+  dcm->readValues(variables, values);
+}
+
+} // namespace AL
@@ -0,0 +1,33 @@
+#include <alcommon/albroker.h>
+#include <alcommon/almodule.h>
+
+namespace AL
+{
+
+namespace detail
+{
+void checkParameters(const ALValue & parameters, unsigned int count)
+{
+  if(parameters.getSize() != count)
+  {
+    throw ALERROR("ALModule", "call", "Wrong number of parameters: " + parameters.toString());
+  }
+}
+} // namespace detail
+
+ALValue ALModule::execute(const std::string & method, const ALValue & parameters)
+{
+  std::map<std::string, boost::shared_ptr<ALFunctorBase> >::iterator it = methods.find(method);
+  if(it == methods.end())
+  {
+    throw ALERROR(getName(), method, "Unknown method");
+  }
+  return it->second->call(parameters);
+}
+
+void ALModule::registerModule(const boost::shared_ptr<ALBroker> & broker, const boost::shared_ptr<ALModuleCore> & module)
+{
+  broker->registerModule(module);
+}
+
+} // namespace AL
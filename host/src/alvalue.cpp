@@ -0,0 +1,289 @@
+#include <alvalue/alvalue.h>
+
+#include <sstream>
+
+namespace AL
+{
+
+namespace
+{
+const char * typeName(ALValue::Type type)
+{
+  switch(type)
+  {
+    case ALValue::TypeBool:
+      return "bool";
+    case ALValue::TypeInt:
+      return "int";
+    case ALValue::TypeFloat:
+      return "float";
+    case ALValue::TypeString:
+      return "string";
+    case ALValue::TypeArray:
+      return "array";
+    default:
+      return "invalid";
+  }
+}
+} // namespace
+
+ALValue::ALValue(const std::vector<float> & values)
+: type(TypeArray), boolValue(false), intValue(0), floatValue(0.0f), arrayValue(values.begin(), values.end())
+{
+}
+
+ALValue::ALValue(const std::vector<int> & values)
+: type(TypeArray), boolValue(false), intValue(0), floatValue(0.0f), arrayValue(values.begin(), values.end())
+{
+}
+
+ALValue::ALValue(const std::vector<std::string> & values)
+: type(TypeArray), boolValue(false), intValue(0), floatValue(0.0f), arrayValue(values.begin(), values.end())
+{
+}
+
+ALValue & ALValue::operator=(bool value)
+{
+  setType(TypeBool);
+  boolValue = value;
+  return *this;
+}
+
+ALValue & ALValue::operator=(int value)
+{
+  setType(TypeInt);
+  intValue = value;
+  return *this;
+}
+
+ALValue & ALValue::operator=(unsigned int value)
+{
+  return *this = static_cast<int>(value);
+}
+
+ALValue & ALValue::operator=(float value)
+{
+  setType(TypeFloat);
+  floatValue = value;
+  return *this;
+}
+
+ALValue & ALValue::operator=(double value)
+{
+  return *this = static_cast<float>(value);
+}
+
+ALValue & ALValue::operator=(const char * value)
+{
+  setType(TypeString);
+  stringValue = value;
+  return *this;
+}
+
+ALValue & ALValue::operator=(const std::string & value)
+{
+  setType(TypeString);
+  stringValue = value;
+  return *this;
+}
+
+void ALValue::arraySetSize(int size)
+{
+  setType(TypeArray);
+  arrayValue.resize(size);
+}
+
+void ALValue::arrayReserve(int size)
+{
+  setType(TypeArray);
+  arrayValue.reserve(size);
+}
+
+void ALValue::arrayPush(const ALValue & value)
+{
+  setType(TypeArray);
+  arrayValue.push_back(value);
+}
+
+void ALValue::clear()
+{
+  type = TypeInvalid;
+  stringValue.clear();
+  arrayValue.clear();
+}
+
+ALValue & ALValue::operator[](int i)
+{
+  checkType(TypeArray, "operator[]");
+  if(i < 0 || i >= static_cast<int>(arrayValue.size()))
+  {
+    throw ALERROR("ALValue", "operator[]", "Index out of range");
+  }
+  return arrayValue[i];
+}
+
+const ALValue & ALValue::operator[](int i) const
+{
+  checkType(TypeArray, "operator[]");
+  if(i < 0 || i >= static_cast<int>(arrayValue.size()))
+  {
+    throw ALERROR("ALValue", "operator[]", "Index out of range");
+  }
+  return arrayValue[i];
+}
+
+ALValue::operator const bool &() const
+{
+  checkType(TypeBool, "operator bool");
+  return boolValue;
+}
+
+ALValue::operator bool &()
+{
+  checkType(TypeBool, "operator bool");
+  return boolValue;
+}
+
+ALValue::operator const int &() const
+{
+  checkType(TypeInt, "operator int");
+  return intValue;
+}
+
+ALValue::operator int &()
+{
+  checkType(TypeInt, "operator int");
+  return intValue;
+}
+
+ALValue::operator const float &() const
+{
+  checkType(TypeFloat, "operator float");
+  return floatValue;
+}
+
+ALValue::operator float &()
+{
+  checkType(TypeFloat, "operator float");
+  return floatValue;
+}
+
+ALValue::operator const std::string &() const
+{
+  checkType(TypeString, "operator std::string");
+  return stringValue;
+}
+
+ALValue::operator std::string &()
+{
+  checkType(TypeString, "operator std::string");
+  return stringValue;
+}
+
+ALValue::operator std::vector<float>() const
+{
+  checkType(TypeArray, "operator std::vector<float>");
+  std::vector<float> values(arrayValue.size());
+  for(size_t i = 0; i < arrayValue.size(); i++)
+  {
+    // python numbers may come as ints
+    values[i] = arrayValue[i].isInt() ? static_cast<float>(arrayValue[i].intValue)
+                                      : static_cast<const float &>(arrayValue[i]);
+  }
+  return values;
+}
+
+ALValue::operator std::vector<int>() const
+{
+  checkType(TypeArray, "operator std::vector<int>");
+  std::vector<int> values(arrayValue.size());
+  for(size_t i = 0; i < arrayValue.size(); i++)
+  {
+    values[i] = arrayValue[i];
+  }
+  return values;
+}
+
+ALValue::operator std::vector<std::string>() const
+{
+  checkType(TypeArray, "operator std::vector<std::string>");
+  std::vector<std::string> values(arrayValue.size());
+  for(size_t i = 0; i < arrayValue.size(); i++)
+  {
+    values[i] = static_cast<const std::string &>(arrayValue[i]);
+  }
+  return values;
+}
+
+bool ALValue::operator==(const ALValue & other) const
+{
+  if(type != other.type)
+  {
+    return false;
+  }
+  switch(type)
+  {
+    case TypeBool:
+      return boolValue == other.boolValue;
+    case TypeInt:
+      return intValue == other.intValue;
+    case TypeFloat:
+      return floatValue == other.floatValue;
+    case TypeString:
+      return stringValue == other.stringValue;
+    case TypeArray:
+      return arrayValue == other.arrayValue;
+    default:
+      return true;
+  }
+}
+
+std::string ALValue::toString() const
+{
+  std::ostringstream out;
+  switch(type)
+  {
+    case TypeBool:
+      out << (boolValue ? "true" : "false");
+      break;
+    case TypeInt:
+      out << intValue;
+      break;
+    case TypeFloat:
+      out << floatValue;
+      break;
+    case TypeString:
+      out << '"' << stringValue << '"';
+      break;
+    case TypeArray:
+      out << '[';
+      for(size_t i = 0; i < arrayValue.size(); i++)
+      {
+        out << (i ? ", " : "") << arrayValue[i].toString();
+      }
+      out << ']';
+      break;
+    default:
+      out << "invalid";
+  }
+  return out.str();
+}
+
+void ALValue::checkType(Type expected, const char * method) const
+{
+  if(type != expected)
+  {
+    throw ALERROR("ALValue", method, std::string("Expected ") + typeName(expected) + ", got " + typeName(type));
+  }
+}
+
+void ALValue::setType(Type newType)
+{
+  if(type == TypeArray && newType != TypeArray)
+  {
+    arrayValue.clear();
+  }
+  type = newType;
+}
+
+} // namespace AL
@@ -0,0 +1,252 @@
+// Checks that the code run by the DCM thread never allocates: malloc, calloc
+// and realloc (hence operator new) are counted while a hot path runs in the
+// calling thread. The setup methods documented as allocating run outside of
+// the counted sections.
+// Usage: AllocationTest
+
+#include <alcommon/albroker.h>
+#include <alcommon/alproxy.h>
+
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+#include "Check.h"
+#include "FakeDCM.h"
+#include "FlightRecorder.h"
+#include "JointLimiter.h"
+#include "LoopStats.h"
+#include "SnapshotRing.h"
+#include "StiffnessRamp.h"
+#include "Watchdog.h"
+#include "mc_naoqi_dcm.h"
+
+using namespace mc_naoqi_dcm;
+
+// glibc allocator, the replacements below only count the calls made by the counting thread
+extern "C" void * __libc_malloc(size_t size);
+extern "C" void * __libc_calloc(size_t count, size_t size);
+extern "C" void * __libc_realloc(void * pointer, size_t size);
+
+namespace
+{
+__thread bool counting = false;
+__thread unsigned int allocations = 0;
+
+void countAllocation()
+{
+  if(counting)
+  {
+    allocations++;
+  }
+}
+
+void startCounting()
+{
+  allocations = 0;
+  counting = true;
+}
+
+unsigned int stopCounting()
+{
+  counting = false;
+  return allocations;
+}
+} // namespace
+
+extern "C" void * malloc(size_t size)
+{
+  countAllocation();
+  return __libc_malloc(size);
+}
+
+extern "C" void * calloc(size_t count, size_t size)
+{
+  countAllocation();
+  return __libc_calloc(count, size);
+}
+
+extern "C" void * realloc(void * pointer, size_t size)
+{
+  countAllocation();
+  return __libc_realloc(pointer, size);
+}
+
+// Run statement with the allocations counted, fail if there was any
+#define CHECK_NO_ALLOCATION(statement)                                                                           \
+  do                                                                                                             \
+  {                                                                                                              \
+    startCounting();                                                                                             \
+    statement;                                                                                                   \
+    unsigned int count = stopCounting();                                                                         \
+    if(count)                                                                                                    \
+    {                                                                                                            \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": " << count << " allocation(s) in " #statement << std::endl; \
+      std::exit(1);                                                                                              \
+    }                                                                                                            \
+  } while(0)
+
+namespace
+{
+const unsigned int numJoints = 17;
+const unsigned int periodUs = RobotModule::defaultDcmPeriod;
+
+void testJointLimiter()
+{
+  JointLimiter limiter;
+  limiter.reset(std::vector<float>(numJoints, -1.0f), std::vector<float>(numJoints, 1.0f),
+                std::vector<float>(numJoints, 2.0f), periodUs, std::vector<float>(numJoints, 0.0f));
+  std::vector<float> target(numJoints, 0.01f);
+  std::vector<float> command(numJoints);
+  // a NaN, a value out of the limits and a step above the velocity limit
+  target[0] = std::numeric_limits<float>::quiet_NaN();
+  target[1] = 5.0f;
+  target[2] = 0.5f;
+  bool limited = true;
+  CHECK_NO_ALLOCATION(limited = limiter.apply(&target[0], &command[0]); limiter.hold(&command[0]));
+  CHECK(!limited);
+  CHECK(limiter.count(0, JointLimiter::ViolationNaN) == 1);
+}
+
+void testLoopStats()
+{
+  LoopStats stats(periodUs, periodUs / 2);
+  long long start = 1000000;
+  // on time, late, overrun and without command
+  CHECK_NO_ALLOCATION(for(unsigned int i = 0; i < 100; i++) {
+    start += i % 10 ? periodUs : 3 * periodUs;
+    stats.recordTick(start, start + (i % 7 ? 100 : periodUs), static_cast<unsigned int>(start - 500), i % 5 != 0);
+  });
+  CHECK(stats.ticks == 100);
+  CHECK(stats.overruns > 0);
+  CHECK(stats.lateTicks > 0);
+  CHECK(stats.missedUpdates > 0);
+}
+
+void testWatchdog()
+{
+  Watchdog watchdog;
+  std::vector<float> command(numJoints, 0.0f);
+  watchdog.reset(command);
+  Watchdog::Policy policies[] = {Watchdog::Off, Watchdog::Hold, Watchdog::ExtrapolateHold, Watchdog::StiffnessOff};
+  for(size_t p = 0; p < sizeof(policies) / sizeof(policies[0]); p++)
+  {
+    watchdog.configure(policies[p], 3, 100);
+    watchdog.restart();
+    // a moving command stream, then a stall long enough to trip
+    CHECK_NO_ALLOCATION(for(unsigned int i = 0; i < 20; i++) {
+      if(i < 10)
+      {
+        command[0] = 0.01f * i;
+      }
+      watchdog.update(i < 10, command);
+    });
+    CHECK(watchdog.tripped() || policies[p] == Watchdog::Off);
+  }
+}
+
+void testStiffnessRamp()
+{
+  StiffnessRamp ramp;
+  ramp.reset(std::vector<float>(numJoints, 0.0f));
+  std::vector<float> target(numJoints, 1.0f);
+  CHECK_NO_ALLOCATION(ramp.start(target, 100, 0); for(int t = 0; t <= 120; t += 12) { ramp.update(t); });
+  CHECK(!ramp.active());
+  CHECK(ramp.values()[0] == 1.0f);
+  // a step
+  target.assign(numJoints, 0.5f);
+  CHECK_NO_ALLOCATION(ramp.start(target, 0, 200); ramp.update(212));
+  CHECK(ramp.values()[0] == 0.5f);
+}
+
+void testFlightRecorder()
+{
+  FlightRecorder recorder;
+  recorder.resize(64, numJoints, 3, 40);
+  std::vector<float> positions(numJoints), stiffness(numJoints), wheels(3), sensors(40);
+  // more cycles than records: the ring wraps
+  CHECK_NO_ALLOCATION(for(unsigned int i = 0; i < 200; i++) {
+    recorder.record(static_cast<int>(i * 12), i, positions, stiffness, wheels, sensors);
+  });
+}
+
+void testSnapshotRing()
+{
+  SnapshotRing ring;
+  ring.resize(40);
+  std::vector<float> values(40);
+  std::vector<unsigned int> indices(3, 1);
+  std::vector<float> selected(indices.size());
+  int dcmTime = 0;
+  unsigned int cycle = 0;
+  bool read = false;
+  CHECK_NO_ALLOCATION(for(unsigned int i = 0; i < 10; i++) {
+    std::vector<float> & slot = ring.beginWrite();
+    slot[1] = static_cast<float>(i);
+    if(i == 9)
+    {
+      ring.abortWrite();
+    }
+    else
+    {
+      ring.endWrite(static_cast<int>(i * 12), i);
+    }
+  });
+  CHECK_NO_ALLOCATION(read = ring.readLatest(values, dcmTime, cycle)
+                             && ring.readLatest(indices, selected, dcmTime, cycle));
+  CHECK(read);
+  CHECK(cycle == 8);
+  CHECK(selected[0] == 8.0f);
+}
+
+// The module callbacks, run by the fake DCM in this thread
+void testCallbacks()
+{
+  boost::shared_ptr<AL::ALBroker> broker(new AL::ALBroker());
+  boost::shared_ptr<MCNAOqiDCM> module = AL::ALModule::createModule<MCNAOqiDCM>(broker, "MCNAOqiDCM");
+  AL::ALProxy proxy(broker, "MCNAOqiDCM");
+  const boost::shared_ptr<AL::FakeDCM> & dcm = broker->fakeDCM();
+
+  std::vector<std::string> joints = proxy.call<std::vector<std::string> >("getJointOrder");
+  proxy.callVoid("setWatchdog", static_cast<int>(Watchdog::ExtrapolateHold), 3, 100);
+  proxy.callVoid("startLoop");
+  proxy.callVoid("setJointStiffnessRamp", std::vector<float>(joints.size(), 1.0f), 100);
+  // position commands, velocity commands, then a stall of the client
+  std::vector<float> targets(joints.size(), 0.0f);
+  for(unsigned int i = 0; i < 30; i++)
+  {
+    if(i < 10)
+    {
+      targets[0] = 0.001f * i;
+      proxy.callVoid("setJointAngles", targets);
+    }
+    else if(i == 10)
+    {
+      proxy.callVoid("setJointVelocities", std::vector<float>(joints.size(), 0.01f), 60);
+    }
+    CHECK_NO_ALLOCATION(dcm->runCycle());
+  }
+  proxy.callVoid("stopLoop");
+  CHECK(dcm->cycles() == 30);
+  CHECK(dcm->droppedPoints() == 0);
+}
+} // namespace
+
+int main()
+{
+  // the counting itself
+  startCounting();
+  int * volatile allocated = new int(0);
+  CHECK(stopCounting() == 1);
+  delete allocated;
+
+  testJointLimiter();
+  testLoopStats();
+  testWatchdog();
+  testStiffnessRamp();
+  testFlightRecorder();
+  testSnapshotRing();
+  testCallbacks();
+  std::cout << "No allocation in the DCM thread" << std::endl;
+  return 0;
+}
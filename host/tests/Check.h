@@ -0,0 +1,14 @@
+#pragma once
+#include <cstdlib>
+#include <iostream>
+
+// Host tests are plain executables: a failed check prints its location and exits with 1
+#define CHECK(condition)                                                                  \
+  do                                                                                      \
+  {                                                                                       \
+    if(!(condition))                                                                      \
+    {                                                                                     \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition << std::endl; \
+      std::exit(1);                                                                       \
+    }                                                                                     \
+  } while(0)
@@ -0,0 +1,107 @@
+// Runs the module against the fake DCM of the host stand-in of NAOqi, through
+// the same proxy calls as a client.
+// Usage: HostLoopTest [periodUs] [jitterUs]
+
+#include <alcommon/albroker.h>
+#include <alcommon/alproxy.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+#include "Check.h"
+#include "FakeDCM.h"
+#include "NAORobotModule.h"
+#include "PepperRobotModule.h"
+#include "mc_naoqi_dcm.h"
+
+using mc_naoqi_dcm::MCNAOqiDCM;
+
+namespace
+{
+// Wait for at least count DCM cycles after the current one, returns the last snapshot
+AL::ALValue waitCycles(AL::ALProxy & proxy, int count)
+{
+  // returns at once, possibly before the first cycle
+  AL::ALValue snapshot = proxy.call<AL::ALValue>("waitForNextCycle", -1, 1000);
+  int first = snapshot[2];
+  for(int i = 0; i < count; i++)
+  {
+    int last = snapshot[2];
+    snapshot = proxy.call<AL::ALValue>("waitForNextCycle", last, 1000);
+    // a timeout returns the snapshot of last
+    CHECK(static_cast<const int &>(snapshot[2]) > last);
+  }
+  CHECK(static_cast<const int &>(snapshot[2]) - first >= count);
+  return snapshot;
+}
+} // namespace
+
+int main(int argc, char ** argv)
+{
+  unsigned int periodUs = argc > 1 ? std::atoi(argv[1]) : mc_naoqi_dcm::RobotModule::defaultDcmPeriod;
+  unsigned int jitterUs = argc > 2 ? std::atoi(argv[2]) : periodUs / 4;
+
+  boost::shared_ptr<AL::ALBroker> broker(new AL::ALBroker());
+  boost::shared_ptr<MCNAOqiDCM> module = AL::ALModule::createModule<MCNAOqiDCM>(broker, "MCNAOqiDCM");
+  AL::ALProxy proxy(broker, "MCNAOqiDCM");
+  const boost::shared_ptr<AL::FakeDCM> & dcm = broker->fakeDCM();
+
+  std::vector<std::string> joints = proxy.call<std::vector<std::string> >("getJointOrder");
+  CHECK(!joints.empty());
+  CHECK(proxy.call<std::vector<float> >("getSensors").size()
+        == proxy.call<std::vector<std::string> >("getSensorsOrder").size());
+
+  dcm->start(periodUs, jitterUs);
+  proxy.callVoid("startLoop");
+  CHECK(proxy.call<bool>("isPreProccessConnected"));
+  // a NaN stiffness is rejected, out of range values are clamped
+  bool rejected = false;
+  try
+  {
+    proxy.callVoid("setStiffness", std::numeric_limits<float>::quiet_NaN());
+  }
+  catch(const AL::ALError &)
+  {
+    rejected = true;
+  }
+  CHECK(rejected);
+  proxy.callVoid("setStiffness", 1.5f);
+
+#ifdef PEPPER
+  mc_naoqi_dcm::PepperRobotModule robot;
+#else
+  mc_naoqi_dcm::NAORobotModule robot;
+#endif
+  // small steps from the initial position within the joint limits, reached within the velocity limits
+  std::vector<float> targets(joints.size());
+  for(size_t i = 0; i < targets.size(); i++)
+  {
+    targets[i] = std::min(std::max(i % 2 ? 0.05f : -0.05f, robot.actuatorLowerLimits[i] + 0.01f),
+                          robot.actuatorUpperLimits[i] - 0.01f);
+  }
+  proxy.callVoid("setJointAngles", targets);
+  AL::ALValue snapshot = waitCycles(proxy, 20);
+
+  // the ideal robot of the fake DCM reports the commands as encoder values
+  std::vector<float> sensors = snapshot[0];
+  for(size_t i = 0; i < joints.size(); i++)
+  {
+    CHECK(std::fabs(sensors[i] - targets[i]) < 1e-5f);
+    CHECK(std::fabs(dcm->getMemoryValue("Device/SubDeviceList/" + joints[i] + "/Position/Actuator/Value") - targets[i])
+          < 1e-5f);
+  }
+  CHECK(std::fabs(dcm->getMemoryValue("Device/SubDeviceList/" + joints[0] + "/Hardness/Actuator/Value") - 1.0f)
+        < 1e-5f);
+
+  AL::ALValue errors = proxy.call<AL::ALValue>("getLoopErrors");
+  proxy.callVoid("stopLoop");
+  dcm->stop();
+  CHECK(!proxy.call<bool>("isPreProccessConnected"));
+  CHECK(dcm->cycles() >= 20);
+  CHECK(dcm->droppedPoints() == 0);
+  std::cout << dcm->cycles() << " cycles of " << periodUs << " us (jitter " << jitterUs << " us), loop errors "
+            << errors.toString() << std::endl;
+  return 0;
+}
@@ -0,0 +1,151 @@
+// Replays a flight recording through the module with the fake DCM: the
+// module reads the recorded sensor values, and the commands it sends in
+// response are logged with the recorded cycles. Altered dumps are rejected.
+// Usage: ReplayTest
+
+#include <alcommon/albroker.h>
+#include <alcommon/alproxy.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+#include "Check.h"
+#include "FakeDCM.h"
+#include "FlightRecorder.h"
+#include "NAORobotModule.h"
+#include "PepperRobotModule.h"
+#include "mc_naoqi_dcm.h"
+
+using mc_naoqi_dcm::MCNAOqiDCM;
+
+namespace
+{
+const unsigned int numRecords = 50;
+// recorded cycles, distinct from the cycles of the fake DCM
+const unsigned int firstCycle = 1000;
+
+// Load a copy of the dump altered by alter, return whether it was rejected
+bool rejected(const std::string & dump, void (*alter)(std::string &))
+{
+  std::ifstream in(dump.c_str(), std::ios::binary);
+  std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  alter(bytes);
+  const std::string altered = dump + ".altered";
+  std::ofstream(altered.c_str(), std::ios::binary).write(bytes.data(), bytes.size());
+  bool failed = false;
+  try
+  {
+    mc_naoqi_dcm::FlightRecording recording;
+    mc_naoqi_dcm::FlightRecorder::load(altered, recording);
+  }
+  catch(const std::runtime_error &)
+  {
+    failed = true;
+  }
+  std::remove(altered.c_str());
+  return failed;
+}
+
+void truncate(std::string & bytes)
+{
+  bytes.resize(bytes.size() - 1);
+}
+
+// numRecords, the last word of the header
+void tooManyRecords(std::string & bytes)
+{
+  bytes.replace(24, 4, "\xff\xff\xff\x0f", 4);
+}
+
+// length of the first joint name
+void longName(std::string & bytes)
+{
+  bytes.replace(28, 4, "\xff\xff\xff\x7f", 4);
+}
+} // namespace
+
+int main(int argc, char ** argv)
+{
+#ifdef PEPPER
+  mc_naoqi_dcm::PepperRobotModule robot;
+#else
+  mc_naoqi_dcm::NAORobotModule robot;
+#endif
+  CHECK(robot.sensors.size() == robot.readSensorKeys.size());
+  const std::string dump = std::string(argv[0]) + ".bin";
+  const std::string commands = std::string(argv[0]) + ".csv";
+
+  // slowly moving sensors, the recorded commands are not replayed
+  {
+    mc_naoqi_dcm::FlightRecorder recorder;
+    recorder.resize(numRecords, robot.actuators.size(), 0, robot.sensors.size());
+    std::vector<float> positions(robot.actuators.size()), stiffness(robot.actuators.size()), wheels;
+    std::vector<float> sensors(robot.sensors.size());
+    for(unsigned int i = 0; i < numRecords; i++)
+    {
+      for(size_t j = 0; j < sensors.size(); j++)
+      {
+        sensors[j] = 0.0001f * i + 0.00001f * j;
+      }
+      recorder.record(static_cast<int>(i * robot.dcmPeriod / 1000), firstCycle + i, positions, stiffness, wheels,
+                      sensors);
+    }
+    CHECK(recorder.dump(dump, robot.dcmPeriod, robot.actuators, std::vector<std::string>(), robot.sensors)
+          == numRecords);
+  }
+  // sizes that do not match the file are rejected before allocating
+  CHECK(rejected(dump, truncate));
+  CHECK(rejected(dump, tooManyRecords));
+  CHECK(rejected(dump, longName));
+  mc_naoqi_dcm::FlightRecording recording;
+  mc_naoqi_dcm::FlightRecorder::load(dump, recording);
+  std::remove(dump.c_str());
+  CHECK(recording.sensors.size() == numRecords);
+
+  boost::shared_ptr<AL::ALBroker> broker(new AL::ALBroker());
+  boost::shared_ptr<MCNAOqiDCM> module = AL::ALModule::createModule<MCNAOqiDCM>(broker, "MCNAOqiDCM");
+  AL::ALProxy proxy(broker, "MCNAOqiDCM");
+  const boost::shared_ptr<AL::FakeDCM> & dcm = broker->fakeDCM();
+
+  // the loop starts from the first record
+  for(size_t j = 0; j < robot.readSensorKeys.size(); j++)
+  {
+    dcm->setMemoryValue(robot.readSensorKeys[j], recording.sensors[0][j]);
+  }
+  proxy.callVoid("startLoop");
+  std::vector<float> targets(recording.sensors[0].begin(), recording.sensors[0].begin() + robot.actuators.size());
+  proxy.callVoid("setJointAngles", targets);
+  dcm->startCommandLog(4 * numRecords, 4 * numRecords, 4 * numRecords * robot.actuators.size());
+  CHECK(dcm->replay(recording, robot.readSensorKeys, false) == numRecords);
+  dcm->stopCommandLog();
+  proxy.callVoid("stopLoop");
+  CHECK(dcm->cycles() == numRecords);
+
+  // the recorded values, not the ones of the ideal robot
+  std::vector<float> sensors = proxy.call<std::vector<float> >("getSensors");
+  CHECK(sensors == recording.sensors.back());
+
+  // the client command is sent by the first replayed cycle
+  CHECK(dcm->loggedCommands() >= 1);
+  CHECK(dcm->unloggedCommands() == 0);
+  dcm->saveCommandLog(commands);
+  std::ifstream in(commands.c_str());
+  std::string line;
+  CHECK(std::getline(in, line) && line == "cycle,alias,times,values");
+  std::ostringstream expected;
+  expected << firstCycle << ",jointActuator,";
+  bool found = false;
+  while(std::getline(in, line))
+  {
+    found = found || line.compare(0, expected.str().size(), expected.str()) == 0;
+  }
+  in.close();
+  std::remove(commands.c_str());
+  CHECK(found);
+
+  std::cout << numRecords << " records replayed, " << dcm->loggedCommands() << " commands logged" << std::endl;
+  return 0;
+}
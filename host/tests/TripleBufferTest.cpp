@@ -0,0 +1,133 @@
+// Stress test of TripleBuffer: a producer thread publishes numbered frames as
+// fast as it can while the consumer thread reads them. Every frame read must
+// be complete (no value from another frame) and newer than the previous one,
+// and the last frame published must be the one read at the end.
+// Only needs boost: g++ -Iinclude host/tests/TripleBufferTest.cpp -lboost_thread -lpthread
+// Usage: TripleBufferTest [frames]
+
+#include <boost/atomic.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <cstdlib>
+#include <vector>
+
+#include "Check.h"
+#include "TripleBuffer.h"
+
+using mc_naoqi_dcm::TripleBuffer;
+
+namespace
+{
+// Size of the Pepper joint and wheel command frame
+const unsigned int frameSize = 20;
+
+struct Frame
+{
+  unsigned int sequence;
+  // sequence + i, a torn frame mixes values of several sequences
+  std::vector<float> values;
+};
+
+void fill(Frame & frame, unsigned int sequence)
+{
+  frame.sequence = sequence;
+  for(size_t i = 0; i < frame.values.size(); i++)
+  {
+    frame.values[i] = static_cast<float>(sequence + i);
+  }
+}
+
+bool complete(const Frame & frame)
+{
+  for(size_t i = 0; i < frame.values.size(); i++)
+  {
+    if(frame.values[i] != static_cast<float>(frame.sequence + i))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+void produce(TripleBuffer<Frame> * buffer, unsigned int frames, boost::atomic<bool> * done)
+{
+  for(unsigned int sequence = 1; sequence <= frames; sequence++)
+  {
+    fill(buffer->writeBuffer(), sequence);
+    buffer->publish();
+  }
+  done->store(true, boost::memory_order_release);
+}
+
+Frame initialFrame()
+{
+  Frame frame;
+  frame.values.resize(frameSize);
+  fill(frame, 0);
+  return frame;
+}
+
+// Single thread: the latest frame wins, and is only reported once
+void testLatestWins()
+{
+  TripleBuffer<Frame> buffer;
+  buffer.reset(initialFrame());
+  CHECK(!buffer.update());
+  CHECK(buffer.readBuffer().sequence == 0);
+
+  for(unsigned int sequence = 1; sequence <= 3; sequence++)
+  {
+    fill(buffer.writeBuffer(), sequence);
+    buffer.publish();
+  }
+  CHECK(buffer.update());
+  CHECK(buffer.readBuffer().sequence == 3);
+  CHECK(complete(buffer.readBuffer()));
+  CHECK(!buffer.update());
+  CHECK(buffer.readBuffer().sequence == 3);
+
+  fill(buffer.writeBuffer(), 4);
+  buffer.publish();
+  CHECK(buffer.update());
+  CHECK(buffer.readBuffer().sequence == 4);
+}
+
+// Two threads: no torn frame, sequences only increase, the last one is always received
+void testConcurrent(unsigned int frames)
+{
+  TripleBuffer<Frame> buffer;
+  buffer.reset(initialFrame());
+  boost::atomic<bool> done(false);
+
+  boost::thread producer(&produce, &buffer, frames, &done);
+  unsigned int last = 0;
+  unsigned int received = 0;
+  bool finished = false;
+  while(!finished)
+  {
+    // read after the producer is done: the last update must see the last frame
+    finished = done.load(boost::memory_order_acquire);
+    if(!buffer.update())
+    {
+      continue;
+    }
+    const Frame & frame = buffer.readBuffer();
+    CHECK(complete(frame));
+    CHECK(frame.sequence > last);
+    last = frame.sequence;
+    received++;
+  }
+  producer.join();
+  CHECK(last == frames);
+  CHECK(!buffer.update());
+  std::cout << "TripleBuffer: " << received << " of " << frames << " frames received, none torn" << std::endl;
+}
+} // namespace
+
+int main(int argc, char ** argv)
+{
+  unsigned int frames = argc > 1 ? std::atoi(argv[1]) : 2000000;
+  testLatestWins();
+  testConcurrent(frames);
+  return 0;
+}
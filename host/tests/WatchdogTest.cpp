@@ -0,0 +1,89 @@
+// Hold policy of the command watchdog: the last command is re-sent for the
+// hold horizon after the watchdog trips, then no joint command is sent until
+// the client comes back. The fake DCM cycles are run from this thread.
+// Usage: WatchdogTest
+
+#include <alcommon/albroker.h>
+#include <alcommon/alproxy.h>
+
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+
+#include "Check.h"
+#include "FakeDCM.h"
+#include "NAORobotModule.h"
+#include "PepperRobotModule.h"
+#include "Watchdog.h"
+#include "mc_naoqi_dcm.h"
+
+using mc_naoqi_dcm::MCNAOqiDCM;
+
+namespace
+{
+const int holdMs = 500;
+const long periodUs = mc_naoqi_dcm::RobotModule::defaultDcmPeriod;
+
+// DCM cycles, about one period apart
+void cycles(AL::FakeDCM & dcm, int count)
+{
+  for(int i = 0; i < count; i++)
+  {
+    boost::this_thread::sleep(boost::posix_time::microseconds(periodUs));
+    dcm.runCycle();
+  }
+}
+} // namespace
+
+int main()
+{
+  boost::shared_ptr<AL::ALBroker> broker(new AL::ALBroker());
+  boost::shared_ptr<MCNAOqiDCM> module = AL::ALModule::createModule<MCNAOqiDCM>(broker, "MCNAOqiDCM");
+  AL::ALProxy proxy(broker, "MCNAOqiDCM");
+  const boost::shared_ptr<AL::FakeDCM> & dcm = broker->fakeDCM();
+
+#ifdef PEPPER
+  mc_naoqi_dcm::PepperRobotModule robot;
+#else
+  mc_naoqi_dcm::NAORobotModule robot;
+#endif
+  std::vector<std::string> joints = proxy.call<std::vector<std::string> >("getJointOrder");
+  std::vector<float> targets(joints.size());
+  for(size_t i = 0; i < targets.size(); i++)
+  {
+    targets[i] = std::min(std::max(0.0f, robot.actuatorLowerLimits[i]), robot.actuatorUpperLimits[i]);
+  }
+  // joint commands sent by the loop
+  const std::string alias = "jointActuator";
+
+  proxy.callVoid("setWatchdog", static_cast<int>(mc_naoqi_dcm::Watchdog::Hold), 3, holdMs);
+  proxy.callVoid("startLoop");
+  proxy.callVoid("setJointAngles", targets);
+  // one cycle with the command, four without: the watchdog trips
+  cycles(*dcm, 5);
+  AL::ALValue status = proxy.call<AL::ALValue>("getWatchdogStatus");
+  CHECK(static_cast<const bool &>(status[3]));
+
+  // within the hold horizon the last command is still sent at every cycle
+  unsigned int sent = dcm->commands(alias);
+  cycles(*dcm, 2);
+  CHECK(dcm->commands(alias) - sent == 2);
+
+  // after it, no joint command is sent
+  boost::this_thread::sleep(boost::posix_time::milliseconds(2 * holdMs));
+  sent = dcm->commands(alias);
+  cycles(*dcm, 2);
+  CHECK(dcm->commands(alias) == sent);
+
+  // a new command recovers
+  proxy.callVoid("setJointAngles", targets);
+  cycles(*dcm, 1);
+  CHECK(dcm->commands(alias) - sent == 1);
+  status = proxy.call<AL::ALValue>("getWatchdogStatus");
+  CHECK(!static_cast<const bool &>(status[3]));
+  CHECK(static_cast<const int &>(status[4]) == 1);
+
+  proxy.callVoid("stopLoop");
+  std::cout << "Watchdog hold horizon of " << holdMs << " ms respected" << std::endl;
+  return 0;
+}
@@ -0,0 +1,131 @@
+#pragma once
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <string>
+#include <vector>
+
+#include "mc_naoqi_dcm_plugin.h"
+
+namespace mc_naoqi_dcm
+{
+/**
+ * @brief Controller plugin loaded from a shared library (see mc_naoqi_dcm_plugin.h)
+ *
+ * The constructor and destructor load and unload the library, step() is
+ * called by the DCM thread only and never allocates. Each step is timed
+ * against a budget: a plugin that overruns it maxConsecutiveOverruns cycles
+ * in a row, or whose step fails, is disabled until setEnabled(true).
+ * This is overrun detection only, the step runs to completion: a plugin
+ * that never returns blocks the DCM thread.
+ * The constructor throws std::runtime_error on failure.
+ */
+class ControllerPlugin
+{
+public:
+  /**
+   * @param name Name of the plugin in the RPC calls
+   * @param path Path of the shared library
+   * @param budgetUs Overrun detection threshold of one step
+   */
+  ControllerPlugin(const std::string & name,
+                   const std::string & path,
+                   unsigned int budgetUs,
+                   const std::string & robot,
+                   unsigned int periodUs,
+                   const std::vector<std::string> & actuators,
+                   const std::vector<std::string> & wheels,
+                   const std::vector<std::string> & sensors);
+  ~ControllerPlugin();
+
+  /**
+   * @brief Run one step of the plugin (DCM thread only)
+   *
+   * Pending parameters are applied first.
+   *
+   * @param commands Modified in place, restored if the step fails
+   * @return false if the plugin is disabled or failed
+   */
+  bool step(const float * sensors, float * commands, float dt);
+
+  /**
+   * @brief Queue a parameter, applied by the DCM thread before the next step
+   *
+   * Throws if the name is too long or the queue is full.
+   */
+  void setParameter(const std::string & name, float value);
+
+  const std::string & name() const
+  {
+    return pluginName;
+  }
+
+  const std::string & path() const
+  {
+    return libraryPath;
+  }
+
+  unsigned int budget() const
+  {
+    return budgetUs;
+  }
+
+  bool enabled() const
+  {
+    return isEnabled.load(boost::memory_order_relaxed);
+  }
+
+  void setEnabled(bool enabled)
+  {
+    isEnabled.store(enabled, boost::memory_order_relaxed);
+  }
+
+  // Steps run, steps over budget, failed steps and parameters refused since loading
+  boost::atomic<unsigned int> steps;
+  boost::atomic<unsigned int> overruns;
+  boost::atomic<unsigned int> failures;
+  boost::atomic<unsigned int> refusedParameters;
+  // Longest step (us)
+  boost::atomic<unsigned int> maxDuration;
+
+  static const unsigned int maxConsecutiveOverruns = 3;
+
+private:
+  // non-copyable
+  ControllerPlugin(const ControllerPlugin &);
+  ControllerPlugin & operator=(const ControllerPlugin &);
+
+  void applyParameter(const char * name, float value);
+
+  struct Parameter
+  {
+    char name[64];
+    float value;
+  };
+  static const unsigned int maxPendingParameters = 16;
+
+  std::string pluginName;
+  std::string libraryPath;
+  unsigned int budgetUs;
+  void * library;
+  const mc_naoqi_dcm_plugin * plugin;
+  void * state;
+
+  // Names referenced by layout
+  std::string robotName;
+  std::vector<std::string> names;
+  std::vector<const char *> namePointers;
+  mc_naoqi_dcm_plugin_layout layout;
+
+  boost::atomic<bool> isEnabled;
+  // DCM thread only
+  unsigned int consecutiveOverruns;
+  std::vector<float> backup;
+
+  // Parameters set through RPC, applied by the DCM thread when it gets the mutex
+  boost::mutex parametersMutex;
+  Parameter pendingParameters[maxPendingParameters];
+  unsigned int numPendingParameters;
+};
+
+} // namespace mc_naoqi_dcm
@@ -0,0 +1,69 @@
+#pragma once
+#include <boost/atomic.hpp>
+
+namespace mc_naoqi_dcm
+{
+/**
+ * @brief Model of the DCM clock against the host monotonic clock.
+ *
+ * DCM time (in ms) is modelled as dcmRef + rate * (host - hostRef), host time
+ * being CLOCK_MONOTONIC in microseconds. The model is calibrated by feeding it
+ * synchronisation points measured with DCMProxy::getTime; the rate (clock drift)
+ * is estimated from the first and latest points once they are far enough apart.
+ *
+ * Reading the model (now(), toDcmTime(), toHostTime()) costs one clock read and
+ * never blocks nor allocates, it can be used from the DCM thread. synchronise()
+ * must only be called from one thread at a time.
+ */
+class DCMClock
+{
+public:
+  DCMClock();
+
+  /** Host monotonic time in microseconds */
+  static long long hostTime();
+
+  /**
+   * @brief Add a synchronisation point
+   *
+   * @param hostTimeUs Host time of the measurement (us)
+   * @param dcmTimeMs DCM time at hostTimeUs (ms, may be fractional when averaged)
+   */
+  void synchronise(long long hostTimeUs, double dcmTimeMs);
+
+  /** Whether synchronise() was called at least once */
+  bool isCalibrated() const;
+
+  /** Current DCM time, equivalent to DCMProxy::getTime(0) */
+  int now() const;
+
+  /** DCM time corresponding to a host time */
+  int toDcmTime(long long hostTimeUs) const;
+
+  /** Host time corresponding to a DCM time */
+  long long toHostTime(int dcmTimeMs) const;
+
+  /** Estimated DCM clock rate, in ms per host us (nominally 1e-3) */
+  double rate() const;
+
+private:
+  struct Model
+  {
+    long long hostRef;
+    double dcmRef;
+    double rate;
+  };
+
+  // consistent copy of the model (seqlock read side)
+  Model read() const;
+
+  Model model;
+  boost::atomic<unsigned int> sequence;
+
+  // first synchronisation point, used to estimate the drift (writer only)
+  bool calibrated;
+  long long anchorHost;
+  double anchorDcm;
+};
+
+} // namespace mc_naoqi_dcm
@@ -0,0 +1,103 @@
+#pragma once
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
+
+#include <string>
+#include <vector>
+
+namespace mc_naoqi_dcm
+{
+/** Content of a file written by FlightRecorder::dump() */
+struct FlightRecording
+{
+  unsigned int dcmPeriodUs;
+  std::vector<std::string> jointNames;
+  std::vector<std::string> wheelNames;
+  std::vector<std::string> sensorNames;
+  std::vector<int> dcmTimes;
+  std::vector<unsigned int> cycles;
+  // one vector of sensor values per record
+  std::vector<std::vector<float> > sensors;
+};
+
+/**
+ * @brief Ring of the last DCM cycles: commands sent and sensors read.
+ *
+ * record() is called by the DCM thread once per cycle and never blocks nor
+ * allocates. dump() may run concurrently from any thread: records overwritten
+ * while they are copied are skipped (per-record sequence locks).
+ *
+ * Dump format (little-endian whatever the host, version 1):
+ *  - header: "MCFR", uint32 version, uint32 dcmPeriodUs, uint32 numJoints,
+ *    uint32 numWheels, uint32 numSensors, uint32 numRecords
+ *  - joint, wheel and sensor names, each as uint32 length followed by the characters
+ *  - records, oldest first: int32 dcmTime, uint32 cycle, float jointPositions[numJoints],
+ *    float jointStiffness[numJoints], float wheelSpeeds[numWheels], float sensors[numSensors]
+ */
+class FlightRecorder
+{
+public:
+  static const unsigned int version = 1;
+
+  FlightRecorder();
+
+  /**
+   * @brief Allocate the ring. Must not be called concurrently with any other method.
+   *
+   * @param numRecords Number of cycles kept
+   */
+  void resize(unsigned int numRecords, unsigned int numJoints, unsigned int numWheels, unsigned int numSensors);
+
+  /** Record one cycle (DCM thread only) */
+  void record(int dcmTime,
+              unsigned int cycle,
+              const std::vector<float> & jointPositions,
+              const std::vector<float> & jointStiffness,
+              const std::vector<float> & wheelSpeeds,
+              const std::vector<float> & sensors);
+
+  /**
+   * @brief Write the recorded cycles to a file
+   *
+   * @return Number of records written
+   * @throws std::runtime_error if the file cannot be written
+   */
+  unsigned int dump(const std::string & path,
+                    unsigned int dcmPeriodUs,
+                    const std::vector<std::string> & jointNames,
+                    const std::vector<std::string> & wheelNames,
+                    const std::vector<std::string> & sensorNames) const;
+
+  /**
+   * @brief Read a file written by dump(), only the sensor values of the records are kept
+   *
+   * @throws std::runtime_error if the file cannot be read, has another version, or
+   * if its size does not match the counts of its header
+   */
+  static void load(const std::string & path, FlightRecording & recording);
+
+  unsigned int capacity() const
+  {
+    return numSlots;
+  }
+
+private:
+  // floats per record: joint positions, joint stiffness, wheel speeds and sensors
+  unsigned int recordSize() const
+  {
+    return 2 * joints + wheels + sensors;
+  }
+
+  unsigned int numSlots;
+  unsigned int joints;
+  unsigned int wheels;
+  unsigned int sensors;
+  boost::scoped_array<boost::atomic<unsigned int> > sequences;
+  boost::scoped_array<int> dcmTimes;
+  boost::scoped_array<unsigned int> cycles;
+  boost::scoped_array<float> values;
+  // number of records written so far
+  boost::atomic<unsigned int> written;
+};
+
+} // namespace mc_naoqi_dcm
@@ -0,0 +1,85 @@
+#pragma once
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
+
+#include <vector>
+
+namespace mc_naoqi_dcm
+{
+/**
+ * @brief Last line of defence between the joint commands and the DCM.
+ *
+ * Each command is checked joint by joint against the previous one sent:
+ * - NaN values are replaced by the previous command,
+ * - values are clamped to the position limits,
+ * - the step from the previous command is limited to maxVelocity * period.
+ *
+ * apply() is called by the DCM thread only, never allocates and has no
+ * branch in its loop over the joints so that the compiler vectorises it.
+ * Joints that were modified are counted per joint and per kind of violation,
+ * any thread may read or reset the counters.
+ */
+class JointLimiter
+{
+public:
+  enum Violation
+  {
+    ViolationNaN = 0,
+    ViolationPosition,
+    ViolationStep,
+    ViolationCount
+  };
+
+  JointLimiter();
+
+  /**
+   * @brief Set the limits (allocates). Only call while the DCM callback is not connected
+   *
+   * @param lower Lower position limits (rad)
+   * @param upper Upper position limits (rad)
+   * @param maxVelocity Maximum velocities (rad/s)
+   * @param periodUs Period of the DCM loop
+   * @param initial Command considered as previously sent
+   */
+  void reset(const std::vector<float> & lower,
+             const std::vector<float> & upper,
+             const std::vector<float> & maxVelocity,
+             unsigned int periodUs,
+             const std::vector<float> & initial);
+
+  /** Consider command as sent, without checking it (e.g. the encoders or the end of a trajectory) */
+  void hold(const float * command);
+
+  /**
+   * @brief Limit a command
+   *
+   * @param target Requested joint positions
+   * @param command Joint positions to send, one per joint
+   * @return false if at least one joint was modified
+   */
+  bool apply(const float * target, float * command);
+
+  unsigned int numJoints() const
+  {
+    return static_cast<unsigned int>(previous.size());
+  }
+
+  /** Number of commands in which the joint was modified because of the violation */
+  unsigned int count(unsigned int joint, Violation violation) const
+  {
+    return counts[joint * ViolationCount + violation].load(boost::memory_order_relaxed);
+  }
+
+  void resetCounters();
+
+private:
+  std::vector<float> lowerLimits;
+  std::vector<float> upperLimits;
+  std::vector<float> maxStep;
+  std::vector<float> previous;
+  // violations of the last apply(), one bit per Violation
+  std::vector<unsigned int> flags;
+  boost::scoped_array<boost::atomic<unsigned int> > counts;
+};
+
+} // namespace mc_naoqi_dcm
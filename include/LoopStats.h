@@ -0,0 +1,110 @@
+#pragma once
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
+
+namespace mc_naoqi_dcm
+{
+/**
+ * @brief Fixed-bucket histogram of durations in microseconds.
+ *
+ * Values above the range are counted in the last bucket. record() is
+ * wait-free and never allocates; it must be called from a single thread,
+ * any thread may read or reset the counters.
+ */
+class Histogram
+{
+public:
+  Histogram(unsigned int bucketWidthUs, unsigned int numBuckets);
+
+  void record(long long valueUs);
+  void reset();
+
+  unsigned int bucketWidth() const
+  {
+    return width;
+  }
+
+  unsigned int numBuckets() const
+  {
+    return size;
+  }
+
+  unsigned int count(unsigned int bucket) const
+  {
+    return counts[bucket].load(boost::memory_order_relaxed);
+  }
+
+  /** Largest recorded value (us) */
+  unsigned int max() const
+  {
+    return maxValue.load(boost::memory_order_relaxed);
+  }
+
+private:
+  unsigned int width;
+  unsigned int size;
+  boost::scoped_array<boost::atomic<unsigned int> > counts;
+  boost::atomic<unsigned int> maxValue;
+};
+
+/**
+ * @brief Timing statistics of the DCM preprocess callback.
+ *
+ * Recorded by the DCM thread at every tick without allocation.
+ */
+struct LoopStats
+{
+  /**
+   * @param periodUs Nominal DCM period
+   * @param budgetUs Maximum duration of the callback before it counts as an overrun
+   */
+  LoopStats(unsigned int periodUs, unsigned int budgetUs);
+
+  /** Change the nominal DCM period. Only call while the DCM callback is not connected */
+  void setNominalPeriod(unsigned int periodUs)
+  {
+    nominalPeriod = periodUs;
+  }
+
+  /**
+   * @brief Record one tick of the callback
+   *
+   * @param startUs Host time at the beginning of the callback
+   * @param endUs Host time at the end of the callback
+   * @param commandTimeUs Host time (truncated to 32 bits) at which the command sent in this tick was published
+   * @param newCommand Whether a new command frame was received since the previous tick
+   */
+  void recordTick(long long startUs, long long endUs, unsigned int commandTimeUs, bool newCommand);
+
+  void reset();
+
+  /** Forget the previous tick. Only call while the DCM callback is not connected */
+  void restart()
+  {
+    lastStart = 0;
+  }
+
+  // Duration of the callback
+  Histogram duration;
+  // Time between the beginning of two consecutive ticks
+  Histogram period;
+  // Age of the command sent to the DCM
+  Histogram commandAge;
+  // Ticks since the last reset
+  boost::atomic<unsigned int> ticks;
+  // Ticks during which the callback took longer than the budget
+  boost::atomic<unsigned int> overruns;
+  // Ticks that started more than 1.5 nominal period after the previous one
+  boost::atomic<unsigned int> lateTicks;
+  // Ticks that had no new command to send
+  boost::atomic<unsigned int> missedUpdates;
+
+  unsigned int nominalPeriod;
+  unsigned int budget;
+
+private:
+  // beginning of the previous tick, 0 when unknown (DCM thread only)
+  long long lastStart;
+};
+
+} // namespace mc_naoqi_dcm
@@ -38,14 +38,36 @@ struct iLedGroup
   std::vector<std::string> intensityLedKeys;
 };
 
+/** Sensors read at a lower rate than RobotModule::readSensorKeys */
+struct SensorTier
+{
+  std::string name;
+  // read once every decimation DCM cycles
+  unsigned int decimation;
+  // human-readable sensor names
+  std::vector<std::string> sensors;
+  // memory keys read with a dedicated ALMemoryFastAccess
+  std::vector<std::string> readSensorKeys;
+};
+
 struct RobotModule
 {
   RobotModule();
 
+  // DCM period of the NAO and Pepper robots (us)
+  static const unsigned int defaultDcmPeriod = 12000;
+
   // Robot name (e.g. nao or pepper)
   std::string name;
+  // Nominal period of the DCM loop (us)
+  unsigned int dcmPeriod;
   // Body joints
   std::vector<std::string> actuators;
+  // Lower and upper position limits of body joints (rad), in the order of actuators
+  std::vector<float> actuatorLowerLimits;
+  std::vector<float> actuatorUpperLimits;
+  // Maximum velocities of body joints (rad/s), in the order of actuators
+  std::vector<float> actuatorVelocityLimits;
   // Memory keys of body joints position command
   std::vector<std::string> setActuatorKeys;
   // Memory keys of body joints stiffness command
@@ -66,6 +88,8 @@ struct RobotModule
   std::vector<std::string> bumpers;
   // Tactile sensors
   std::vector<std::string> tactile;
+  // Slow-changing sensors (temperatures, motor and board status, battery), kept out of readSensorKeys
+  std::vector<SensorTier> sensorTiers;
 
   // Generate memory keys
   void genMemoryKeys(std::string prefix,
@@ -74,6 +98,13 @@ struct RobotModule
                      std::vector<std::string> & memory_keys,
                      bool isSensor = false,
                      std::string sensor_prefix = "");
+
+  // Generate memory keys and sensor names of a sensor tier
+  void genTierMemoryKeys(SensorTier & tier,
+                         std::string prefix,
+                         std::vector<std::string> & devices,
+                         std::string postfix,
+                         std::string sensor_prefix = "");
 };
 
 } // namespace mc_naoqi_dcm
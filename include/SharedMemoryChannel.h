@@ -0,0 +1,147 @@
+#pragma once
+#include <boost/atomic.hpp>
+
+#include <stdint.h>
+#include <string>
+
+namespace mc_naoqi_dcm
+{
+/**
+ * Layout of the POSIX shared-memory segment exchanged between MCNAOqiDCM and
+ * a controller running on the robot.
+ *
+ * Every block is protected by its own sequence counter (odd while being
+ * written) and has a single writer: the client writes the command blocks, the
+ * module writes the sensor block once per DCM cycle. The doorbell holds the
+ * latest sensor cycle and is used as a futex so that clients can sleep until
+ * the next DCM tick.
+ */
+namespace shm
+{
+static const uint32_t magic = 0x4d434443; // "MCDC"
+static const uint32_t version = 1;
+static const unsigned maxActuators = 32;
+static const unsigned maxWheels = 4;
+static const unsigned maxSensors = 128;
+
+template<unsigned N>
+struct CommandBlock
+{
+  boost::atomic<uint32_t> sequence;
+  float values[N];
+};
+
+struct SensorBlock
+{
+  boost::atomic<uint32_t> sequence;
+  uint32_t cycle;
+  int32_t dcmTime;
+  float values[maxSensors];
+};
+
+struct Layout
+{
+  Layout();
+
+  uint32_t magic;
+  uint32_t version;
+  uint32_t numActuators;
+  uint32_t numWheels;
+  uint32_t numSensors;
+  CommandBlock<maxActuators> jointPositions;
+  CommandBlock<maxActuators> jointStiffness;
+  CommandBlock<maxWheels> wheelSpeeds;
+  SensorBlock sensors;
+  // latest sensor cycle, futex word
+  boost::atomic<uint32_t> doorbell;
+  // number of clients sleeping on the doorbell
+  boost::atomic<uint32_t> waiters;
+};
+} // namespace shm
+
+/**
+ * @brief Shared-memory command/sensor channel bypassing ALProxy.
+ *
+ * Created by MCNAOqiDCM with create(), opened by clients with open().
+ * Commands written by the client are picked up by the next DCM preprocess,
+ * sensors are published at every DCM postprocess.
+ * All methods throw std::runtime_error on system errors.
+ */
+class SharedMemoryChannel
+{
+public:
+  SharedMemoryChannel();
+  ~SharedMemoryChannel();
+
+  /** Create (or recreate) the segment /name and initialise its header (module side) */
+  void create(const std::string & name, unsigned numActuators, unsigned numWheels, unsigned numSensors);
+
+  /** Map an existing segment created by the module (client side) */
+  void open(const std::string & name);
+
+  /** Unmap the segment, and unlink it if it was created by this object */
+  void close();
+
+  bool isOpen() const
+  {
+    return layout != 0;
+  }
+
+  const std::string & name() const
+  {
+    return segmentName;
+  }
+
+  unsigned numActuators() const;
+  unsigned numWheels() const;
+  unsigned numSensors() const;
+
+  /**
+   * Client side: publish a command frame. Blocks must not have more than
+   * one writer. The module clamps stiffness to [0, 1] and drops a stiffness
+   * frame with a NaN value.
+   */
+  void writeJointPositions(const float * values);
+  void writeJointStiffness(const float * values);
+  void writeWheelSpeeds(const float * values);
+
+  /**
+   * Module side: copy a command frame if a new complete one was written since
+   * lastSequence. Never blocks, a frame being written is picked up at the next call.
+   *
+   * @return true if values and lastSequence were updated
+   */
+  bool readJointPositions(float * values, uint32_t & lastSequence) const;
+  bool readJointStiffness(float * values, uint32_t & lastSequence) const;
+  bool readWheelSpeeds(float * values, uint32_t & lastSequence) const;
+
+  /** Module side: publish a sensor snapshot and wake up waiting clients */
+  void writeSensors(const float * values, int dcmTime, uint32_t cycle);
+
+  /**
+   * Client side: copy the latest sensor snapshot
+   *
+   * @return false if no snapshot was published yet
+   */
+  bool readSensors(float * values, int & dcmTime, uint32_t & cycle) const;
+
+  /**
+   * Client side: sleep until a sensor cycle other than lastCycle is published
+   *
+   * @return false on timeout
+   */
+  bool waitForCycle(uint32_t lastCycle, int timeoutMs) const;
+
+private:
+  // non-copyable
+  SharedMemoryChannel(const SharedMemoryChannel &);
+  SharedMemoryChannel & operator=(const SharedMemoryChannel &);
+
+  void map(int fd, bool initialise);
+
+  std::string segmentName;
+  shm::Layout * layout;
+  bool owner;
+};
+
+} // namespace mc_naoqi_dcm
@@ -0,0 +1,169 @@
+#pragma once
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
+
+#include <vector>
+
+namespace mc_naoqi_dcm
+{
+/**
+ * @brief Ring of fixed-size value snapshots protected by per-slot sequence locks.
+ *
+ * A single writer (the DCM thread) fills one slot per cycle with
+ * beginWrite()/endWrite(), without blocking or allocating. Any number of
+ * readers can copy the latest complete snapshot with readLatest(); a reader
+ * that overlaps a write of the same slot simply retries. With several slots a
+ * reader only has to retry if it is slower than a full turn of the ring.
+ */
+class SnapshotRing
+{
+public:
+  SnapshotRing() : numSlots(0), writeIndex(0), latestIndex(-1) {}
+
+  /**
+   * @brief Allocate the slots. Must not be called concurrently with any other method.
+   *
+   * @param numValues Number of values in each snapshot
+   * @param slots Number of snapshots kept in the ring
+   */
+  void resize(size_t numValues, unsigned slots = 4)
+  {
+    numSlots = slots;
+    ring.reset(new Slot[numSlots]);
+    for(unsigned i = 0; i < numSlots; i++)
+    {
+      ring[i].values.resize(numValues, 0.0f);
+    }
+    writeIndex = 0;
+    latestIndex.store(-1, boost::memory_order_release);
+  }
+
+  /**
+   * @brief Start writing the next snapshot (writer only)
+   *
+   * @return Values of the slot being written, to be overwritten in place
+   */
+  std::vector<float> & beginWrite()
+  {
+    writeIndex = (writeIndex + 1) % numSlots;
+    Slot & slot = ring[writeIndex];
+    // odd sequence: write in progress
+    slot.sequence.store(slot.sequence.load(boost::memory_order_relaxed) + 1, boost::memory_order_relaxed);
+    boost::atomic_thread_fence(boost::memory_order_release);
+    return slot.values;
+  }
+
+  /**
+   * @brief Stamp and publish the snapshot started by beginWrite() (writer only)
+   *
+   * @param dcmTime DCM time at which the values were read
+   * @param cycle DCM cycle counter
+   */
+  void endWrite(int dcmTime, unsigned int cycle)
+  {
+    Slot & slot = ring[writeIndex];
+    slot.dcmTime = dcmTime;
+    slot.cycle = cycle;
+    slot.sequence.store(slot.sequence.load(boost::memory_order_relaxed) + 1, boost::memory_order_release);
+    latestIndex.store(static_cast<int>(writeIndex), boost::memory_order_release);
+  }
+
+  /**
+   * @brief Give up the snapshot started by beginWrite() (writer only)
+   * The previous snapshot stays the latest one.
+   */
+  void abortWrite()
+  {
+    Slot & slot = ring[writeIndex];
+    slot.sequence.store(slot.sequence.load(boost::memory_order_relaxed) + 1, boost::memory_order_release);
+  }
+
+  /**
+   * @brief Copy the latest complete snapshot
+   *
+   * @return false if nothing was published yet
+   */
+  bool readLatest(std::vector<float> & values, int & dcmTime, unsigned int & cycle) const
+  {
+    while(true)
+    {
+      int index = latestIndex.load(boost::memory_order_acquire);
+      if(index < 0)
+      {
+        return false;
+      }
+      const Slot & slot = ring[index];
+      unsigned int before = slot.sequence.load(boost::memory_order_acquire);
+      if(before & 1)
+      {
+        continue;
+      }
+      values.assign(slot.values.begin(), slot.values.end());
+      dcmTime = slot.dcmTime;
+      cycle = slot.cycle;
+      boost::atomic_thread_fence(boost::memory_order_acquire);
+      if(slot.sequence.load(boost::memory_order_relaxed) == before)
+      {
+        return true;
+      }
+    }
+  }
+
+  /**
+   * @brief Copy only some values of the latest complete snapshot
+   *
+   * @param indices Indices of the values to copy
+   * @param values Resized to indices.size()
+   * @return false if nothing was published yet
+   */
+  bool readLatest(const std::vector<unsigned int> & indices,
+                  std::vector<float> & values,
+                  int & dcmTime,
+                  unsigned int & cycle) const
+  {
+    values.resize(indices.size());
+    while(true)
+    {
+      int index = latestIndex.load(boost::memory_order_acquire);
+      if(index < 0)
+      {
+        return false;
+      }
+      const Slot & slot = ring[index];
+      unsigned int before = slot.sequence.load(boost::memory_order_acquire);
+      if(before & 1)
+      {
+        continue;
+      }
+      for(size_t i = 0; i < indices.size(); i++)
+      {
+        values[i] = slot.values[indices[i]];
+      }
+      dcmTime = slot.dcmTime;
+      cycle = slot.cycle;
+      boost::atomic_thread_fence(boost::memory_order_acquire);
+      if(slot.sequence.load(boost::memory_order_relaxed) == before)
+      {
+        return true;
+      }
+    }
+  }
+
+private:
+  struct Slot
+  {
+    Slot() : sequence(0), dcmTime(0), cycle(0) {}
+    boost::atomic<unsigned int> sequence;
+    std::vector<float> values;
+    int dcmTime;
+    unsigned int cycle;
+  };
+
+  boost::scoped_array<Slot> ring;
+  unsigned numSlots;
+  // only accessed by the writer
+  unsigned writeIndex;
+  boost::atomic<int> latestIndex;
+};
+
+} // namespace mc_naoqi_dcm
@@ -0,0 +1,59 @@
+#pragma once
+#include <vector>
+
+namespace mc_naoqi_dcm
+{
+/**
+ * @brief Per-joint stiffness interpolated by the DCM loop.
+ *
+ * start() and update() are called by the DCM thread only and never allocate
+ * once reset() sized the vectors. A ramp of zero duration is a step.
+ */
+class StiffnessRamp
+{
+public:
+  StiffnessRamp();
+
+  /** Set the current stiffness without ramp (allocates). Only call while the DCM callback is not connected */
+  void reset(const std::vector<float> & stiffness);
+
+  /**
+   * @brief Start a ramp from the current stiffness
+   *
+   * @param target Stiffness at the end of the ramp, one value per joint
+   * @param durationMs Duration of the ramp, 0 to reach the target on the next update()
+   * @param dcmTime DCM time at which the ramp starts
+   */
+  void start(const std::vector<float> & target, int durationMs, int dcmTime);
+
+  /**
+   * @brief Compute the stiffness at the given time
+   *
+   * @return true if the stiffness changed and must be sent to the DCM
+   */
+  bool update(int dcmTime);
+
+  /** Current stiffness */
+  const std::vector<float> & values() const
+  {
+    return current;
+  }
+
+  /** Whether a ramp is in progress */
+  bool active() const
+  {
+    return running;
+  }
+
+private:
+  std::vector<float> current;
+  std::vector<float> from;
+  std::vector<float> to;
+  int startTime;
+  int duration;
+  bool running;
+  // the stiffness changed since the last update()
+  bool pending;
+};
+
+} // namespace mc_naoqi_dcm
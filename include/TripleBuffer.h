@@ -0,0 +1,97 @@
+#pragma once
+#include <boost/atomic.hpp>
+
+namespace mc_naoqi_dcm
+{
+/**
+ * @brief Wait-free single-producer/single-consumer triple buffer.
+ *
+ * The producer fills writeBuffer() and calls publish(), the consumer calls
+ * update() and reads readBuffer(). Neither side ever blocks: the three slots
+ * are allocated once with reset() and afterwards only exchanged by index, so
+ * as long as the producer overwrites the slot in place (e.g. std::copy into a
+ * vector of the right size) no allocation happens on either side.
+ *
+ * The consumer always sees one complete frame, the latest one published
+ * before its last call to update().
+ */
+template<typename T>
+class TripleBuffer
+{
+public:
+  TripleBuffer() : state(middleIndex), backIndex(backIndexInit), frontIndex(frontIndexInit) {}
+
+  /**
+   * @brief Fill all three slots with the given value (allocates).
+   * Must not be called concurrently with any other method.
+   */
+  void reset(const T & value)
+  {
+    for(unsigned i = 0; i < 3; i++)
+    {
+      buffers[i] = value;
+    }
+    state.store(middleIndex, boost::memory_order_release);
+    backIndex = backIndexInit;
+    frontIndex = frontIndexInit;
+  }
+
+  /**
+   * @brief Slot owned by the producer. Its content is undefined after publish(),
+   * the whole frame must be written before the next publish().
+   */
+  T & writeBuffer()
+  {
+    return buffers[backIndex];
+  }
+
+  /** Make the frame written in writeBuffer() available to the consumer */
+  void publish()
+  {
+    backIndex = state.exchange(backIndex | dirtyBit, boost::memory_order_acq_rel) & indexMask;
+  }
+
+  /**
+   * @brief Acquire the latest published frame, if any.
+   *
+   * @return true if a new frame was published since the previous call
+   */
+  bool update()
+  {
+    if(!(state.load(boost::memory_order_relaxed) & dirtyBit))
+    {
+      return false;
+    }
+    frontIndex = state.exchange(frontIndex, boost::memory_order_acq_rel) & indexMask;
+    return true;
+  }
+
+  /** Slot owned by the consumer, valid until the next call to update() */
+  const T & readBuffer() const
+  {
+    return buffers[frontIndex];
+  }
+
+  /** Slot owned by the consumer, it may be modified in place until the next call to update() */
+  T & readBuffer()
+  {
+    return buffers[frontIndex];
+  }
+
+private:
+  static const unsigned int frontIndexInit = 0;
+  static const unsigned int middleIndex = 1;
+  static const unsigned int backIndexInit = 2;
+  static const unsigned int indexMask = 3;
+  static const unsigned int dirtyBit = 4;
+
+  T buffers[3];
+  // index of the shared slot and whether it holds an unread frame
+  boost::atomic<unsigned int> state;
+  // only accessed by the producer
+  unsigned int backIndex;
+  // only accessed by the consumer
+  unsigned int frontIndex;
+};
+
+} // namespace mc_naoqi_dcm
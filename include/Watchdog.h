@@ -0,0 +1,111 @@
+#pragma once
+#include <boost/atomic.hpp>
+
+#include <vector>
+
+namespace mc_naoqi_dcm
+{
+/**
+ * @brief Detects a stalled command stream in the DCM loop and applies a fallback policy.
+ *
+ * update() is called by the DCM thread at every tick and never blocks nor
+ * allocates. The policy can be changed and the status read from any thread.
+ */
+class Watchdog
+{
+public:
+  enum Policy
+  {
+    // only count missed cycles, the loop keeps re-sending the last command
+    Off = 0,
+    // re-send the last command for durationMs after the watchdog trips, then stop sending joint commands
+    Hold = 1,
+    // extrapolate the last commands velocity until the watchdog trips, then hold as Hold
+    ExtrapolateHold = 2,
+    // hold and ramp the joint stiffness down to zero over durationMs when the watchdog trips
+    StiffnessOff = 3
+  };
+
+  Watchdog();
+
+  /**
+   * @brief Change the policy (any thread)
+   *
+   * @param policy Fallback policy
+   * @param missedCycles Number of cycles without command after which the watchdog trips
+   * @param durationMs Hold horizon of the Hold and ExtrapolateHold policies,
+   * duration of the stiffness ramp of the StiffnessOff policy
+   */
+  void configure(Policy policy, unsigned int missedCycles, unsigned int durationMs);
+
+  /** Set the initial command. Only call while the DCM callback is not connected */
+  void reset(const std::vector<float> & command);
+
+  /** Forget the command stream. Only call while the DCM callback is not connected */
+  void restart();
+
+  /**
+   * @brief Update the watchdog with the command of this cycle (DCM thread)
+   *
+   * @param newCommand Whether a new command was received since the previous cycle
+   * @param command Command to be sent, extrapolated in place by the ExtrapolateHold policy
+   *
+   * @return true on the cycle the watchdog trips
+   */
+  bool update(bool newCommand, std::vector<float> & command);
+
+  Policy policy() const
+  {
+    return static_cast<Policy>(policyValue.load(boost::memory_order_relaxed));
+  }
+
+  unsigned int missedCycles() const
+  {
+    return missedCyclesValue.load(boost::memory_order_relaxed);
+  }
+
+  unsigned int durationMs() const
+  {
+    return durationMsValue.load(boost::memory_order_relaxed);
+  }
+
+  /** Whether the command stream is currently considered dead */
+  bool tripped() const
+  {
+    return trippedValue.load(boost::memory_order_relaxed);
+  }
+
+  /** Number of times the watchdog tripped since the last resetCounters() */
+  unsigned int trips() const
+  {
+    return tripsValue.load(boost::memory_order_relaxed);
+  }
+
+  unsigned int cyclesSinceCommand() const
+  {
+    return cyclesSinceCommandValue.load(boost::memory_order_relaxed);
+  }
+
+  /** Longest run of cycles without command since the last resetCounters() */
+  unsigned int maxCyclesSinceCommand() const
+  {
+    return maxCyclesSinceCommandValue.load(boost::memory_order_relaxed);
+  }
+
+  void resetCounters();
+
+private:
+  boost::atomic<int> policyValue;
+  boost::atomic<unsigned int> missedCyclesValue;
+  boost::atomic<unsigned int> durationMsValue;
+  boost::atomic<bool> trippedValue;
+  boost::atomic<unsigned int> tripsValue;
+  boost::atomic<unsigned int> cyclesSinceCommandValue;
+  boost::atomic<unsigned int> maxCyclesSinceCommandValue;
+
+  // last received command and its velocity per cycle (DCM thread only)
+  std::vector<float> lastCommand;
+  std::vector<float> velocity;
+};
+
+} // namespace mc_naoqi_dcm
@@ -3,8 +3,19 @@
 #include <althread/almutex.h>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
 
+#include "ControllerPlugin.h"
+#include "DCMClock.h"
+#include "FlightRecorder.h"
+#include "JointLimiter.h"
+#include "LoopStats.h"
 #include "RobotModule.h"
+#include "SharedMemoryChannel.h"
+#include "SnapshotRing.h"
+#include "StiffnessRamp.h"
+#include "TripleBuffer.h"
+#include "Watchdog.h"
 
 namespace AL
 {
@@ -40,9 +51,30 @@ public:
   /*! Stop the example */
   void stopLoop();
 
-  /*! Enable/disable turning off wheels on bumper pressed */
+  /**
+   * @brief Enable/disable turning off wheels on bumper pressed
+   *
+   * While the loop is running the bumpers are checked at every DCM cycle: the
+   * reflex then zeroes wheel speed and stiffness in the same cycle and stays
+   * latched until rearmBumperReflex() is called.
+   */
   void bumperSafetyReflex(bool state);
 
+  /*! Release a latched bumper reflex, wheel stiffness must then be restored with setWheelsStiffness */
+  void rearmBumperReflex();
+
+  /**
+   * @brief Bumper reflex status
+   *
+   * @return [enabled, latched, trips]
+   */
+  AL::ALValue getBumperReflexStatus();
+
+#ifdef MC_NAOQI_DCM_HOST
+  /*! Host build only: createAliasPrepareCommand on the joint actuator keys, timed by host/benchmarks */
+  void benchmarkCreateAliasPrepareCommand(AL::ALValue & command);
+#endif
+
 private:
   /*! Initialisation of ALMemory/DCM link */
   void init();
@@ -50,7 +82,23 @@ private:
   /*! ALMemory fast access */
   void initFastAccess();
 
-  /*!  Connect callback to the DCM preproccess */
+  /*! Measure the DCM time with getTime and update the DCM clock model */
+  void synchroniseDCMClock();
+
+  /*! Periodically call synchroniseDCMClock, runs in clockSyncThread */
+  void clockSyncLoop();
+
+  /*! Write the flight recorder to path, runs in flightRecorderDumpThread */
+  void flightRecorderDumpLoop(std::string path);
+
+  /**
+   * @brief Latest sensor snapshot and its stamps
+   *
+   * Reads ALMemory directly if the loop is not running (cycle is then 0)
+   */
+  void readSensorSnapshot(std::vector<float> & sensorValues, int & DCMtime, unsigned int & cycle);
+
+  /*!  Connect callbacks to the DCM preproccess and postprocess */
   void connectToDCMloop();
 
   /**
@@ -65,6 +113,152 @@ private:
    */
   void synchronisedDCMcallback();
 
+  /**
+   * @brief Callback called by the DCM every 12ms after sensors are updated
+   *
+   *  Once connected to DCM postprocess it reads all sensors once per cycle
+   *  and publishes them as a consistent snapshot for getSensors().
+   *  Same real-time constraints as synchronisedDCMcallback().
+   */
+  void synchronisedSensorsCallback();
+
+  /*! Apply the watchdog policy on the cycle it trips (DCM thread) */
+  void applyWatchdogPolicy(int DCMtime);
+
+  /*! Apply stiffness commands written to the shared-memory channel (DCM thread) */
+  void sendSharedMemoryCommands(int DCMtime);
+
+  /**
+   * Errors of the DCM callbacks. The callbacks never throw nor build error
+   * messages, failures are only counted (see getLoopErrors())
+   */
+  enum LoopError
+  {
+    LoopErrorNone = 0,
+    // setAlias of the joint position command failed
+    LoopErrorJointCommand,
+    // setAlias of a stiffness command failed
+    LoopErrorStiffnessCommand,
+    // setAlias of a wheels command failed
+    LoopErrorWheelsCommand,
+    // reading sensors from ALMemory failed
+    LoopErrorSensors,
+    // a stiffness frame of the shared-memory channel had a NaN value, it was dropped
+    LoopErrorSharedMemoryStiffness,
+    LoopErrorCount
+  };
+
+  /*! Count an error of the DCM callbacks (wait-free) */
+  void reportLoopError(LoopError error);
+
+  /**
+   * @brief setAlias from the DCM thread, reporting failures instead of throwing
+   *
+   * @return false if the command could not be sent
+   */
+  bool sendLoopCommand(const AL::ALValue & command, LoopError error);
+
+  /**
+   * @brief Errors of the DCM callbacks since the last resetLoopErrors()
+   *
+   * @return [last error code, [count for each error code]]
+   * Error codes: 0 none, 1 joint command, 2 stiffness command, 3 wheels command, 4 sensors,
+   * 5 shared-memory stiffness
+   */
+  AL::ALValue getLoopErrors();
+
+  /*! Reset the DCM callbacks error counters */
+  void resetLoopErrors();
+
+  /**
+   * @brief Write the last cycles of the loop (commands and sensors) to a file
+   *
+   * The file is written from a background thread, see getFlightRecorderStatus().
+   * The format is described in FlightRecorder.h, utils/flight_recorder_to_csv.py converts it to CSV.
+   *
+   * @param path File to write on the robot
+   */
+  void dumpFlightRecorder(const std::string & path);
+
+  /**
+   * @brief Flight recorder status
+   *
+   * @return [capacity in cycles, dump in progress, records written by the last dump or -1 if it failed]
+   */
+  AL::ALValue getFlightRecorderStatus();
+
+  /**
+   * @brief Load a controller plugin run by the DCM loop (see mc_naoqi_dcm_plugin.h)
+   *
+   * Plugins run in load order at every cycle, after the client commands and
+   * the watchdog, and before the joint limiter. A plugin is disabled if its
+   * step fails, or if it overruns its budget several cycles in a row. The
+   * budget only detects overruns: a step that never returns stalls the DCM
+   * thread. The loop must be stopped.
+   *
+   * @param name Name of the plugin in the other calls
+   * @param path Shared library on the robot
+   * @param budgetUs Overrun detection threshold of one step
+   */
+  void loadPlugin(const std::string & name, const std::string & path, const int & budgetUs);
+
+  /*! Shut down and unload a plugin. The loop must be stopped */
+  void unloadPlugin(const std::string & name);
+
+  /*! Set a parameter of a plugin, applied by the DCM loop before the next step */
+  void setPluginParameter(const std::string & name, const std::string & parameter, const float & value);
+
+  /*! Enable or disable a plugin, e.g. after it was disabled for overrunning its budget */
+  void setPluginEnabled(const std::string & name, const bool & enabled);
+
+  /**
+   * @brief Loaded plugins
+   *
+   * @return [[name, path, enabled, budgetUs, steps, overruns, failures, maxDurationUs, refusedParameters], ...]
+   */
+  AL::ALValue getPlugins();
+
+  /**
+   * @brief Timing statistics of the DCM preprocess callback since the last resetLoopStats()
+   *
+   * @return array of [name, value] pairs. Histograms (callbackDuration, period,
+   * commandAge) are given as [bucket width (us), [bucket counts], max (us)],
+   * the last bucket counting all values above the range. Counters are ticks,
+   * overruns (callback longer than its budget), lateTicks (period above 1.5
+   * nominal period) and missedUpdates (ticks without a new command).
+   */
+  AL::ALValue getLoopStats();
+
+  /*! Reset the timing statistics of the DCM preprocess callback */
+  void resetLoopStats();
+
+  /**
+   * @brief Configure the command watchdog evaluated in the DCM loop
+   *
+   * @param policy 0: off (only count, the last command is re-sent indefinitely),
+   * 1: hold the last command, 2: extrapolate the last commands then hold,
+   * 3: hold and ramp stiffness to zero
+   * @param missedCycles Number of DCM cycles without a new command after which the watchdog trips
+   * @param durationMs Hold horizon of policies 1 and 2, duration of the stiffness ramp of policy 3
+   *
+   * Policies 1 and 2 re-send the last command for durationMs after the watchdog
+   * trips, then stop sending joint commands: the DCM keeps the last actuator
+   * values, but a dead client is no longer driven by the loop. When the
+   * watchdog trips the wheels (if any) are also stopped. It recovers on the
+   * next command, stiffness must then be restored with setStiffness.
+   */
+  void setWatchdog(const int & policy, const int & missedCycles, const int & durationMs);
+
+  /**
+   * @brief Watchdog configuration and status
+   *
+   * @return [policy, missedCycles, durationMs, tripped, trips, cyclesSinceCommand, maxCyclesSinceCommand]
+   */
+  AL::ALValue getWatchdogStatus();
+
+  /*! Reset the watchdog trips and max cycles counters */
+  void resetWatchdogCounters();
+
   /**
    * @brief Set one hardness value to all joint
    *
@@ -73,6 +267,26 @@ private:
    */
   void setStiffness(const float & stiffnessValue);
 
+  /**
+   * @brief Set the stiffness of every joint
+   *
+   * @param stiffnessValues Stiffness values from 0.0 to 1.0, in the order of getJointOrder().
+   * Values out of range are clamped, a NaN value is rejected.
+   */
+  void setJointStiffness(const std::vector<float> & stiffnessValues);
+
+  /**
+   * @brief Ramp the stiffness of every joint from its current value to a target
+   *
+   * The DCM loop interpolates the stiffness linearly and sends it at every
+   * cycle, together with the joint positions. Without the loop the DCM
+   * interpolates between the current stiffness and the target instead.
+   *
+   * @param stiffnessValues Target stiffness values, in the order of getJointOrder()
+   * @param durationMs Duration of the ramp
+   */
+  void setJointStiffnessRamp(const std::vector<float> & stiffnessValues, const int & durationMs);
+
   /**
    * @brief Sets the desired actuator position to the specified one.
    *
@@ -81,6 +295,50 @@ private:
    */
   void setJointAngles(std::vector<float> jointValues);
 
+  /**
+   * @brief Send a joint trajectory to the DCM, which interpolates between its points
+   *
+   * All points are sent in a single multi-point command by the next cycle of
+   * the loop, the loop then stops sending joint positions until the last
+   * point is reached. Any other joint command cancels the rest of the trajectory.
+   *
+   * @param timesMs Time of each point relative to the cycle that sends the trajectory,
+   * strictly increasing
+   * @param points Array of joint vectors, in the order of getJointOrder()
+   */
+  void setJointTrajectory(const std::vector<int> & timesMs, const AL::ALValue & points);
+
+  /**
+   * @brief Move the joints at constant velocities, integrated by the DCM loop
+   *
+   * The first velocity command starts from the current encoder values, the
+   * loop then integrates the velocities at every cycle and clamps the
+   * positions to the joint limits. The client only needs to send a new
+   * command when the velocities change. Any position command ends the
+   * velocity mode. Note that setJointGroupAngles() completes its frame with the
+   * last positions sent through RPC, not with the integrated ones.
+   *
+   * @param velocities Joint velocities (rad/s), in the order of getJointOrder()
+   * @param expiryMs The joints stop after this duration without a new velocity command, 0 for never.
+   * While velocities are being integrated the watchdog does not trip, the expiry is the only timeout.
+   */
+  void setJointVelocities(const std::vector<float> & velocities, const int & expiryMs);
+
+  /**
+   * @brief Commands modified by the joint limiter of the DCM loop
+   *
+   * Before being sent, the joint positions of every cycle are checked against
+   * the previous ones: NaN values are replaced by the previous command, values
+   * are clamped to the joint limits and the step is limited by the joint
+   * maximum velocity.
+   *
+   * @return [[jointName, nanCycles, positionCycles, velocityCycles], ...] in the order of getJointOrder()
+   */
+  AL::ALValue getJointLimitViolations();
+
+  /*! Reset the counters of getJointLimitViolations() */
+  void resetJointLimitViolations();
+
   /**
    * @brief Joint order in which the actuator values will be expressed
    *
@@ -89,6 +347,26 @@ private:
    */
   std::vector<std::string> getJointOrder() const;
 
+  /**
+   * @brief Get a handle on a subset of the joints, for setJointGroupAngles()
+   *
+   * Resolving the same joints in the same order always returns the same handle.
+   *
+   * @param jointNames Joint names from getJointOrder()
+   * @return Joint group handle
+   */
+  int resolveJointGroup(const std::vector<std::string> & jointNames);
+
+  /**
+   * @brief Set the desired position of the joints of a group only
+   *
+   * Other joints keep the position of the last setJointAngles() or setJointGroupAngles() call.
+   *
+   * @param handle Handle returned by resolveJointGroup()
+   * @param jointValues Joint values, in the order given to resolveJointGroup()
+   */
+  void setJointGroupAngles(const int & handle, const std::vector<float> & jointValues);
+
   /**
    * @brief List of readable sensor names.
    * getSensors() will return sensor values corresponding to these.
@@ -101,10 +379,94 @@ private:
   /**
    * @brief Sensor values in the order expressed by getSensorsOrder()
    *
+   * While the loop is running, this is the latest snapshot read by the DCM
+   * postprocess callback: all values come from the same DCM cycle.
+   *
    * @return Vector of sensor values
    */
   std::vector<float> getSensors();
 
+  /**
+   * @brief Register a subset of the sensors to be read with getSensorsProfile()
+   *
+   * @param name Profile name, registering an existing name replaces its sensors and keeps its id
+   * @param sensors Sensor names from getSensorsOrder(), or prefixes ending with '*' to
+   * select a whole group (e.g. "Encoder*", "Gyroscope*")
+   * @return Profile id
+   */
+  int registerSensorProfile(const std::string & name, const std::vector<std::string> & sensors);
+
+  /**
+   * @brief Sensor names of a profile, in the order of getSensorsProfile()
+   */
+  std::vector<std::string> getSensorsProfileOrder(const int & id);
+
+  /**
+   * @brief Values of the sensors of a profile, from the same snapshot as getSensors()
+   *
+   * @param id Id returned by registerSensorProfile()
+   */
+  std::vector<float> getSensorsProfile(const int & id);
+
+  /**
+   * @brief Sensor tiers read at a lower rate than getSensors()
+   *
+   * @return Array of [name, decimation, [sensor names]], decimation being the
+   * number of DCM cycles between two reads of the tier
+   */
+  AL::ALValue getSensorTiers() const;
+
+  /**
+   * @brief Latest values of a sensor tier
+   *
+   * All values of a tier are read in the same cycle, the DCM time and cycle
+   * tell how fresh they are.
+   *
+   * @param tierName Name from getSensorTiers()
+   * @return [values, DCMtime, cycle]
+   */
+  AL::ALValue getTierSensors(const std::string & tierName);
+
+  /**
+   * @brief Set joint angles and get the latest sensor snapshot in a single call
+   *
+   * Equivalent to setJointAngles() followed by getSensors(), but with only one
+   * proxy round-trip per control cycle.
+   *
+   * @param jointValues
+   * Joint values, specified in the same order as RobotModule::actuators.
+   *
+   * @return [sensor values, DCM time of the snapshot, DCM cycle counter]
+   * The cycle counter is 0 if the loop is not running.
+   */
+  AL::ALValue setJointAnglesAndGetSensors(std::vector<float> jointValues);
+
+  /**
+   * @brief Block until the DCM postprocess publishes a cycle other than lastCycleId
+   *
+   * Lets a controller run in lockstep with the DCM: it computes right after
+   * the sensors are read and its command is picked up by the next preprocess,
+   * instead of polling getSensors() at its own pace. Clients using the shared
+   * memory channel use SharedMemoryChannel::waitForCycle() instead.
+   *
+   * @param lastCycleId Cycle counter of the last snapshot received, any other value
+   * (e.g. -1) returns the latest snapshot immediately
+   * @param timeoutMs Maximum waiting time
+   *
+   * @return [sensor values, DCM time of the snapshot, DCM cycle counter]
+   * The cycle counter is still lastCycleId after a timeout. Throws if the loop is not running.
+   */
+  AL::ALValue waitForNextCycle(const int & lastCycleId, const int & timeoutMs);
+
+  /**
+   * @brief Map a DCM time to the robot host monotonic clock (CLOCK_MONOTONIC)
+   *
+   * @param dcmTime DCM time in ms, e.g. as returned by setJointAnglesAndGetSensors()
+   *
+   * @return [seconds, nanoseconds]
+   */
+  AL::ALValue dcmTimeToHostTime(const int & dcmTime);
+
   /**
    * @brief Robot name (pepper or nao)
    *
@@ -147,41 +509,365 @@ private:
    */
   void setWheelSpeed(const float & speed_fl, const float & speed_fr, const float & speed_b);
 
+  /**
+   * @brief Set joint angles and wheel speeds in the same command frame
+   *
+   * Both are sent to the DCM in the same cycle of the loop.
+   *
+   * @param jointValues Joint values, in the order of getJointOrder()
+   * @param wheelSpeeds Wheel speeds, in the order of wheelNames()
+   */
+  void setJointAnglesAndWheelSpeeds(const std::vector<float> & jointValues, const std::vector<float> & wheelSpeeds);
+
   // one led set function for all groups
   void setLeds(std::string ledGroupName, const float & r, const float & g, const float & b);
   void setLedsDelay(std::string ledGroupName, const float & r, const float & g, const float & b, const int & delay);
   // Note: cannot bind mathods with the same name and different arguments
   void isetLeds(std::string ledGroupName, const float & intensity);
+
+  /**
+   * @brief Get a handle on a led group, for setLedsHandle() and isetLedsHandle()
+   *
+   * Handles are stable for the lifetime of the module.
+   */
+  int resolveLedGroup(const std::string & ledGroupName);
+
+  /*! setLeds() on the led group of a handle returned by resolveLedGroup() */
+  void setLedsHandle(const int & handle, const float & r, const float & g, const float & b);
+
+  /*! isetLeds() on the led group of a handle returned by resolveLedGroup() */
+  void isetLedsHandle(const int & handle, const float & intensity);
+
+  /**
+   * @brief Set several led groups at once
+   *
+   * All groups share the same command time and each group is sent with a
+   * single setAlias. Nothing is sent if any entry is invalid.
+   *
+   * @param entries Array of [ledGroupName, r, g, b] (RGB groups) or
+   * [ledGroupName, intensity] (single channel groups) entries
+   */
+  void setLedsBatch(const AL::ALValue & entries);
+
+  /**
+   * @brief Store a named led animation, to be played with playLedAnimation()
+   *
+   * Keyframes are expanded once into one time-separate DCM command per led
+   * group, the DCM then interpolates linearly between keyframes on its own.
+   *
+   * @param name Animation name, replaces any animation with the same name
+   * @param keyframes Array of [timeMs, ledGroupName, r, g, b] (RGB groups) or
+   * [timeMs, ledGroupName, intensity] (single channel groups) sorted by time,
+   * with 0 <= timeMs < durationMs and at most one keyframe per group and time
+   * @param durationMs Duration of one loop of the animation
+   * @param loops Number of times the animation is played
+   */
+  void uploadLedAnimation(const std::string & name, const AL::ALValue & keyframes, const int & durationMs,
+                          const int & loops);
+
+  /**
+   * @brief Play an animation stored with uploadLedAnimation()
+   *
+   * The whole animation is queued in the DCM (one setAlias per led group), no
+   * further call is needed.
+   */
+  void playLedAnimation(const std::string & name);
+
+  /*! Names of the stored led animations */
+  std::vector<std::string> getLedAnimations();
+
   // blink
   void blink();
 
   // check if preProces is connected
   bool isPreProccessConnected();
 
+  /**
+   * @brief Create (if needed) and enable the shared-memory channel
+   *
+   * Once enabled, command frames written by a SharedMemoryChannel client are
+   * sent by the DCM preprocess callback, and sensor snapshots are published to
+   * the channel at every DCM postprocess. The segment stays mapped until the
+   * module is destroyed.
+   *
+   * @param name POSIX shared-memory object name (e.g. "/mc_naoqi_dcm")
+   */
+  void enableSharedMemoryChannel(const std::string & name);
+
+  /*! Stop using the shared-memory channel in the DCM callbacks */
+  void disableSharedMemoryChannel();
+
 private:
   // Used for preprocess sync with the DCM
   ProcessSignalConnection fDCMPreProcessConnection;
 
-  // Used to check id preprocess is connected
-  bool preProcessConnected;
+  // Used for postprocess sync with the DCM
+  ProcessSignalConnection fDCMPostProcessConnection;
+
+  // Used to check id preprocess is connected, set by startLoop/stopLoop
+  boost::atomic<bool> preProcessConnected;
+  // Serialises startLoop, stopLoop, loadPlugin and unloadPlugin: the plugins
+  // are only modified while the loop is stopped
+  boost::shared_ptr<AL::ALMutex> loopMutex;
 
   // Used for fast memory access
   boost::shared_ptr<AL::ALMemoryFastAccess> fMemoryFastAccess;
 
-  // Store sensor values.
-  std::vector<float> sensorValues;
+  // Sensor values read once per DCM cycle in synchronisedSensorsCallback
+  SnapshotRing sensorSnapshots;
+
+  // Number of DCM cycles seen by synchronisedSensorsCallback (DCM thread only)
+  unsigned int dcmCycle;
+
+  // Latest cycle published by synchronisedSensorsCallback, for waitForNextCycle
+  boost::atomic<unsigned int> publishedCycle;
+  // Number of RPC clients blocked in waitForNextCycle, they sleep on publishedCycle as a futex
+  boost::atomic<int> cycleWaiters;
+
   boost::shared_ptr<AL::DCMProxy> dcmProxy;
 
+  /**
+   * DCM time model, avoids a dcmProxy->getTime call for every command
+   * (in particular on the DCM thread)
+   */
+  DCMClock dcmClock;
+  // Resynchronises dcmClock every clockSyncPeriodMs
+  boost::thread clockSyncThread;
+  static const int clockSyncPeriodMs = 1000;
+
+  // Last cycles of the loop, filled by synchronisedSensorsCallback
+  FlightRecorder flightRecorder;
+  static const int flightRecorderSeconds = 10;
+  boost::thread flightRecorderDumpThread;
+  boost::atomic<bool> flightRecorderDumping;
+  boost::atomic<int> flightRecorderLastDump;
+
+  // Controller plugins, only modified while the loop is stopped
+  std::vector<boost::shared_ptr<ControllerPlugin> > plugins;
+  // Serialises the plugin RPC calls
+  boost::shared_ptr<AL::ALMutex> pluginsMutex;
+  // Joint positions then wheel speeds refined by the plugins (DCM thread only)
+  std::vector<float> loopPluginCommands;
+  // DCM time of the previous plugin steps, 0 before the first one
+  int loopPluginTime;
+
+  /*! Run the plugins on the current command into loopPluginCommands (DCM thread) */
+  void runPlugins(int DCMtime);
+
+  /*! Plugin of a name received through RPC, pluginsMutex must be held */
+  boost::shared_ptr<ControllerPlugin> plugin(const std::string & name, const std::string & method);
+
   // Memory proxy
   boost::shared_ptr<AL::ALMemoryProxy> memoryProxy;
 
   /**
    * This method will be called every time the bumper press event is raised
+   * Only used while the loop is not running, the loop reacts faster on its own
    */
   void onBumperPressed();
 
+  // Indices of the platform bumpers in the sensor values
+  std::vector<unsigned int> bumperSensorIndices;
+  boost::atomic<bool> bumperReflexEnabled;
+  // Set by the loop when a bumper is pressed, cleared by rearmBumperReflex
+  boost::atomic<bool> bumperReflexLatched;
+  boost::atomic<unsigned int> bumperReflexTrips;
+
+  /*! Check the bumpers in the latest sensor values and stop the wheels if needed (DCM thread) */
+  void checkBumperReflex(const std::vector<float> & sensorValues, int DCMtime);
+
+  // Command frame sent to the DCM loop
+  struct JointCommandFrame
+  {
+    // joint positions followed by the wheel speeds (if any)
+    std::vector<float> values;
+    // sequence of the wheel speeds in values, 0 if the frame only commands the joints
+    unsigned int wheelsSequence;
+    // times of the trajectory points relative to the cycle that sends them, empty if no trajectory
+    std::vector<int> trajectoryTimes;
+    // multi-point jointActuator command, times filled by the loop
+    AL::ALValue trajectory;
+  };
+
   // Used for sending joint position commands every 12ms in callback
-  std::vector<float> jointPositionCommands;
+  // Written by setJointAngles/setJointTrajectory, read by synchronisedDCMcallback without locking
+  TripleBuffer<JointCommandFrame> jointPositionCommands;
+
+  // Maximum number of points of setJointTrajectory
+  static const unsigned int maxTrajectoryPoints = 250;
+
+  // DCM time of the last point of the trajectory being executed (DCM thread only)
+  int loopTrajectoryEnd;
+  bool loopTrajectoryActive;
+
+  // Velocity command sent to the DCM loop
+  struct VelocityFrame
+  {
+    std::vector<float> velocities;
+    // 0 if the command does not expire
+    int expiryMs;
+  };
+
+  // Written by setJointVelocities (under jointPositionCommandsMutex), read by synchronisedDCMcallback
+  TripleBuffer<VelocityFrame> jointVelocityCommands;
+
+  // Velocity mode state (DCM thread only)
+  std::vector<float> loopJointVelocities;
+  bool loopVelocityActive;
+  bool loopVelocityExpires;
+  int loopVelocityExpiry;
+  // DCM time of the last integration step
+  int loopVelocityTime;
+  // sensor values read when the velocity mode starts
+  std::vector<float> loopSensorValues;
+
+  /*! Integrate the joint velocities up to DCMtime into loopJointPositions (DCM thread) */
+  void integrateJointVelocities(int DCMtime);
+
+  // Serialises concurrent setJointAngles callers (the DCM callback never takes it)
+  boost::shared_ptr<AL::ALMutex> jointPositionCommandsMutex;
+
+  // Last frame commanded through RPC, completed by setJointGroupAngles (under jointPositionCommandsMutex)
+  std::vector<float> jointPositionTargets;
+
+  /*! Publish jointPositionTargets to the DCM loop, jointPositionCommandsMutex must be held */
+  void publishCommandFrame(bool withWheels);
+
+  /*! Send a trajectory published by setJointTrajectory and hold its last point (DCM thread) */
+  void sendJointTrajectory(JointCommandFrame & frame, int DCMtime);
+
+  /*! Stop holding the joints for a trajectory cancelled by another joint command (DCM thread) */
+  void interruptJointTrajectory();
+
+  // Stiffness command sent to the DCM loop
+  struct StiffnessFrame
+  {
+    // target stiffness of every joint
+    std::vector<float> stiffness;
+    // duration of the ramp from the current stiffness, 0 for a step
+    int durationMs;
+  };
+
+  // Written by the stiffness setters (under jointPositionCommandsMutex), read by synchronisedDCMcallback
+  TripleBuffer<StiffnessFrame> jointStiffnessFrames;
+
+  // Stiffness currently sent by the DCM loop (DCM thread only while the loop is connected)
+  StiffnessRamp jointStiffnessRamp;
+
+  // All zero stiffness, target of the watchdog ramp
+  std::vector<float> zeroJointStiffness;
+
+  /*! Send a stiffness command to the loop, or directly to the DCM when the loop is not connected */
+  void sendJointStiffness(const std::vector<float> & stiffnessValues, int durationMs, const std::string & method);
+
+  // Wheels stiffness to be sent by the DCM loop (written under jointPositionCommandsMutex)
+  TripleBuffer<float> wheelsStiffnessTarget;
+
+  // Set when the wheels were stopped by the watchdog or a bumper: the loop sends
+  // zero wheel speeds until the next wheel speed command
+  boost::atomic<bool> wheelsStopped;
+
+  // Wheel speeds sent to the DCM at every cycle (DCM thread only)
+  std::vector<float> loopWheelSpeeds;
+
+  // Wheel speeds command sent to the DCM loop without touching the joints
+  struct WheelsFrame
+  {
+    std::vector<float> speeds;
+    unsigned int sequence;
+  };
+
+  // Written by setWheelSpeed (under jointPositionCommandsMutex), read by synchronisedDCMcallback
+  TripleBuffer<WheelsFrame> wheelSpeedCommands;
+
+  // Sequence of the last wheel speeds published (under jointPositionCommandsMutex)
+  unsigned int wheelSpeedsSequence;
+  // Sequence of the wheel speeds in loopWheelSpeeds (DCM thread only), the newest of the two frames wins
+  unsigned int loopWheelSpeedsSequence;
+
+  /*! Take the wheel speeds of a frame if they are newer than loopWheelSpeeds (DCM thread) */
+  void updateLoopWheelSpeeds(const float * speeds, unsigned int sequence);
+
+  // Actuator indices of the groups returned by resolveJointGroup (under jointPositionCommandsMutex)
+  std::vector<std::vector<unsigned int> > jointGroups;
+
+  // Reads one RobotModule::sensorTiers entry in the postprocess callback
+  struct SensorTierReader
+  {
+    boost::shared_ptr<AL::ALMemoryFastAccess> fastAccess;
+    SnapshotRing snapshots;
+    // the tier is read when dcmCycle % decimation == phase
+    unsigned int phase;
+  };
+
+  // One reader per sensor tier, in the order of robot_module.sensorTiers
+  std::vector<boost::shared_ptr<SensorTierReader> > sensorTierReaders;
+
+  /*! Read the sensor tiers due in this cycle (DCM thread only) */
+  void readSensorTiers(int DCMtime);
+
+  // Subset of the sensors registered by a client, immutable once registered
+  struct SensorProfile
+  {
+    std::string name;
+    // indices in robot_module.sensors
+    std::vector<unsigned int> indices;
+  };
+
+  // Profiles by id, replaced as a whole when re-registered
+  std::vector<boost::shared_ptr<const SensorProfile> > sensorProfiles;
+
+  // Protects sensorProfiles, only held to copy a profile pointer
+  boost::shared_ptr<AL::ALMutex> sensorProfilesMutex;
+
+  /*! Profile of an id received through RPC */
+  boost::shared_ptr<const SensorProfile> sensorProfile(int id);
+
+  // Joint positions requested from the DCM loop (DCM thread only)
+  std::vector<float> loopJointPositions;
+  // Joint positions actually sent, after jointLimiter (DCM thread only)
+  std::vector<float> loopSentJointPositions;
+  // Limits the joint positions sent by the loop
+  JointLimiter jointLimiter;
+
+  /*! Start the joint limiter from the encoders, the commands sent before may be far from them */
+  void holdJointLimiterAtEncoders(const std::vector<float> & sensorValues);
+
+  /**
+   * Optional shared-memory transport for controllers running on the robot
+   */
+  SharedMemoryChannel sharedMemoryChannel;
+  // Whether the DCM callbacks use sharedMemoryChannel
+  boost::atomic<bool> sharedMemoryActive;
+  // Serialises enable/disable calls
+  boost::shared_ptr<AL::ALMutex> sharedMemoryMutex;
+  // Sequence of the last frames read from the channel (DCM thread only)
+  uint32_t sharedJointPositionsSequence;
+  uint32_t sharedJointStiffnessSequence;
+  uint32_t sharedWheelSpeedsSequence;
+  std::vector<float> sharedJointStiffness;
+  // Copies of the stiffness/wheels commands owned by the DCM thread
+  AL::ALValue loopJointStiffnessCommands;
+  AL::ALValue loopWheelsCommands;
+  AL::ALValue loopWheelsStiffnessCommands;
+
+  // Detects a stalled command stream in synchronisedDCMcallback
+  Watchdog watchdog;
+  // DCM time until which a tripped Hold or ExtrapolateHold watchdog re-sends the last command (DCM thread only)
+  int watchdogHoldEnd;
+
+  // Timing statistics of synchronisedDCMcallback
+  LoopStats loopStats;
+  // Host time (us, truncated) at which setJointAngles last published a command
+  boost::atomic<unsigned int> jointPositionCommandsTime;
+  // Host time at which the command sent by the loop was published (DCM thread only)
+  unsigned int loopJointPositionsTime;
+  // Time budget of the DCM callback
+  static const unsigned int callbackBudgetUs = 1000;
+
+  // Error counters of the DCM callbacks, indexed by LoopError
+  boost::atomic<unsigned int> loopErrorCounts[LoopErrorCount];
+  boost::atomic<int> lastLoopError;
 
   // Used to store joint possition command to set via DCM every 12ms
   AL::ALValue commands;
@@ -193,10 +879,53 @@ private:
    * Store command to send to leds
    */
 
-  // map led group name to corresponding RGB or intensity commands
-  // clang-format off
-  std::map< std::string, std::vector<AL::ALValue> > ledCmdMap;
-  // clang-format on
+  struct LedGroupCommand
+  {
+    // RGB groups: the alias holds all red keys, then all green keys, then all blue keys
+    bool rgb;
+    // number of leds in the group
+    unsigned int numLeds;
+    // command of the whole group, sent with a single setAlias
+    AL::ALValue command;
+  };
+
+  // RGB or intensity commands of every led group, indexed by handle
+  std::vector<LedGroupCommand> ledCommands;
+
+  // map led group name to its handle in ledCommands
+  std::map<std::string, int> ledGroupHandles;
+
+  /*! Handle of a led group, -1 if unknown */
+  int findLedGroup(const std::string & ledGroupName) const;
+
+  /*! Check a led group handle received through RPC */
+  LedGroupCommand & ledGroup(int handle, const std::string & method);
+
+  /*! Send an RGB led command at DCMtime */
+  void setLedsAt(LedGroupCommand & leds, int DCMtime, float r, float g, float b);
+
+  // Serialises led commands sent from concurrent calls
+  boost::shared_ptr<AL::ALMutex> ledsMutex;
+
+  // Keyframes of a led animation for one led group, as a time-separate DCM command
+  struct LedAnimationTrack
+  {
+    // keyframe times relative to the start of the animation
+    std::vector<int> times;
+    // command with one value per keyframe for every memory key of the group
+    AL::ALValue command;
+  };
+
+  // led animations by name, each with one track per animated led group
+  std::map<std::string, std::vector<LedAnimationTrack> > ledAnimations;
+
+  /**
+   * Fill the command of a led group. Only r is used (as intensity) for single channel groups
+   */
+  void fillLedCommand(LedGroupCommand & leds, int DCMtime, float r, float g, float b);
+
+  /*! Send the command of a led group to the DCM */
+  void sendLedCommand(const LedGroupCommand & leds);
 
   /**
    * Store commands to send to wheels (speed and stiffness)
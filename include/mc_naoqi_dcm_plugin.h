@@ -0,0 +1,74 @@
+#pragma once
+/*
+ * C ABI of the controller plugins run inside the DCM loop of MCNAOqiDCM.
+ *
+ * A plugin is a shared library exporting MC_NAOQI_DCM_PLUGIN_ENTRY, a function
+ * returning a static mc_naoqi_dcm_plugin. It is loaded with the loadPlugin
+ * method of the module, while the loop is stopped:
+ *
+ *   static int step(void * state, const float * sensors, float * commands, float dt) { ... return 0; }
+ *   static const mc_naoqi_dcm_plugin plugin = {MC_NAOQI_DCM_PLUGIN_ABI_VERSION, init, step, set_parameter, shutdown};
+ *   extern "C" const mc_naoqi_dcm_plugin * mc_naoqi_dcm_plugin_entry(void) { return &plugin; }
+ *
+ * init, set_parameter and shutdown may allocate, step must not: it is called
+ * by the DCM thread at every cycle. Steps are timed but never interrupted,
+ * a step that blocks stalls the DCM. set_parameter is also called by the DCM
+ * thread, between two steps, so that plugins need no locking.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MC_NAOQI_DCM_PLUGIN_ABI_VERSION 1
+
+/* Name of the entry point exported by every plugin */
+#define MC_NAOQI_DCM_PLUGIN_ENTRY "mc_naoqi_dcm_plugin_entry"
+
+/* Layout of the buffers passed to step(), valid until shutdown */
+typedef struct mc_naoqi_dcm_plugin_layout
+{
+  /* Robot name (nao or pepper) */
+  const char * robot;
+  /* Nominal period of the DCM loop (us) */
+  unsigned int period_us;
+  unsigned int num_actuators;
+  unsigned int num_wheels;
+  unsigned int num_sensors;
+  /* Names of the commands (actuators then wheels) and of the sensors, in buffer order */
+  const char * const * actuators;
+  const char * const * wheels;
+  const char * const * sensors;
+} mc_naoqi_dcm_plugin_layout;
+
+typedef struct mc_naoqi_dcm_plugin
+{
+  /* MC_NAOQI_DCM_PLUGIN_ABI_VERSION the plugin was built with */
+  unsigned int abi_version;
+
+  /* Create the plugin state, NULL on failure */
+  void * (*init)(const mc_naoqi_dcm_plugin_layout * layout);
+
+  /*
+   * Refine the commands of one DCM cycle
+   *
+   * sensors: latest sensor snapshot, num_sensors values
+   * commands: joint positions (rad) then wheel speeds, to be modified in place.
+   * They hold the command of the client, or the output of the previous plugin.
+   * dt: time since the previous step (s)
+   *
+   * Returns 0 on success. Otherwise the commands are restored and the plugin is disabled.
+   */
+  int (*step)(void * state, const float * sensors, float * commands, float dt);
+
+  /* Returns 0 if the parameter was accepted */
+  int (*set_parameter)(void * state, const char * name, float value);
+
+  void (*shutdown)(void * state);
+} mc_naoqi_dcm_plugin;
+
+typedef const mc_naoqi_dcm_plugin * (*mc_naoqi_dcm_plugin_entry_fn)(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,156 @@
+#include "ControllerPlugin.h"
+
+#include "DCMClock.h"
+#include "RobotModule.h"
+
+#include <dlfcn.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace mc_naoqi_dcm
+{
+
+ControllerPlugin::ControllerPlugin(const std::string & name,
+                                   const std::string & path,
+                                   unsigned int budgetUs,
+                                   const std::string & robot,
+                                   unsigned int periodUs,
+                                   const std::vector<std::string> & actuators,
+                                   const std::vector<std::string> & wheels,
+                                   const std::vector<std::string> & sensors)
+: steps(0), overruns(0), failures(0), refusedParameters(0), maxDuration(0), pluginName(name), libraryPath(path),
+  budgetUs(budgetUs), library(0), plugin(0), state(0), robotName(robot), isEnabled(true), consecutiveOverruns(0),
+  backup(actuators.size() + wheels.size(), 0.0f), numPendingParameters(0)
+{
+  names = actuators;
+  names.insert(names.end(), wheels.begin(), wheels.end());
+  names.insert(names.end(), sensors.begin(), sensors.end());
+  for(size_t i = 0; i < names.size(); i++)
+  {
+    namePointers.push_back(names[i].c_str());
+  }
+  layout.robot = robotName.c_str();
+  layout.period_us = periodUs;
+  layout.num_actuators = actuators.size();
+  layout.num_wheels = wheels.size();
+  layout.num_sensors = sensors.size();
+  layout.actuators = namePointers.empty() ? 0 : &namePointers[0];
+  layout.wheels = layout.actuators + actuators.size();
+  layout.sensors = layout.wheels + wheels.size();
+
+  // RTLD_NOW: fail here rather than on the first step in the DCM thread
+  library = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if(!library)
+  {
+    throw std::runtime_error("Cannot load " + path + ": " + dlerror());
+  }
+  mc_naoqi_dcm_plugin_entry_fn entry =
+      reinterpret_cast<mc_naoqi_dcm_plugin_entry_fn>(dlsym(library, MC_NAOQI_DCM_PLUGIN_ENTRY));
+  if(entry)
+  {
+    plugin = entry();
+  }
+  if(!plugin || plugin->abi_version != MC_NAOQI_DCM_PLUGIN_ABI_VERSION || !plugin->init || !plugin->step)
+  {
+    dlclose(library);
+    throw std::runtime_error(path + " is not a plugin of version " + to_string(MC_NAOQI_DCM_PLUGIN_ABI_VERSION));
+  }
+  state = plugin->init(&layout);
+  if(!state)
+  {
+    dlclose(library);
+    throw std::runtime_error("Initialisation of " + path + " failed");
+  }
+}
+
+ControllerPlugin::~ControllerPlugin()
+{
+  if(plugin->shutdown)
+  {
+    plugin->shutdown(state);
+  }
+  dlclose(library);
+}
+
+bool ControllerPlugin::step(const float * sensors, float * commands, float dt)
+{
+  // never wait for an RPC call, the parameters are applied at the next cycle instead
+  if(parametersMutex.try_lock())
+  {
+    for(unsigned int i = 0; i < numPendingParameters; i++)
+    {
+      applyParameter(pendingParameters[i].name, pendingParameters[i].value);
+    }
+    numPendingParameters = 0;
+    parametersMutex.unlock();
+  }
+
+  if(!isEnabled.load(boost::memory_order_relaxed))
+  {
+    consecutiveOverruns = 0;
+    return false;
+  }
+
+  std::copy(commands, commands + backup.size(), backup.begin());
+  long long start = DCMClock::hostTime();
+  int result = plugin->step(state, sensors, commands, dt);
+  long long duration = DCMClock::hostTime() - start;
+  steps.fetch_add(1, boost::memory_order_relaxed);
+
+  unsigned int durationUs = static_cast<unsigned int>(duration);
+  if(durationUs > maxDuration.load(boost::memory_order_relaxed))
+  {
+    maxDuration.store(durationUs, boost::memory_order_relaxed);
+  }
+
+  if(result != 0)
+  {
+    std::copy(backup.begin(), backup.end(), commands);
+    failures.fetch_add(1, boost::memory_order_relaxed);
+    isEnabled.store(false, boost::memory_order_relaxed);
+    return false;
+  }
+
+  // a step cannot be interrupted, a plugin that keeps overrunning is disabled instead
+  if(durationUs > budgetUs)
+  {
+    overruns.fetch_add(1, boost::memory_order_relaxed);
+    if(++consecutiveOverruns >= maxConsecutiveOverruns)
+    {
+      isEnabled.store(false, boost::memory_order_relaxed);
+    }
+  }
+  else
+  {
+    consecutiveOverruns = 0;
+  }
+  return true;
+}
+
+void ControllerPlugin::setParameter(const std::string & name, float value)
+{
+  if(name.size() >= sizeof(pendingParameters[0].name))
+  {
+    throw std::runtime_error("Parameter name " + name + " is too long");
+  }
+  boost::mutex::scoped_lock lock(parametersMutex);
+  if(numPendingParameters == maxPendingParameters)
+  {
+    throw std::runtime_error("Too many pending parameters for " + pluginName);
+  }
+  Parameter & parameter = pendingParameters[numPendingParameters++];
+  std::strcpy(parameter.name, name.c_str());
+  parameter.value = value;
+}
+
+void ControllerPlugin::applyParameter(const char * name, float value)
+{
+  if(!plugin->set_parameter || plugin->set_parameter(state, name, value) != 0)
+  {
+    refusedParameters.fetch_add(1, boost::memory_order_relaxed);
+  }
+}
+
+} // namespace mc_naoqi_dcm
@@ -0,0 +1,105 @@
+#include "DCMClock.h"
+
+#include <cmath>
+#include <time.h>
+
+namespace mc_naoqi_dcm
+{
+namespace
+{
+// DCM time is in ms, host time in us
+const double nominalRate = 1e-3;
+// maximum accepted drift of the DCM clock (relative)
+const double maxDrift = 1e-3;
+// synchronisation points closer than this to the first one do not update the drift
+const long long minDriftBaselineUs = 10000000LL;
+} // namespace
+
+DCMClock::DCMClock() : sequence(0), calibrated(false), anchorHost(0), anchorDcm(0.0)
+{
+  model.hostRef = 0;
+  model.dcmRef = 0.0;
+  model.rate = nominalRate;
+}
+
+long long DCMClock::hostTime()
+{
+  // served from the vDSO, no system call
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+void DCMClock::synchronise(long long hostTimeUs, double dcmTimeMs)
+{
+  Model updated = model;
+  if(!calibrated)
+  {
+    anchorHost = hostTimeUs;
+    anchorDcm = dcmTimeMs;
+  }
+  else if(hostTimeUs - anchorHost > minDriftBaselineUs)
+  {
+    double estimatedRate = (dcmTimeMs - anchorDcm) / static_cast<double>(hostTimeUs - anchorHost);
+    if(std::fabs(estimatedRate / nominalRate - 1.0) < maxDrift)
+    {
+      updated.rate = estimatedRate;
+    }
+  }
+  updated.hostRef = hostTimeUs;
+  updated.dcmRef = dcmTimeMs;
+
+  unsigned int s = sequence.load(boost::memory_order_relaxed);
+  sequence.store(s + 1, boost::memory_order_relaxed);
+  boost::atomic_thread_fence(boost::memory_order_release);
+  model = updated;
+  sequence.store(s + 2, boost::memory_order_release);
+  calibrated = true;
+}
+
+bool DCMClock::isCalibrated() const
+{
+  return sequence.load(boost::memory_order_acquire) != 0;
+}
+
+DCMClock::Model DCMClock::read() const
+{
+  while(true)
+  {
+    unsigned int before = sequence.load(boost::memory_order_acquire);
+    if(before & 1)
+    {
+      continue;
+    }
+    Model copy = model;
+    boost::atomic_thread_fence(boost::memory_order_acquire);
+    if(sequence.load(boost::memory_order_relaxed) == before)
+    {
+      return copy;
+    }
+  }
+}
+
+int DCMClock::now() const
+{
+  return toDcmTime(hostTime());
+}
+
+int DCMClock::toDcmTime(long long hostTimeUs) const
+{
+  Model m = read();
+  return static_cast<int>(std::floor(m.dcmRef + m.rate * static_cast<double>(hostTimeUs - m.hostRef) + 0.5));
+}
+
+long long DCMClock::toHostTime(int dcmTimeMs) const
+{
+  Model m = read();
+  return m.hostRef + static_cast<long long>(std::floor((dcmTimeMs - m.dcmRef) / m.rate + 0.5));
+}
+
+double DCMClock::rate() const
+{
+  return read().rate;
+}
+
+} // namespace mc_naoqi_dcm
@@ -0,0 +1,337 @@
+#include "FlightRecorder.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <stdint.h>
+
+namespace mc_naoqi_dcm
+{
+namespace
+{
+bool littleEndianHost()
+{
+  const uint32_t one = 1;
+  return *reinterpret_cast<const unsigned char *>(&one) == 1;
+}
+
+uint32_t swapBytes(uint32_t value)
+{
+  return (value >> 24) | ((value >> 8) & 0xff00) | ((value << 8) & 0xff0000) | (value << 24);
+}
+
+void writeBytes(std::FILE * file, const void * data, size_t size)
+{
+  if(size != 0 && std::fwrite(data, size, 1, file) != 1)
+  {
+    throw std::runtime_error("FlightRecorder: write failed");
+  }
+}
+
+// 32-bit values (uint32, int32 and float), written little-endian whatever the host
+void writeWords(std::FILE * file, const void * data, size_t count)
+{
+  if(littleEndianHost() || count == 0)
+  {
+    writeBytes(file, data, count * sizeof(uint32_t));
+    return;
+  }
+  std::vector<uint32_t> words(count);
+  std::memcpy(&words[0], data, count * sizeof(uint32_t));
+  for(size_t i = 0; i < count; i++)
+  {
+    words[i] = swapBytes(words[i]);
+  }
+  writeBytes(file, &words[0], count * sizeof(uint32_t));
+}
+
+void writeUint32(std::FILE * file, uint32_t value)
+{
+  writeWords(file, &value, 1);
+}
+
+void writeNames(std::FILE * file, const std::vector<std::string> & names)
+{
+  for(size_t i = 0; i < names.size(); i++)
+  {
+    writeUint32(file, names[i].size());
+    writeBytes(file, names[i].data(), names[i].size());
+  }
+}
+
+void readBytes(std::FILE * file, void * data, size_t size)
+{
+  if(size != 0 && std::fread(data, size, 1, file) != 1)
+  {
+    throw std::runtime_error("FlightRecorder: truncated file");
+  }
+}
+
+void readWords(std::FILE * file, void * data, size_t count)
+{
+  readBytes(file, data, count * sizeof(uint32_t));
+  if(littleEndianHost())
+  {
+    return;
+  }
+  unsigned char * bytes = static_cast<unsigned char *>(data);
+  for(size_t i = 0; i < count; i++)
+  {
+    uint32_t word;
+    std::memcpy(&word, bytes + i * sizeof(word), sizeof(word));
+    word = swapBytes(word);
+    std::memcpy(bytes + i * sizeof(word), &word, sizeof(word));
+  }
+}
+
+uint32_t readUint32(std::FILE * file)
+{
+  uint32_t value;
+  readWords(file, &value, 1);
+  return value;
+}
+
+// Bytes left after the read position, the sizes read from a file are checked
+// against it before anything is allocated
+unsigned long long remainingBytes(std::FILE * file, long fileSize)
+{
+  long position = std::ftell(file);
+  return position < 0 || position > fileSize ? 0 : fileSize - position;
+}
+
+void readNames(std::FILE * file, long fileSize, unsigned int count, std::vector<std::string> & names)
+{
+  // each name takes at least its length
+  if(static_cast<unsigned long long>(count) * sizeof(uint32_t) > remainingBytes(file, fileSize))
+  {
+    throw std::runtime_error("FlightRecorder: truncated file");
+  }
+  names.resize(count);
+  for(unsigned int i = 0; i < count; i++)
+  {
+    uint32_t length = readUint32(file);
+    if(length > remainingBytes(file, fileSize))
+    {
+      throw std::runtime_error("FlightRecorder: truncated file");
+    }
+    std::vector<char> name(length);
+    if(!name.empty())
+    {
+      readBytes(file, &name[0], name.size());
+    }
+    names[i].assign(name.begin(), name.end());
+  }
+}
+
+// closes the file on every exit path of dump() and load()
+struct FileCloser
+{
+  explicit FileCloser(std::FILE * f) : file(f) {}
+  ~FileCloser()
+  {
+    if(file)
+    {
+      std::fclose(file);
+    }
+  }
+  std::FILE * file;
+};
+} // namespace
+
+FlightRecorder::FlightRecorder() : numSlots(0), joints(0), wheels(0), sensors(0), written(0) {}
+
+void FlightRecorder::resize(unsigned int numRecords,
+                            unsigned int numJoints,
+                            unsigned int numWheels,
+                            unsigned int numSensors)
+{
+  numSlots = numRecords;
+  joints = numJoints;
+  wheels = numWheels;
+  sensors = numSensors;
+  sequences.reset(new boost::atomic<unsigned int>[numSlots]);
+  dcmTimes.reset(new int[numSlots]);
+  cycles.reset(new unsigned int[numSlots]);
+  values.reset(new float[numSlots * recordSize()]);
+  for(unsigned int i = 0; i < numSlots; i++)
+  {
+    sequences[i].store(0, boost::memory_order_relaxed);
+  }
+  written.store(0, boost::memory_order_release);
+}
+
+void FlightRecorder::record(int dcmTime,
+                            unsigned int cycle,
+                            const std::vector<float> & jointPositions,
+                            const std::vector<float> & jointStiffness,
+                            const std::vector<float> & wheelSpeeds,
+                            const std::vector<float> & sensorValues)
+{
+  if(numSlots == 0)
+  {
+    return;
+  }
+  unsigned int index = written.load(boost::memory_order_relaxed);
+  unsigned int slot = index % numSlots;
+
+  // odd sequence: write in progress
+  unsigned int sequence = sequences[slot].load(boost::memory_order_relaxed);
+  sequences[slot].store(sequence + 1, boost::memory_order_relaxed);
+  boost::atomic_thread_fence(boost::memory_order_release);
+
+  dcmTimes[slot] = dcmTime;
+  cycles[slot] = cycle;
+  float * out = &values[slot * recordSize()];
+  out = std::copy(jointPositions.begin(), jointPositions.begin() + joints, out);
+  out = std::copy(jointStiffness.begin(), jointStiffness.begin() + joints, out);
+  out = std::copy(wheelSpeeds.begin(), wheelSpeeds.begin() + wheels, out);
+  std::copy(sensorValues.begin(), sensorValues.begin() + sensors, out);
+
+  sequences[slot].store(sequence + 2, boost::memory_order_release);
+  written.store(index + 1, boost::memory_order_release);
+}
+
+unsigned int FlightRecorder::dump(const std::string & path,
+                                  unsigned int dcmPeriodUs,
+                                  const std::vector<std::string> & jointNames,
+                                  const std::vector<std::string> & wheelNames,
+                                  const std::vector<std::string> & sensorNames) const
+{
+  if(jointNames.size() != joints || wheelNames.size() != wheels || sensorNames.size() != sensors)
+  {
+    throw std::runtime_error("FlightRecorder: names do not match the recorded values");
+  }
+
+  // copy the records first, the header holds their number
+  unsigned int end = written.load(boost::memory_order_acquire);
+  unsigned int begin = end > numSlots ? end - numSlots : 0;
+  std::vector<int32_t> recordTimes;
+  std::vector<uint32_t> recordCycles;
+  std::vector<float> recordValues;
+  recordTimes.reserve(end - begin);
+  recordCycles.reserve(end - begin);
+  recordValues.reserve((end - begin) * recordSize());
+  for(unsigned int index = begin; index != end; index++)
+  {
+    unsigned int slot = index % numSlots;
+    unsigned int before = sequences[slot].load(boost::memory_order_acquire);
+    // each write of a slot adds 2 to its sequence: any other value means the
+    // slot is being written or already holds a newer cycle
+    if(before != 2 * (index / numSlots + 1))
+    {
+      continue;
+    }
+    int dcmTime = dcmTimes[slot];
+    unsigned int cycle = cycles[slot];
+    size_t offset = recordValues.size();
+    recordValues.insert(recordValues.end(), &values[slot * recordSize()], &values[(slot + 1) * recordSize()]);
+    boost::atomic_thread_fence(boost::memory_order_acquire);
+    if(sequences[slot].load(boost::memory_order_relaxed) != before)
+    {
+      // overwritten by a newer cycle while copying
+      recordValues.resize(offset);
+      continue;
+    }
+    recordTimes.push_back(dcmTime);
+    recordCycles.push_back(cycle);
+  }
+
+  std::FILE * file = std::fopen(path.c_str(), "wb");
+  if(!file)
+  {
+    throw std::runtime_error("FlightRecorder: cannot open " + path);
+  }
+  FileCloser closer(file);
+
+  writeBytes(file, "MCFR", 4);
+  writeUint32(file, version);
+  writeUint32(file, dcmPeriodUs);
+  writeUint32(file, joints);
+  writeUint32(file, wheels);
+  writeUint32(file, sensors);
+  writeUint32(file, recordTimes.size());
+  writeNames(file, jointNames);
+  writeNames(file, wheelNames);
+  writeNames(file, sensorNames);
+  for(size_t i = 0; i < recordTimes.size(); i++)
+  {
+    writeWords(file, &recordTimes[i], 1);
+    writeWords(file, &recordCycles[i], 1);
+    writeWords(file, &recordValues[i * recordSize()], recordSize());
+  }
+  closer.file = 0;
+  if(std::fclose(file) != 0)
+  {
+    throw std::runtime_error("FlightRecorder: cannot write " + path);
+  }
+  return recordTimes.size();
+}
+
+void FlightRecorder::load(const std::string & path, FlightRecording & recording)
+{
+  std::FILE * file = std::fopen(path.c_str(), "rb");
+  if(!file)
+  {
+    throw std::runtime_error("FlightRecorder: cannot open " + path);
+  }
+  FileCloser closer(file);
+  long fileSize = -1;
+  if(std::fseek(file, 0, SEEK_END) == 0)
+  {
+    fileSize = std::ftell(file);
+  }
+  if(fileSize < 0 || std::fseek(file, 0, SEEK_SET) != 0)
+  {
+    throw std::runtime_error("FlightRecorder: cannot read " + path);
+  }
+
+  char magic[4];
+  readBytes(file, magic, 4);
+  if(std::string(magic, 4) != "MCFR")
+  {
+    throw std::runtime_error("FlightRecorder: " + path + " is not a flight recorder dump");
+  }
+  if(readUint32(file) != version)
+  {
+    throw std::runtime_error("FlightRecorder: unsupported version in " + path);
+  }
+  recording.dcmPeriodUs = readUint32(file);
+  unsigned int numJoints = readUint32(file);
+  unsigned int numWheels = readUint32(file);
+  unsigned int numSensors = readUint32(file);
+  unsigned int numRecords = readUint32(file);
+  readNames(file, fileSize, numJoints, recording.jointNames);
+  readNames(file, fileSize, numWheels, recording.wheelNames);
+  readNames(file, fileSize, numSensors, recording.sensorNames);
+  // the records fill the rest of the file
+  unsigned long long recordBytes =
+      2 * sizeof(uint32_t) + (2ULL * numJoints + numWheels + numSensors) * sizeof(float);
+  if(recordBytes * numRecords != remainingBytes(file, fileSize))
+  {
+    throw std::runtime_error("FlightRecorder: the size of " + path + " does not match its header");
+  }
+
+  // commands are skipped, they are produced again by the replay
+  std::vector<float> commands(2 * numJoints + numWheels);
+  recording.dcmTimes.resize(numRecords);
+  recording.cycles.resize(numRecords);
+  recording.sensors.assign(numRecords, std::vector<float>(numSensors));
+  for(unsigned int i = 0; i < numRecords; i++)
+  {
+    int32_t dcmTime;
+    readWords(file, &dcmTime, 1);
+    recording.dcmTimes[i] = dcmTime;
+    recording.cycles[i] = readUint32(file);
+    if(!commands.empty())
+    {
+      readWords(file, &commands[0], commands.size());
+    }
+    if(numSensors != 0)
+    {
+      readWords(file, &recording.sensors[i][0], numSensors);
+    }
+  }
+}
+
+} // namespace mc_naoqi_dcm
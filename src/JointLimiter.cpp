@@ -0,0 +1,99 @@
+#include "JointLimiter.h"
+
+#include <algorithm>
+
+namespace mc_naoqi_dcm
+{
+
+namespace
+{
+// Distinct arrays: without __restrict__ the alias checks prevent the vectorisation.
+// Selects only, compiled to compare/blend/min/max instructions.
+unsigned int limit(size_t n,
+                   const float * __restrict__ target,
+                   const float * __restrict__ lower,
+                   const float * __restrict__ upper,
+                   const float * __restrict__ step,
+                   float * __restrict__ last,
+                   float * __restrict__ command,
+                   unsigned int * __restrict__ violations)
+{
+  unsigned int any = 0;
+  for(size_t i = 0; i < n; i++)
+  {
+    float value = target[i];
+    const float prev = last[i];
+    unsigned int isNaN = value != value;
+    value = isNaN ? prev : value;
+    float clamped = std::min(std::max(value, lower[i]), upper[i]);
+    float delta = clamped - prev;
+    float limitedDelta = std::min(std::max(delta, -step[i]), step[i]);
+    unsigned int isStep = limitedDelta != delta;
+    // prev + (clamped - prev) may round, the clamped value is kept when in range
+    float result = isStep ? prev + limitedDelta : clamped;
+    command[i] = result;
+    last[i] = result;
+    unsigned int v = isNaN | (static_cast<unsigned int>(clamped != value) << JointLimiter::ViolationPosition)
+                     | (isStep << JointLimiter::ViolationStep);
+    violations[i] = v;
+    any |= v;
+  }
+  return any;
+}
+} // namespace
+
+JointLimiter::JointLimiter() {}
+
+void JointLimiter::reset(const std::vector<float> & lower,
+                         const std::vector<float> & upper,
+                         const std::vector<float> & maxVelocity,
+                         unsigned int periodUs,
+                         const std::vector<float> & initial)
+{
+  lowerLimits = lower;
+  upperLimits = upper;
+  maxStep.resize(maxVelocity.size());
+  for(size_t i = 0; i < maxVelocity.size(); i++)
+  {
+    maxStep[i] = maxVelocity[i] * static_cast<float>(periodUs) * 1e-6f;
+  }
+  previous = initial;
+  flags.assign(initial.size(), 0);
+  counts.reset(new boost::atomic<unsigned int>[initial.size() * ViolationCount]);
+  resetCounters();
+}
+
+void JointLimiter::hold(const float * command)
+{
+  std::copy(command, command + previous.size(), previous.begin());
+}
+
+bool JointLimiter::apply(const float * target, float * command)
+{
+  if(!limit(previous.size(), target, &lowerLimits[0], &upperLimits[0], &maxStep[0], &previous[0], command, &flags[0]))
+  {
+    return true;
+  }
+
+  for(size_t i = 0; i < previous.size(); i++)
+  {
+    for(unsigned int k = 0; k < ViolationCount; k++)
+    {
+      if(flags[i] & (1U << k))
+      {
+        counts[i * ViolationCount + k].fetch_add(1, boost::memory_order_relaxed);
+      }
+    }
+  }
+  return false;
+}
+
+void JointLimiter::resetCounters()
+{
+  for(size_t i = 0; i < previous.size() * ViolationCount; i++)
+  {
+    counts[i].store(0, boost::memory_order_relaxed);
+  }
+}
+
+} // namespace mc_naoqi_dcm
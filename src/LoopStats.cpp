@@ -0,0 +1,88 @@
+#include "LoopStats.h"
+
+namespace mc_naoqi_dcm
+{
+
+Histogram::Histogram(unsigned int bucketWidthUs, unsigned int numBuckets)
+: width(bucketWidthUs), size(numBuckets), counts(new boost::atomic<unsigned int>[numBuckets]), maxValue(0)
+{
+  reset();
+}
+
+void Histogram::record(long long valueUs)
+{
+  if(valueUs < 0)
+  {
+    valueUs = 0;
+  }
+  unsigned long long bucket = static_cast<unsigned long long>(valueUs) / width;
+  if(bucket >= size)
+  {
+    bucket = size - 1;
+  }
+  counts[bucket].fetch_add(1, boost::memory_order_relaxed);
+  unsigned int value = valueUs > 0xffffffffLL ? 0xffffffffU : static_cast<unsigned int>(valueUs);
+  if(value > maxValue.load(boost::memory_order_relaxed))
+  {
+    maxValue.store(value, boost::memory_order_relaxed);
+  }
+}
+
+void Histogram::reset()
+{
+  for(unsigned int i = 0; i < size; i++)
+  {
+    counts[i].store(0, boost::memory_order_relaxed);
+  }
+  maxValue.store(0, boost::memory_order_relaxed);
+}
+
+LoopStats::LoopStats(unsigned int periodUs, unsigned int budgetUs)
+// callback duration up to 5ms, period up to 40ms, command age up to 100ms
+: duration(50, 100), period(100, 400), commandAge(1000, 100), ticks(0), overruns(0), lateTicks(0),
+  missedUpdates(0), nominalPeriod(periodUs), budget(budgetUs), lastStart(0)
+{
+}
+
+void LoopStats::recordTick(long long startUs, long long endUs, unsigned int commandTimeUs, bool newCommand)
+{
+  ticks.fetch_add(1, boost::memory_order_relaxed);
+
+  long long callbackDuration = endUs - startUs;
+  duration.record(callbackDuration);
+  if(callbackDuration > budget)
+  {
+    overruns.fetch_add(1, boost::memory_order_relaxed);
+  }
+
+  if(lastStart != 0)
+  {
+    long long tickPeriod = startUs - lastStart;
+    period.record(tickPeriod);
+    if(2 * tickPeriod > 3 * static_cast<long long>(nominalPeriod))
+    {
+      lateTicks.fetch_add(1, boost::memory_order_relaxed);
+    }
+  }
+  lastStart = startUs;
+
+  // unsigned difference of truncated times stays valid across wrap-around
+  commandAge.record(static_cast<unsigned int>(startUs) - commandTimeUs);
+  if(!newCommand)
+  {
+    missedUpdates.fetch_add(1, boost::memory_order_relaxed);
+  }
+}
+
+void LoopStats::reset()
+{
+  duration.reset();
+  period.reset();
+  commandAge.reset();
+  ticks.store(0, boost::memory_order_relaxed);
+  overruns.store(0, boost::memory_order_relaxed);
+  lateTicks.store(0, boost::memory_order_relaxed);
+  missedUpdates.store(0, boost::memory_order_relaxed);
+}
+
+} // namespace mc_naoqi_dcm
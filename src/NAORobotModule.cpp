@@ -36,6 +36,24 @@ NAORobotModule::NAORobotModule()
   actuators.push_back("RShoulderRoll");
   actuators.push_back("RWristYaw");
 
+  // joint position limits (rad), from the NAO H25 V5 documentation
+  const float lowerLimits[] = {-0.6720f, -2.0857f, -1.189516f, -0.397880f, -1.5446f, -2.0857f, 0.0f,
+                               -1.535889f, -0.379472f, -1.145303f, -0.092346f, -2.0857f, -0.3142f, -1.8238f,
+                               -1.186448f, -0.768992f, 0.0349f, -2.0857f, 0.0f, -1.535889f, -0.790477f,
+                               -0.103083f, -2.0857f, -1.3265f, -1.8238f};
+  const float upperLimits[] = {0.5149f, 2.0857f, 0.922747f, 0.769001f, -0.0349f, 2.0857f, 1.0f,
+                               0.484090f, 0.790477f, 0.740810f, 2.112528f, 2.0857f, 1.3265f, 1.8238f,
+                               0.932056f, 0.397935f, 1.5446f, 2.0857f, 1.0f, 0.484090f, 0.379472f,
+                               2.120198f, 2.0857f, 0.3142f, 1.8238f};
+  actuatorLowerLimits.assign(lowerLimits, lowerLimits + actuators.size());
+  actuatorUpperLimits.assign(upperLimits, upperLimits + actuators.size());
+  // joint velocity limits (rad/s), from the same documentation
+  const float velocityLimits[] = {7.19235f, 8.26818f, 6.40239f, 4.16174f, 7.19235f, 8.26818f, 8.33f,
+                                  6.40239f, 4.16174f, 4.16174f, 6.40239f, 8.26818f, 7.19235f, 24.6229f,
+                                  6.40239f, 4.16174f, 7.19235f, 8.26818f, 8.33f, 6.40239f, 4.16174f,
+                                  6.40239f, 8.26818f, 7.19235f, 24.6229f};
+  actuatorVelocityLimits.assign(velocityLimits, velocityLimits + actuators.size());
+
   // generate memory keys for sending commands to the joints (position/stiffness)
   genMemoryKeys("", actuators, "/Position/Actuator/Value", setActuatorKeys);
   genMemoryKeys("", actuators, "/Hardness/Actuator/Value", setHardnessKeys);
@@ -64,6 +82,20 @@ NAORobotModule::NAORobotModule()
   genMemoryKeys("LFoot/", bumpers, "/Sensor/Value", readSensorKeys, true, "LFoot");
   genMemoryKeys("RFoot/", bumpers, "/Sensor/Value", readSensorKeys, true, "RFoot");
 
+  // joint temperatures change slowly, read them every 50 cycles (0.6s)
+  SensorTier temperatures;
+  temperatures.name = "temperatures";
+  temperatures.decimation = 50;
+  genTierMemoryKeys(temperatures, "", actuators, "/Temperature/Sensor/Value", "Temperature");
+  sensorTiers.push_back(temperatures);
+
+  // motor status, from 0 (normal) to 3 (stiffness cut by the overheat protection), as slow as the temperatures
+  SensorTier motorStatus;
+  motorStatus.name = "motorStatus";
+  motorStatus.decimation = 50;
+  genTierMemoryKeys(motorStatus, "", actuators, "/Temperature/Sensor/Status", "Status");
+  sensorTiers.push_back(motorStatus);
+
   // led groups
   rgbLedGroup eyesLeds;
   eyesLeds.groupName = "eyesLeds";
@@ -25,6 +25,19 @@ PepperRobotModule::PepperRobotModule() : RobotModule()
   actuators.push_back("RWristYaw");
   actuators.push_back("RHand");
 
+  // joint position limits (rad), from the Pepper documentation
+  const float lowerLimits[] = {-0.5149f, -1.0385f, -0.5149f, -2.0857f, -0.7068f, -2.0857f, 0.0087f, -2.0857f, -1.5620f,
+                               -1.8239f, 0.0f, -2.0857f, -1.5620f, -2.0857f, 0.0087f, -1.8239f, 0.0f};
+  const float upperLimits[] = {0.5149f, 1.0385f, 0.5149f, 2.0857f, 0.6371f, 2.0857f, 1.5620f, 2.0857f, -0.0087f,
+                               1.8239f, 1.0f, 2.0857f, -0.0087f, 2.0857f, 1.5620f, 1.8239f, 1.0f};
+  actuatorLowerLimits.assign(lowerLimits, lowerLimits + actuators.size());
+  actuatorUpperLimits.assign(upperLimits, upperLimits + actuators.size());
+  // joint velocity limits (rad/s), from the same documentation
+  const float velocityLimits[] = {2.93276f, 2.93276f, 2.27032f, 7.33998f, 9.22756f, 7.33998f, 9.22756f, 7.33998f,
+                                  9.22756f, 17.3835f, 2.27032f, 7.33998f, 9.22756f, 7.33998f, 9.22756f, 17.3835f,
+                                  2.27032f};
+  actuatorVelocityLimits.assign(velocityLimits, velocityLimits + actuators.size());
+
   // generate memory keys for sending commands to the joints (position/stiffness)
   genMemoryKeys("", actuators, "/Position/Actuator/Value", setActuatorKeys);
   genMemoryKeys("", actuators, "/Hardness/Actuator/Value", setHardnessKeys);
@@ -62,6 +75,20 @@ PepperRobotModule::PepperRobotModule() : RobotModule()
   tactile.push_back("LHand/Touch/Back");
   genMemoryKeys("", tactile, "/Sensor/Value", readSensorKeys, true);
 
+  // joint temperatures change slowly, read them every 50 cycles (0.6s)
+  SensorTier temperatures;
+  temperatures.name = "temperatures";
+  temperatures.decimation = 50;
+  genTierMemoryKeys(temperatures, "", actuators, "/Temperature/Sensor/Value", "Temperature");
+  sensorTiers.push_back(temperatures);
+
+  // motor status, from 0 (normal) to 3 (stiffness cut by the overheat protection), as slow as the temperatures
+  SensorTier motorStatus;
+  motorStatus.name = "motorStatus";
+  motorStatus.decimation = 50;
+  genTierMemoryKeys(motorStatus, "", actuators, "/Temperature/Sensor/Status", "Status");
+  sensorTiers.push_back(motorStatus);
+
   // led groups
   rgbLedGroup eyesCenter;
   eyesCenter.groupName = "eyesCenter";
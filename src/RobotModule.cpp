@@ -3,7 +3,7 @@
 namespace mc_naoqi_dcm
 {
 
-RobotModule::RobotModule()
+RobotModule::RobotModule() : dcmPeriod(defaultDcmPeriod)
 {
   imu.push_back("AccelerometerX");
   imu.push_back("AccelerometerY");
@@ -14,6 +14,25 @@ RobotModule::RobotModule()
   imu.push_back("AngleX");
   imu.push_back("AngleY");
   imu.push_back("AngleZ");
+
+  // battery status, common to all robots
+  SensorTier battery;
+  battery.name = "battery";
+  battery.decimation = 100;
+  std::vector<std::string> batterySensors;
+  batterySensors.push_back("Charge");
+  batterySensors.push_back("Current");
+  batterySensors.push_back("Temperature");
+  genTierMemoryKeys(battery, "Battery/", batterySensors, "/Sensor/Value", "Battery");
+  sensorTiers.push_back(battery);
+
+  // error code of the chest board, which relays the motor boards, common to all robots
+  SensorTier boards;
+  boards.name = "boards";
+  boards.decimation = 100;
+  boards.readSensorKeys.push_back("Device/DeviceList/ChestBoard/Error");
+  boards.sensors.push_back("ChestBoardError");
+  sensorTiers.push_back(boards);
 }
 
 // Function to create various memory key groups
@@ -36,4 +55,17 @@ void RobotModule::genMemoryKeys(std::string prefix,
   }
 }
 
+void RobotModule::genTierMemoryKeys(SensorTier & tier,
+                                    std::string prefix,
+                                    std::vector<std::string> & devices,
+                                    std::string postfix,
+                                    std::string sensor_prefix)
+{
+  for(unsigned i = 0; i < devices.size(); i++)
+  {
+    tier.readSensorKeys.push_back("Device/SubDeviceList/" + prefix + devices[i] + postfix);
+    tier.sensors.push_back(sensor_prefix + devices[i]);
+  }
+}
+
 } // namespace mc_naoqi_dcm
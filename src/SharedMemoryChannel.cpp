@@ -0,0 +1,310 @@
+#include "SharedMemoryChannel.h"
+
+#include <boost/static_assert.hpp>
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <new>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "RobotModule.h"
+
+// The doorbell is used directly as a futex word
+BOOST_STATIC_ASSERT(sizeof(boost::atomic<uint32_t>) == sizeof(uint32_t));
+
+namespace mc_naoqi_dcm
+{
+namespace
+{
+
+std::string systemError(const std::string & what)
+{
+  return what + ": " + std::strerror(errno);
+}
+
+int futex(const boost::atomic<uint32_t> & word, int op, uint32_t value, const struct timespec * timeout)
+{
+  return syscall(SYS_futex, reinterpret_cast<const uint32_t *>(&word), op, value, timeout, NULL, 0);
+}
+
+template<unsigned N>
+void writeBlock(shm::CommandBlock<N> & block, const float * values, unsigned size)
+{
+  uint32_t sequence = block.sequence.load(boost::memory_order_relaxed);
+  // odd sequence: write in progress
+  block.sequence.store(sequence + 1, boost::memory_order_relaxed);
+  boost::atomic_thread_fence(boost::memory_order_release);
+  std::memcpy(block.values, values, size * sizeof(float));
+  block.sequence.store(sequence + 2, boost::memory_order_release);
+}
+
+template<unsigned N>
+bool tryReadBlock(const shm::CommandBlock<N> & block, float * values, unsigned size, uint32_t & lastSequence)
+{
+  uint32_t before = block.sequence.load(boost::memory_order_acquire);
+  if((before & 1) || before == lastSequence)
+  {
+    return false;
+  }
+  std::memcpy(values, block.values, size * sizeof(float));
+  boost::atomic_thread_fence(boost::memory_order_acquire);
+  if(block.sequence.load(boost::memory_order_relaxed) != before)
+  {
+    return false;
+  }
+  lastSequence = before;
+  return true;
+}
+
+} // namespace
+
+shm::Layout::Layout()
+: magic(0), version(0), numActuators(0), numWheels(0), numSensors(0), doorbell(0), waiters(0)
+{
+  jointPositions.sequence.store(0);
+  jointStiffness.sequence.store(0);
+  wheelSpeeds.sequence.store(0);
+  sensors.sequence.store(0);
+  sensors.cycle = 0;
+  sensors.dcmTime = 0;
+}
+
+SharedMemoryChannel::SharedMemoryChannel() : layout(0), owner(false) {}
+
+SharedMemoryChannel::~SharedMemoryChannel()
+{
+  close();
+}
+
+void SharedMemoryChannel::create(const std::string & name,
+                                 unsigned numActuators,
+                                 unsigned numWheels,
+                                 unsigned numSensors)
+{
+  if(numActuators > shm::maxActuators || numWheels > shm::maxWheels || numSensors > shm::maxSensors)
+  {
+    throw std::runtime_error("Shared memory channel too small for " + to_string(numActuators) + " actuators, "
+                             + to_string(numWheels) + " wheels and " + to_string(numSensors) + " sensors");
+  }
+  close();
+
+  int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+  if(fd < 0)
+  {
+    throw std::runtime_error(systemError("shm_open(" + name + ")"));
+  }
+  if(ftruncate(fd, sizeof(shm::Layout)) < 0)
+  {
+    std::string error = systemError("ftruncate(" + name + ")");
+    ::close(fd);
+    shm_unlink(name.c_str());
+    throw std::runtime_error(error);
+  }
+  segmentName = name;
+  owner = true;
+  map(fd, true);
+
+  layout->numActuators = numActuators;
+  layout->numWheels = numWheels;
+  layout->numSensors = numSensors;
+  layout->version = shm::version;
+  // clients only accept the segment once the header is complete
+  boost::atomic_thread_fence(boost::memory_order_release);
+  layout->magic = shm::magic;
+}
+
+void SharedMemoryChannel::open(const std::string & name)
+{
+  close();
+
+  int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if(fd < 0)
+  {
+    throw std::runtime_error(systemError("shm_open(" + name + ")"));
+  }
+  struct stat status;
+  if(fstat(fd, &status) < 0 || status.st_size < static_cast<off_t>(sizeof(shm::Layout)))
+  {
+    ::close(fd);
+    throw std::runtime_error("Shared memory segment " + name + " is not a mc_naoqi_dcm channel");
+  }
+  segmentName = name;
+  owner = false;
+  map(fd, false);
+
+  boost::atomic_thread_fence(boost::memory_order_acquire);
+  if(layout->magic != shm::magic || layout->version != shm::version)
+  {
+    close();
+    throw std::runtime_error("Shared memory segment " + name + " has an incompatible layout");
+  }
+}
+
+void SharedMemoryChannel::map(int fd, bool initialise)
+{
+  void * address = mmap(NULL, sizeof(shm::Layout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if(address == MAP_FAILED)
+  {
+    std::string error = systemError("mmap(" + segmentName + ")");
+    if(owner)
+    {
+      shm_unlink(segmentName.c_str());
+    }
+    throw std::runtime_error(error);
+  }
+  if(initialise)
+  {
+    layout = new(address) shm::Layout();
+  }
+  else
+  {
+    layout = static_cast<shm::Layout *>(address);
+  }
+}
+
+void SharedMemoryChannel::close()
+{
+  if(!layout)
+  {
+    return;
+  }
+  munmap(layout, sizeof(shm::Layout));
+  layout = 0;
+  if(owner)
+  {
+    shm_unlink(segmentName.c_str());
+    owner = false;
+  }
+}
+
+unsigned SharedMemoryChannel::numActuators() const
+{
+  return layout->numActuators;
+}
+
+unsigned SharedMemoryChannel::numWheels() const
+{
+  return layout->numWheels;
+}
+
+unsigned SharedMemoryChannel::numSensors() const
+{
+  return layout->numSensors;
+}
+
+void SharedMemoryChannel::writeJointPositions(const float * values)
+{
+  writeBlock(layout->jointPositions, values, layout->numActuators);
+}
+
+void SharedMemoryChannel::writeJointStiffness(const float * values)
+{
+  writeBlock(layout->jointStiffness, values, layout->numActuators);
+}
+
+void SharedMemoryChannel::writeWheelSpeeds(const float * values)
+{
+  writeBlock(layout->wheelSpeeds, values, layout->numWheels);
+}
+
+bool SharedMemoryChannel::readJointPositions(float * values, uint32_t & lastSequence) const
+{
+  return tryReadBlock(layout->jointPositions, values, layout->numActuators, lastSequence);
+}
+
+bool SharedMemoryChannel::readJointStiffness(float * values, uint32_t & lastSequence) const
+{
+  return tryReadBlock(layout->jointStiffness, values, layout->numActuators, lastSequence);
+}
+
+bool SharedMemoryChannel::readWheelSpeeds(float * values, uint32_t & lastSequence) const
+{
+  return tryReadBlock(layout->wheelSpeeds, values, layout->numWheels, lastSequence);
+}
+
+void SharedMemoryChannel::writeSensors(const float * values, int dcmTime, uint32_t cycle)
+{
+  shm::SensorBlock & block = layout->sensors;
+  uint32_t sequence = block.sequence.load(boost::memory_order_relaxed);
+  block.sequence.store(sequence + 1, boost::memory_order_relaxed);
+  boost::atomic_thread_fence(boost::memory_order_release);
+  std::memcpy(block.values, values, layout->numSensors * sizeof(float));
+  block.cycle = cycle;
+  block.dcmTime = dcmTime;
+  block.sequence.store(sequence + 2, boost::memory_order_release);
+
+  // ring the doorbell, only enter the kernel if a client is actually sleeping
+  layout->doorbell.store(cycle, boost::memory_order_seq_cst);
+  if(layout->waiters.load(boost::memory_order_seq_cst) > 0)
+  {
+    futex(layout->doorbell, FUTEX_WAKE, INT_MAX, NULL);
+  }
+}
+
+bool SharedMemoryChannel::readSensors(float * values, int & dcmTime, uint32_t & cycle) const
+{
+  const shm::SensorBlock & block = layout->sensors;
+  while(true)
+  {
+    uint32_t before = block.sequence.load(boost::memory_order_acquire);
+    if(before == 0)
+    {
+      return false;
+    }
+    if(before & 1)
+    {
+      continue;
+    }
+    std::memcpy(values, block.values, layout->numSensors * sizeof(float));
+    dcmTime = block.dcmTime;
+    cycle = block.cycle;
+    boost::atomic_thread_fence(boost::memory_order_acquire);
+    if(block.sequence.load(boost::memory_order_relaxed) == before)
+    {
+      return true;
+    }
+  }
+}
+
+bool SharedMemoryChannel::waitForCycle(uint32_t lastCycle, int timeoutMs) const
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  long long deadline = now.tv_sec * 1000000000LL + now.tv_nsec + timeoutMs * 1000000LL;
+
+  bool newCycle = false;
+  layout->waiters.fetch_add(1, boost::memory_order_seq_cst);
+  while(true)
+  {
+    uint32_t cycle = layout->doorbell.load(boost::memory_order_seq_cst);
+    if(cycle != lastCycle)
+    {
+      newCycle = true;
+      break;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long remaining = deadline - (now.tv_sec * 1000000000LL + now.tv_nsec);
+    if(remaining <= 0)
+    {
+      break;
+    }
+    struct timespec timeout;
+    timeout.tv_sec = remaining / 1000000000LL;
+    timeout.tv_nsec = remaining % 1000000000LL;
+    // returns immediately if the doorbell changed since it was read
+    futex(layout->doorbell, FUTEX_WAIT, cycle, &timeout);
+  }
+  layout->waiters.fetch_sub(1, boost::memory_order_seq_cst);
+  return newCycle;
+}
+
+} // namespace mc_naoqi_dcm
@@ -0,0 +1,62 @@
+#include "StiffnessRamp.h"
+
+#include <algorithm>
+
+namespace mc_naoqi_dcm
+{
+
+StiffnessRamp::StiffnessRamp() : startTime(0), duration(0), running(false), pending(false) {}
+
+void StiffnessRamp::reset(const std::vector<float> & stiffness)
+{
+  current = stiffness;
+  from = stiffness;
+  to = stiffness;
+  running = false;
+  pending = false;
+}
+
+void StiffnessRamp::start(const std::vector<float> & target, int durationMs, int dcmTime)
+{
+  std::copy(target.begin(), target.end(), to.begin());
+  if(durationMs <= 0)
+  {
+    std::copy(to.begin(), to.end(), current.begin());
+    running = false;
+    pending = true;
+    return;
+  }
+  std::copy(current.begin(), current.end(), from.begin());
+  startTime = dcmTime;
+  duration = durationMs;
+  running = true;
+}
+
+bool StiffnessRamp::update(int dcmTime)
+{
+  if(!running)
+  {
+    bool changed = pending;
+    pending = false;
+    return changed;
+  }
+
+  float alpha = static_cast<float>(dcmTime - startTime) / static_cast<float>(duration);
+  if(alpha >= 1.0f)
+  {
+    std::copy(to.begin(), to.end(), current.begin());
+    running = false;
+  }
+  else
+  {
+    alpha = std::max(alpha, 0.0f);
+    for(size_t i = 0; i < current.size(); i++)
+    {
+      current[i] = from[i] + alpha * (to[i] - from[i]);
+    }
+  }
+  pending = false;
+  return true;
+}
+
+} // namespace mc_naoqi_dcm
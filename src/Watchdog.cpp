@@ -0,0 +1,87 @@
+#include "Watchdog.h"
+
+#include <algorithm>
+
+namespace mc_naoqi_dcm
+{
+
+Watchdog::Watchdog()
+: policyValue(Off), missedCyclesValue(10), durationMsValue(1000), trippedValue(false), tripsValue(0),
+  cyclesSinceCommandValue(0), maxCyclesSinceCommandValue(0)
+{
+}
+
+void Watchdog::configure(Policy policy, unsigned int missedCycles, unsigned int durationMs)
+{
+  missedCyclesValue.store(missedCycles, boost::memory_order_relaxed);
+  durationMsValue.store(durationMs, boost::memory_order_relaxed);
+  policyValue.store(policy, boost::memory_order_relaxed);
+}
+
+void Watchdog::reset(const std::vector<float> & command)
+{
+  lastCommand = command;
+  velocity.assign(command.size(), 0.0f);
+  restart();
+}
+
+void Watchdog::restart()
+{
+  std::fill(velocity.begin(), velocity.end(), 0.0f);
+  cyclesSinceCommandValue.store(0, boost::memory_order_relaxed);
+  trippedValue.store(false, boost::memory_order_relaxed);
+}
+
+bool Watchdog::update(bool newCommand, std::vector<float> & command)
+{
+  unsigned int cycles = cyclesSinceCommandValue.load(boost::memory_order_relaxed);
+  if(newCommand)
+  {
+    // commands may come slower than the DCM: velocity per DCM cycle
+    float interval = static_cast<float>(cycles + 1);
+    for(size_t i = 0; i < command.size(); i++)
+    {
+      velocity[i] = (command[i] - lastCommand[i]) / interval;
+      lastCommand[i] = command[i];
+    }
+    cyclesSinceCommandValue.store(0, boost::memory_order_relaxed);
+    trippedValue.store(false, boost::memory_order_relaxed);
+    return false;
+  }
+
+  cycles++;
+  cyclesSinceCommandValue.store(cycles, boost::memory_order_relaxed);
+  if(cycles > maxCyclesSinceCommandValue.load(boost::memory_order_relaxed))
+  {
+    maxCyclesSinceCommandValue.store(cycles, boost::memory_order_relaxed);
+  }
+
+  Policy currentPolicy = policy();
+  if(currentPolicy == Off || trippedValue.load(boost::memory_order_relaxed))
+  {
+    return false;
+  }
+  if(cycles > missedCycles())
+  {
+    // from now on the last command (possibly extrapolated) is held
+    trippedValue.store(true, boost::memory_order_relaxed);
+    tripsValue.fetch_add(1, boost::memory_order_relaxed);
+    return true;
+  }
+  if(currentPolicy == ExtrapolateHold)
+  {
+    for(size_t i = 0; i < command.size(); i++)
+    {
+      command[i] += velocity[i];
+    }
+  }
+  return false;
+}
+
+void Watchdog::resetCounters()
+{
+  tripsValue.store(0, boost::memory_order_relaxed);
+  maxCyclesSinceCommandValue.store(0, boost::memory_order_relaxed);
+}
+
+} // namespace mc_naoqi_dcm
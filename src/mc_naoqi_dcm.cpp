@@ -8,9 +8,16 @@
 #include <alcommon/almodule.h>
 #include <alcommon/alproxy.h>
 #include <alerror/alerror.h>
+#include <althread/alcriticalsection.h>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/static_assert.hpp>
 #include <algorithm>
+#include <climits>
+#include <linux/futex.h>
+#include <stdexcept>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 #include "NAORobotModule.h"
 #include "PepperRobotModule.h"
@@ -29,14 +36,54 @@
 
 #include <boost/bind.hpp>
 
+// publishedCycle is used directly as a futex word, as the doorbell of SharedMemoryChannel
+BOOST_STATIC_ASSERT(sizeof(boost::atomic<unsigned int>) == sizeof(unsigned int));
+
 namespace mc_naoqi_dcm
 {
+namespace
+{
+int futex(const boost::atomic<unsigned int> & word, int op, unsigned int value, const struct timespec * timeout)
+{
+  return syscall(SYS_futex, reinterpret_cast<const unsigned int *>(&word), op, value, timeout, NULL, 0);
+}
+
+// numbers coming from python may be either int or float
+float toFloat(const AL::ALValue & value)
+{
+  if(value.isInt())
+  {
+    return static_cast<float>(static_cast<const int &>(value));
+  }
+  return static_cast<const float &>(value);
+}
+} // namespace
+
+// bound to a const reference by boost::posix_time::milliseconds
+const int MCNAOqiDCM::clockSyncPeriodMs;
+
 MCNAOqiDCM::MCNAOqiDCM(boost::shared_ptr<AL::ALBroker> broker, const std::string & name)
 : AL::ALModule(broker, name),
-  fMemoryFastAccess(boost::shared_ptr<AL::ALMemoryFastAccess>(new AL::ALMemoryFastAccess())), preProcessConnected(false)
+  preProcessConnected(false), loopMutex(AL::ALMutex::createALMutex()),
+  fMemoryFastAccess(boost::shared_ptr<AL::ALMemoryFastAccess>(new AL::ALMemoryFastAccess())), dcmCycle(0),
+  publishedCycle(0), cycleWaiters(0), flightRecorderDumping(false), flightRecorderLastDump(0),
+  pluginsMutex(AL::ALMutex::createALMutex()), loopPluginTime(0), bumperReflexEnabled(false), bumperReflexLatched(false),
+  bumperReflexTrips(0), loopTrajectoryEnd(0), loopTrajectoryActive(false), loopVelocityActive(false),
+  loopVelocityExpires(false), loopVelocityExpiry(0), loopVelocityTime(0),
+  jointPositionCommandsMutex(AL::ALMutex::createALMutex()), wheelsStopped(false), wheelSpeedsSequence(0),
+  loopWheelSpeedsSequence(0), sensorProfilesMutex(AL::ALMutex::createALMutex()), sharedMemoryActive(false),
+  sharedMemoryMutex(AL::ALMutex::createALMutex()), sharedJointPositionsSequence(0), sharedJointStiffnessSequence(0),
+  sharedWheelSpeedsSequence(0), watchdogHoldEnd(0), loopStats(RobotModule::defaultDcmPeriod, callbackBudgetUs),
+  jointPositionCommandsTime(0), loopJointPositionsTime(0), ledsMutex(AL::ALMutex::createALMutex())
 {
   setModuleDescription("Module to communicate with mc_rtc_naoqi interface for whole-body control via mc_rtc framework");
 
+  for(int i = 0; i < LoopErrorCount; i++)
+  {
+    loopErrorCounts[i].store(0);
+  }
+  lastLoopError.store(LoopErrorNone);
+
   // Bind methods to make them accessible through proxies
   functionName("startLoop", getName(), "connect a callback to DCM loop");
   BIND_METHOD(MCNAOqiDCM::startLoop);
@@ -52,14 +99,50 @@ MCNAOqiDCM::MCNAOqiDCM(boost::shared_ptr<AL::ALBroker> broker, const std::string
   addParam("value", "new stiffness value from 0.0 to 1.0");
   BIND_METHOD(MCNAOqiDCM::setStiffness);
 
+  functionName("setJointStiffness", getName(), "change stiffness of every joint");
+  addParam("values", "new stiffness values from 0.0 to 1.0, in the order of getJointOrder");
+  BIND_METHOD(MCNAOqiDCM::setJointStiffness);
+
+  functionName("setJointStiffnessRamp", getName(), "ramp the stiffness of every joint to a target");
+  addParam("values", "target stiffness values from 0.0 to 1.0, in the order of getJointOrder");
+  addParam("durationMs", "duration of the ramp (ms)");
+  BIND_METHOD(MCNAOqiDCM::setJointStiffnessRamp);
+
   functionName("setJointAngles", getName(), "set joint angles");
   addParam("values", "new joint angles (in radian)");
   BIND_METHOD(MCNAOqiDCM::setJointAngles);
 
+  functionName("setJointTrajectory", getName(), "send a joint trajectory interpolated by the DCM");
+  addParam("timesMs", "time of each point relative to now (ms), strictly increasing");
+  addParam("points", "array of joint vectors (in radian) in the order of getJointOrder");
+  BIND_METHOD(MCNAOqiDCM::setJointTrajectory);
+
+  functionName("setJointVelocities", getName(), "move the joints at constant velocities");
+  addParam("velocities", "joint velocities (rad/s) in the order of getJointOrder");
+  addParam("expiryMs", "duration after which the joints stop without new velocity command, 0 for never");
+  BIND_METHOD(MCNAOqiDCM::setJointVelocities);
+
+  functionName("getJointLimitViolations", getName(), "get the commands modified by the joint limiter");
+  setReturn("violations", "[[jointName, nanCycles, positionCycles, velocityCycles], ...]");
+  BIND_METHOD(MCNAOqiDCM::getJointLimitViolations);
+
+  functionName("resetJointLimitViolations", getName(), "reset the joint limiter counters");
+  BIND_METHOD(MCNAOqiDCM::resetJointLimitViolations);
+
   functionName("getJointOrder", getName(), "get reference joint order");
   setReturn("joint order", "array containing names of all the joints");
   BIND_METHOD(MCNAOqiDCM::getJointOrder);
 
+  functionName("resolveJointGroup", getName(), "get a handle on a subset of the joints");
+  addParam("jointNames", "joint names from getJointOrder");
+  setReturn("handle", "joint group handle for setJointGroupAngles");
+  BIND_METHOD(MCNAOqiDCM::resolveJointGroup);
+
+  functionName("setJointGroupAngles", getName(), "set the joint angles of a joint group");
+  addParam("handle", "joint group handle from resolveJointGroup");
+  addParam("jointValues", "joint values in the order of the group");
+  BIND_METHOD(MCNAOqiDCM::setJointGroupAngles);
+
   functionName("getSensorsOrder", getName(), "get reference sensor order");
   setReturn("sensor names", "array containing names of all the sensors");
   BIND_METHOD(MCNAOqiDCM::getSensorsOrder);
@@ -84,6 +167,109 @@ MCNAOqiDCM::MCNAOqiDCM(boost::shared_ptr<AL::ALBroker> broker, const std::string
   setReturn("sensor values", "array containing values of all the sensors");
   BIND_METHOD(MCNAOqiDCM::getSensors);
 
+  functionName("registerSensorProfile", getName(), "register a subset of the sensors");
+  addParam("name", "profile name");
+  addParam("sensors", "sensor names from getSensorsOrder, or prefixes ending with '*'");
+  setReturn("id", "profile id for getSensorsProfile");
+  BIND_METHOD(MCNAOqiDCM::registerSensorProfile);
+
+  functionName("getSensorsProfileOrder", getName(), "get the sensor names of a profile");
+  addParam("id", "profile id from registerSensorProfile");
+  setReturn("sensor names", "sensor names in the order of getSensorsProfile");
+  BIND_METHOD(MCNAOqiDCM::getSensorsProfileOrder);
+
+  functionName("getSensorsProfile", getName(), "get the sensor values of a profile");
+  addParam("id", "profile id from registerSensorProfile");
+  setReturn("sensor values", "sensor values in the order of getSensorsProfileOrder");
+  BIND_METHOD(MCNAOqiDCM::getSensorsProfile);
+
+  functionName("getSensorTiers", getName(), "get the sensor tiers read at a lower rate");
+  setReturn("sensor tiers", "array of [name, decimation, [sensor names]]");
+  BIND_METHOD(MCNAOqiDCM::getSensorTiers);
+
+  functionName("getTierSensors", getName(), "get the latest values of a sensor tier");
+  addParam("tierName", "name of the tier from getSensorTiers");
+  setReturn("tier snapshot", "array [values, DCMtime, cycle]");
+  BIND_METHOD(MCNAOqiDCM::getTierSensors);
+
+  functionName("setJointAnglesAndGetSensors", getName(), "set joint angles and get all sensor values");
+  addParam("values", "new joint angles (in radian)");
+  setReturn("sensor snapshot", "array [sensor values, DCM time, DCM cycle counter]");
+  BIND_METHOD(MCNAOqiDCM::setJointAnglesAndGetSensors);
+
+  functionName("waitForNextCycle", getName(), "wait for the sensors of the next DCM cycle");
+  addParam("lastCycleId", "DCM cycle counter of the last snapshot received");
+  addParam("timeoutMs", "maximum waiting time (ms)");
+  setReturn("sensor snapshot", "array [sensor values, DCM time, DCM cycle counter]");
+  BIND_METHOD(MCNAOqiDCM::waitForNextCycle);
+
+  functionName("dcmTimeToHostTime", getName(), "convert a DCM time to the robot monotonic clock");
+  addParam("dcmTime", "DCM time (ms)");
+  setReturn("host time", "array [seconds, nanoseconds] of CLOCK_MONOTONIC");
+  BIND_METHOD(MCNAOqiDCM::dcmTimeToHostTime);
+
+  functionName("getLoopErrors", getName(), "get errors of the DCM callbacks");
+  setReturn("loop errors", "array [last error code, [count for each error code]]");
+  BIND_METHOD(MCNAOqiDCM::getLoopErrors);
+
+  functionName("resetLoopErrors", getName(), "reset error counters of the DCM callbacks");
+  BIND_METHOD(MCNAOqiDCM::resetLoopErrors);
+
+  functionName("dumpFlightRecorder", getName(), "write the last cycles of the loop to a file");
+  addParam("path", "file to write on the robot");
+  BIND_METHOD(MCNAOqiDCM::dumpFlightRecorder);
+
+  functionName("getFlightRecorderStatus", getName(), "get the flight recorder status");
+  setReturn("flight recorder status", "array [capacity, dumping, records written by the last dump or -1]");
+  BIND_METHOD(MCNAOqiDCM::getFlightRecorderStatus);
+
+  functionName("loadPlugin", getName(), "load a controller plugin run by the DCM loop");
+  addParam("name", "name of the plugin");
+  addParam("path", "shared library on the robot");
+  addParam("budgetUs", "overrun detection threshold of one step (us)");
+  BIND_METHOD(MCNAOqiDCM::loadPlugin);
+
+  functionName("unloadPlugin", getName(), "unload a controller plugin");
+  addParam("name", "name of the plugin");
+  BIND_METHOD(MCNAOqiDCM::unloadPlugin);
+
+  functionName("setPluginParameter", getName(), "set a parameter of a controller plugin");
+  addParam("name", "name of the plugin");
+  addParam("parameter", "name of the parameter");
+  addParam("value", "value of the parameter");
+  BIND_METHOD(MCNAOqiDCM::setPluginParameter);
+
+  functionName("setPluginEnabled", getName(), "enable or disable a controller plugin");
+  addParam("name", "name of the plugin");
+  addParam("enabled", "true to run the plugin in the loop");
+  BIND_METHOD(MCNAOqiDCM::setPluginEnabled);
+
+  functionName("getPlugins", getName(), "get the loaded controller plugins");
+  setReturn("plugins",
+            "array of [name, path, enabled, budgetUs, steps, overruns, failures, maxDurationUs, refusedParameters]");
+  BIND_METHOD(MCNAOqiDCM::getPlugins);
+
+  functionName("getLoopStats", getName(), "get timing statistics of the DCM callback");
+  setReturn("loop stats", "array of [name, value] pairs (histograms and counters)");
+  BIND_METHOD(MCNAOqiDCM::getLoopStats);
+
+  functionName("resetLoopStats", getName(), "reset timing statistics of the DCM callback");
+  BIND_METHOD(MCNAOqiDCM::resetLoopStats);
+
+  functionName("setWatchdog", getName(), "configure the command watchdog of the DCM loop");
+  addParam("policy", "0: off, 1: hold, 2: extrapolate then hold, 3: ramp stiffness to zero");
+  addParam("missedCycles", "number of DCM cycles without command before the watchdog trips");
+  addParam("durationMs", "hold horizon of policies 1 and 2, duration of the stiffness ramp of policy 3 (ms)");
+  BIND_METHOD(MCNAOqiDCM::setWatchdog);
+
+  functionName("getWatchdogStatus", getName(), "get the command watchdog configuration and status");
+  setReturn("watchdog status",
+            "array [policy, missedCycles, durationMs, tripped, trips, cyclesSinceCommand, maxCyclesSinceCommand]");
+  BIND_METHOD(MCNAOqiDCM::getWatchdogStatus);
+
+  functionName("resetWatchdogCounters", getName(), "reset the command watchdog counters");
+  BIND_METHOD(MCNAOqiDCM::resetWatchdogCounters);
+
   functionName("getRobotName", getName(), "get robot name");
   setReturn("robot name", "name of the robot for which module was built <pepper|nao>");
   BIND_METHOD(MCNAOqiDCM::getRobotName);
@@ -105,6 +291,42 @@ MCNAOqiDCM::MCNAOqiDCM(boost::shared_ptr<AL::ALBroker> broker, const std::string
   addParam("b", "blue intensity %");
   BIND_METHOD(MCNAOqiDCM::isetLeds);
 
+  functionName("resolveLedGroup", getName(), "get a handle on a led group");
+  addParam("ledGroupName", "Name of the leds group from robot module");
+  setReturn("handle", "led group handle for setLedsHandle and isetLedsHandle");
+  BIND_METHOD(MCNAOqiDCM::resolveLedGroup);
+
+  functionName("setLedsHandle", getName(), "setLeds on a led group handle");
+  addParam("handle", "led group handle from resolveLedGroup");
+  addParam("r", "red intensity %");
+  addParam("g", "green intensity %");
+  addParam("b", "blue intensity %");
+  BIND_METHOD(MCNAOqiDCM::setLedsHandle);
+
+  functionName("isetLedsHandle", getName(), "isetLeds on a led group handle");
+  addParam("handle", "led group handle from resolveLedGroup");
+  addParam("intensity", "intensity %");
+  BIND_METHOD(MCNAOqiDCM::isetLedsHandle);
+
+  functionName("setLedsBatch", getName(), "set several led groups at once");
+  addParam("entries", "array of [ledGroup, r, g, b] or [ledGroup, intensity], ledGroup being a name or a handle");
+  BIND_METHOD(MCNAOqiDCM::setLedsBatch);
+
+  functionName("uploadLedAnimation", getName(), "store a named led keyframe animation");
+  addParam("name", "animation name");
+  addParam("keyframes", "array of [timeMs, ledGroupName, r, g, b] or [timeMs, ledGroupName, intensity]");
+  addParam("durationMs", "duration of one loop (ms)");
+  addParam("loops", "number of loops");
+  BIND_METHOD(MCNAOqiDCM::uploadLedAnimation);
+
+  functionName("playLedAnimation", getName(), "queue a stored led animation in the DCM");
+  addParam("name", "animation name");
+  BIND_METHOD(MCNAOqiDCM::playLedAnimation);
+
+  functionName("getLedAnimations", getName(), "get the names of the stored led animations");
+  setReturn("animations", "array of animation names");
+  BIND_METHOD(MCNAOqiDCM::getLedAnimations);
+
   functionName("blink", getName(), "blink");
   BIND_METHOD(MCNAOqiDCM::blink);
 
@@ -115,6 +337,20 @@ MCNAOqiDCM::MCNAOqiDCM(boost::shared_ptr<AL::ALBroker> broker, const std::string
   addParam("state", "true to enable, false to disable");
   BIND_METHOD(MCNAOqiDCM::bumperSafetyReflex);
 
+  functionName("rearmBumperReflex", getName(), "Release a latched bumper safety reflex");
+  BIND_METHOD(MCNAOqiDCM::rearmBumperReflex);
+
+  functionName("getBumperReflexStatus", getName(), "get the bumper safety reflex status");
+  setReturn("bumper reflex status", "array [enabled, latched, trips]");
+  BIND_METHOD(MCNAOqiDCM::getBumperReflexStatus);
+
+  functionName("enableSharedMemoryChannel", getName(), "Create and use the shared-memory command/sensor channel");
+  addParam("name", "POSIX shared-memory object name, e.g. /mc_naoqi_dcm");
+  BIND_METHOD(MCNAOqiDCM::enableSharedMemoryChannel);
+
+  functionName("disableSharedMemoryChannel", getName(), "Stop using the shared-memory command/sensor channel");
+  BIND_METHOD(MCNAOqiDCM::disableSharedMemoryChannel);
+
 #ifdef PEPPER
   // Bind methods specific to Pepper robot
   functionName("setWheelsStiffness", getName(), "change wheels stiffness");
@@ -127,12 +363,18 @@ MCNAOqiDCM::MCNAOqiDCM(boost::shared_ptr<AL::ALBroker> broker, const std::string
   addParam("speed_b", "back wheel speed");
   BIND_METHOD(MCNAOqiDCM::setWheelSpeed);
 
+  functionName("setJointAnglesAndWheelSpeeds", getName(), "set joint angles and wheel speeds in the same DCM cycle");
+  addParam("jointValues", "joint values in the order of getJointOrder");
+  addParam("wheelSpeeds", "wheel speeds in the order of wheelNames");
+  BIND_METHOD(MCNAOqiDCM::setJointAnglesAndWheelSpeeds);
+
   // Create Pepper robot module
   robot_module = PepperRobotModule();
 #else
   // Create NAO robot module
   robot_module = NAORobotModule();
 #endif
+  loopStats.setNominalPeriod(robot_module.dcmPeriod);
 
   // Get the DCM proxy
   try
@@ -170,33 +412,54 @@ MCNAOqiDCM::MCNAOqiDCM(boost::shared_ptr<AL::ALBroker> broker, const std::string
     throw ALERROR(getName(), "MCNAOqiDCM", "Error no DCM running ");
   }
 
+  // Calibrate the DCM clock model used instead of dcmProxy->getTime
+  synchroniseDCMClock();
+
   // initialize sensor reading/setting
   init();
 
   // Get all sensor values from ALMemory using fastaccess
+  std::vector<float> sensorValues;
   fMemoryFastAccess->GetValues(sensorValues);
 
-  // Save initial sensor values into 'jointPositionCommands'
-  for(int i = 0; i < robot_module.actuators.size(); i++)
-  {
-    jointPositionCommands.push_back(sensorValues[i]);
-  }
+  // Save initial sensor values into 'jointPositionCommands', with the wheels stopped
+  // This preallocates all its buffers, publishing a command never allocates afterwards
+  std::vector<float> initialJointPositions(sensorValues.begin(), sensorValues.begin() + robot_module.actuators.size());
+  jointPositionTargets = initialJointPositions;
+  jointPositionTargets.resize(robot_module.actuators.size() + wheelNames().size(), 0.0f);
+  JointCommandFrame initialFrame;
+  initialFrame.values = jointPositionTargets;
+  initialFrame.wheelsSequence = 0;
+  initialFrame.trajectoryTimes.reserve(maxTrajectoryPoints);
+  jointPositionCommands.reset(initialFrame);
+  VelocityFrame initialVelocities;
+  initialVelocities.velocities.resize(robot_module.actuators.size(), 0.0f);
+  initialVelocities.expiryMs = 0;
+  jointVelocityCommands.reset(initialVelocities);
+  loopJointVelocities = initialVelocities.velocities;
+  loopSensorValues.resize(robot_module.readSensorKeys.size(), 0.0f);
+  loopJointPositions = initialJointPositions;
+  loopSentJointPositions = initialJointPositions;
+  jointLimiter.reset(robot_module.actuatorLowerLimits, robot_module.actuatorUpperLimits,
+                     robot_module.actuatorVelocityLimits, robot_module.dcmPeriod, initialJointPositions);
+  loopWheelSpeeds.resize(wheelNames().size(), 0.0f);
+  WheelsFrame initialWheels;
+  initialWheels.speeds = loopWheelSpeeds;
+  initialWheels.sequence = 0;
+  wheelSpeedCommands.reset(initialWheels);
+  loopPluginCommands.resize(jointPositionTargets.size(), 0.0f);
+  wheelsStiffnessTarget.reset(0.0f);
+  watchdog.reset(initialJointPositions);
+  sharedJointStiffness.resize(robot_module.actuators.size(), 0.0f);
+  flightRecorder.resize(flightRecorderSeconds * 1000000 / robot_module.dcmPeriod, robot_module.actuators.size(),
+                        loopWheelSpeeds.size(), robot_module.readSensorKeys.size());
 
   // Send initial command to the actuators
-  int DCMtime;
-  try
-  {
-    // Get absolute time, at 0 ms in the future ( i.e. now )
-    DCMtime = dcmProxy->getTime(0);
-  }
-  catch(const AL::ALError & e)
-  {
-    throw ALERROR(getName(), "MCNAOqiDCM", "Error on DCM getTime : " + e.toString());
-  }
+  int DCMtime = dcmClock.now();
   commands[4][0] = DCMtime;
   for(unsigned i = 0; i < robot_module.actuators.size(); i++)
   {
-    commands[5][i][0] = jointPositionCommands[i];
+    commands[5][i][0] = initialJointPositions[i];
   }
   try
   {
@@ -206,21 +469,38 @@ MCNAOqiDCM::MCNAOqiDCM(boost::shared_ptr<AL::ALBroker> broker, const std::string
   {
     throw ALERROR(getName(), "MCNAOqiDCM", "Error when sending command to DCM : " + e.toString());
   }
+
+  // Keep the DCM clock model synchronised (offset and drift) from a background thread
+  clockSyncThread = boost::thread(&MCNAOqiDCM::clockSyncLoop, this);
 }
 
 // Module destructor
 MCNAOqiDCM::~MCNAOqiDCM()
 {
   bumperSafetyReflex(false);
-  setWheelSpeed(0.0f, 0.0f, 0.0f);
-  setStiffness(0.0f);
-  setWheelsStiffness(0.0f);
+  // without the loop the wheel commands below are sent directly
   stopLoop();
+  plugins.clear();
+  // the wheel aliases only exist on robots with wheels
+  bool hasWheels = !wheelNames().empty();
+  if(hasWheels)
+  {
+    setWheelSpeed(0.0f, 0.0f, 0.0f);
+  }
+  setStiffness(0.0f);
+  if(hasWheels)
+  {
+    setWheelsStiffness(0.0f);
+  }
+  clockSyncThread.interrupt();
+  clockSyncThread.join();
+  flightRecorderDumpThread.join();
 }
 
 // Enable/disable mobile base safety reflex
 void MCNAOqiDCM::bumperSafetyReflex(bool state)
 {
+  bumperReflexEnabled.store(state, boost::memory_order_release);
   if(state)
   {
     // Subscribe to events
@@ -240,6 +520,15 @@ void MCNAOqiDCM::bumperSafetyReflex(bool state)
 // Start loop
 void MCNAOqiDCM::startLoop()
 {
+  AL::ALCriticalSection section(loopMutex);
+  // the callback is not connected yet, the previous tick is meaningless
+  loopStats.restart();
+  watchdog.restart();
+  // the joints may have moved while the loop was stopped
+  std::vector<float> sensorValues;
+  fMemoryFastAccess->GetValues(sensorValues);
+  holdJointLimiterAtEncoders(sensorValues);
+  loopPluginTime = 0;
   connectToDCMloop();
   preProcessConnected = true;
 }
@@ -247,16 +536,71 @@ void MCNAOqiDCM::startLoop()
 // Stop loop
 void MCNAOqiDCM::stopLoop()
 {
-  // Remove the preProcess callback connection
+  AL::ALCriticalSection section(loopMutex);
+  // Remove the preProcess and postProcess callback connections
   fDCMPreProcessConnection.disconnect();
+  fDCMPostProcessConnection.disconnect();
   preProcessConnected = false;
 }
 
+void MCNAOqiDCM::rearmBumperReflex()
+{
+  bumperReflexLatched.store(false, boost::memory_order_release);
+}
+
+AL::ALValue MCNAOqiDCM::getBumperReflexStatus()
+{
+  AL::ALValue status;
+  status.arraySetSize(3);
+  status[0] = bumperReflexEnabled.load(boost::memory_order_relaxed);
+  status[1] = bumperReflexLatched.load(boost::memory_order_relaxed);
+  status[2] = static_cast<int>(bumperReflexTrips.load(boost::memory_order_relaxed));
+  return status;
+}
+
+void MCNAOqiDCM::checkBumperReflex(const std::vector<float> & sensorValues, int DCMtime)
+{
+  if(!bumperReflexEnabled.load(boost::memory_order_acquire) || bumperReflexLatched.load(boost::memory_order_acquire))
+  {
+    return;
+  }
+  bool pressed = false;
+  for(size_t i = 0; i < bumperSensorIndices.size(); i++)
+  {
+    pressed = pressed || sensorValues[bumperSensorIndices[i]] > 0.5f;
+  }
+  if(!pressed)
+  {
+    return;
+  }
+
+  bumperReflexLatched.store(true, boost::memory_order_release);
+  bumperReflexTrips.fetch_add(1, boost::memory_order_relaxed);
+#ifdef PEPPER
+  // turn off wheels in this cycle, the preprocess callback keeps them stopped while latched
+  loopWheelsCommands[4][0] = DCMtime;
+  loopWheelsStiffnessCommands[4][0] = DCMtime;
+  for(unsigned i = 0; i < loopWheelSpeeds.size(); i++)
+  {
+    loopWheelsCommands[5][i][0] = 0.0f;
+    loopWheelsStiffnessCommands[5][i][0] = 0.0f;
+  }
+  sendLoopCommand(loopWheelsCommands, LoopErrorWheelsCommand);
+  sendLoopCommand(loopWheelsStiffnessCommands, LoopErrorWheelsCommand);
+#endif
+}
+
 void MCNAOqiDCM::onBumperPressed()
 {
-  // Turn off wheels
+  if(preProcessConnected)
+  {
+    // already handled by the loop
+    return;
+  }
+  // Turn off wheels, until the client sends new wheel speeds
   setWheelsStiffness(0.0f);
   setWheelSpeed(0.0f, 0.0f, 0.0f);
+  wheelsStopped.store(true, boost::memory_order_release);
 }
 
 bool MCNAOqiDCM::isPreProccessConnected()
@@ -264,14 +608,160 @@ bool MCNAOqiDCM::isPreProccessConnected()
   return preProcessConnected;
 }
 
+void MCNAOqiDCM::enableSharedMemoryChannel(const std::string & name)
+{
+  AL::ALCriticalSection section(sharedMemoryMutex);
+  if(!sharedMemoryChannel.isOpen())
+  {
+    try
+    {
+      sharedMemoryChannel.create(name, robot_module.actuators.size(), wheelNames().size(),
+                                 robot_module.readSensorKeys.size());
+    }
+    catch(const std::runtime_error & e)
+    {
+      throw ALERROR(getName(), "enableSharedMemoryChannel()", e.what());
+    }
+  }
+  else if(sharedMemoryChannel.name() != name)
+  {
+    // the DCM thread may still be reading the existing segment, it is never unmapped while the module runs
+    throw ALERROR(getName(), "enableSharedMemoryChannel()",
+                  "Shared memory channel already created as " + sharedMemoryChannel.name());
+  }
+  sharedMemoryActive.store(true, boost::memory_order_release);
+}
+
+void MCNAOqiDCM::disableSharedMemoryChannel()
+{
+  AL::ALCriticalSection section(sharedMemoryMutex);
+  sharedMemoryActive.store(false, boost::memory_order_release);
+}
+
+void MCNAOqiDCM::synchroniseDCMClock()
+{
+  // The DCM time has a 1ms resolution: average several round-trips
+  const int numSamples = 16;
+  double rate = dcmClock.rate();
+  long long hostRef = 0;
+  double dcmSum = 0.0;
+  for(int i = 0; i < numSamples; i++)
+  {
+    long long before = DCMClock::hostTime();
+    int DCMtime;
+    try
+    {
+      DCMtime = dcmProxy->getTime(0);
+    }
+    catch(const AL::ALError & e)
+    {
+      throw ALERROR(getName(), "synchroniseDCMClock()", "Error on DCM getTime : " + e.toString());
+    }
+    long long hostTime = (before + DCMClock::hostTime()) / 2;
+    if(i == 0)
+    {
+      hostRef = hostTime;
+    }
+    // bring every sample back to the host time of the first one
+    dcmSum += DCMtime - rate * static_cast<double>(hostTime - hostRef);
+  }
+  dcmClock.synchronise(hostRef, dcmSum / numSamples);
+}
+
+void MCNAOqiDCM::clockSyncLoop()
+{
+  // interrupted by the destructor (sleep is an interruption point)
+  while(true)
+  {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(clockSyncPeriodMs));
+    try
+    {
+      synchroniseDCMClock();
+    }
+    catch(const AL::ALError & e)
+    {
+      qiLogWarning("mc_naoqi_dcm") << "DCM clock synchronisation failed: " << e.toString() << std::endl;
+    }
+  }
+}
+
+void MCNAOqiDCM::dumpFlightRecorder(const std::string & path)
+{
+  if(flightRecorderDumping.exchange(true, boost::memory_order_acq_rel))
+  {
+    throw ALERROR(getName(), "dumpFlightRecorder()", "A flight recorder dump is already in progress");
+  }
+  // the previous dump thread has finished
+  flightRecorderDumpThread.join();
+  flightRecorderDumpThread = boost::thread(&MCNAOqiDCM::flightRecorderDumpLoop, this, path);
+}
+
+void MCNAOqiDCM::flightRecorderDumpLoop(std::string path)
+{
+  try
+  {
+    unsigned int records = flightRecorder.dump(path, robot_module.dcmPeriod, robot_module.actuators, wheelNames(),
+                                               robot_module.sensors);
+    flightRecorderLastDump.store(static_cast<int>(records), boost::memory_order_relaxed);
+  }
+  catch(const std::exception & e)
+  {
+    qiLogError("mc_naoqi_dcm") << "Flight recorder dump failed: " << e.what() << std::endl;
+    flightRecorderLastDump.store(-1, boost::memory_order_relaxed);
+  }
+  flightRecorderDumping.store(false, boost::memory_order_release);
+}
+
+AL::ALValue MCNAOqiDCM::getFlightRecorderStatus()
+{
+  AL::ALValue status;
+  status.arraySetSize(3);
+  status[0] = static_cast<int>(flightRecorder.capacity());
+  status[1] = flightRecorderDumping.load(boost::memory_order_acquire);
+  status[2] = flightRecorderLastDump.load(boost::memory_order_relaxed);
+  return status;
+}
+
+AL::ALValue MCNAOqiDCM::dcmTimeToHostTime(const int & dcmTime)
+{
+  long long hostTime = dcmClock.toHostTime(dcmTime);
+  AL::ALValue result;
+  result.arraySetSize(2);
+  result[0] = static_cast<int>(hostTime / 1000000LL);
+  result[1] = static_cast<int>((hostTime % 1000000LL) * 1000);
+  return result;
+}
+
 void MCNAOqiDCM::init()
 {
   // Enable fast access of all robot_module.readSensorKeys from memory
   initFastAccess();
+  // preallocate the sensor snapshots filled by the DCM postprocess callback
+  sensorSnapshots.resize(robot_module.readSensorKeys.size());
+#ifdef PEPPER
+  // platform bumpers checked by the bumper reflex
+  for(size_t i = 0; i < robot_module.bumpers.size(); i++)
+  {
+    std::vector<std::string>::const_iterator it =
+        std::find(robot_module.sensors.begin(), robot_module.sensors.end(), robot_module.bumpers[i]);
+    if(it != robot_module.sensors.end())
+    {
+      bumperSensorIndices.push_back(it - robot_module.sensors.begin());
+    }
+  }
+#endif
   // create 'jointActuator' alias to be used for sending joint possition commands
   createAliasPrepareCommand("jointActuator", robot_module.setActuatorKeys, commands);
   // create 'jointStiffness' alias to be used for setting joint stiffness commands
   createAliasPrepareCommand("jointStiffness", robot_module.setHardnessKeys, jointStiffnessCommands);
+  loopJointStiffnessCommands = jointStiffnessCommands;
+  // preallocate the stiffness frames and ramp
+  zeroJointStiffness.resize(robot_module.actuators.size(), 0.0f);
+  StiffnessFrame stiffnessFrame;
+  stiffnessFrame.stiffness = zeroJointStiffness;
+  stiffnessFrame.durationMs = 0;
+  jointStiffnessFrames.reset(stiffnessFrame);
+  jointStiffnessRamp.reset(zeroJointStiffness);
   // keep body joints turned off at initialization
   setStiffness(0.0f);
   // prepare commands for all led groups of robot_module
@@ -288,6 +778,8 @@ void MCNAOqiDCM::init()
       std::string wheelsStiffnessAliasName = wheels.groupName + std::string("Stiffness");
       createAliasPrepareCommand(wheelsSpeedAliasName, wheels.setActuatorKeys, wheelsCommands);
       createAliasPrepareCommand(wheelsStiffnessAliasName, wheels.setHardnessKeys, wheelsStiffnessCommands);
+      loopWheelsCommands = wheelsCommands;
+      loopWheelsStiffnessCommands = wheelsStiffnessCommands;
       // keep wheels turned off at initialization
       setWheelsStiffness(0.0f);
       break;
@@ -300,6 +792,21 @@ void MCNAOqiDCM::initFastAccess()
 {
   // Create the fast memory access to read sensor values
   fMemoryFastAccess->ConnectToVariables(getParentBroker(), robot_module.readSensorKeys, false);
+
+  // Slow sensors get their own fast access so that they do not slow down the main read. init is run by the
+  // constructor and again by the module loader, the readers must stay aligned with robot_module.sensorTiers
+  sensorTierReaders.clear();
+  for(size_t i = 0; i < robot_module.sensorTiers.size(); i++)
+  {
+    const SensorTier & tier = robot_module.sensorTiers[i];
+    boost::shared_ptr<SensorTierReader> reader(new SensorTierReader());
+    reader->fastAccess.reset(new AL::ALMemoryFastAccess());
+    reader->fastAccess->ConnectToVariables(getParentBroker(), tier.readSensorKeys, false);
+    reader->snapshots.resize(tier.readSensorKeys.size());
+    // spread the tiers over different cycles
+    reader->phase = (i + 1) % tier.decimation;
+    sensorTierReaders.push_back(reader);
+  }
 }
 
 void MCNAOqiDCM::createAliasPrepareCommand(std::string aliasName,
@@ -338,62 +845,72 @@ void MCNAOqiDCM::createAliasPrepareCommand(std::string aliasName,
   alias_command[2] = std::string("time-separate");
   alias_command[3] = 0; // Importance level. Not yet implemented. Must be set to 0
   // placeholder for command time
+  // typed right away so that updating it later (e.g. from the DCM thread) never reallocates
   alias_command[4].arraySetSize(1);
+  alias_command[4][0] = 0;
   // placeholder for command values
   alias_command[5].arraySetSize(mem_keys.size());
   for(int i = 0; i < mem_keys.size(); i++)
   {
     // allocate space for a new value for a memory key to be set via setAlias call
     alias_command[5][i].arraySetSize(1);
+    alias_command[5][i][0] = 0.0f;
   }
 }
 
+#ifdef MC_NAOQI_DCM_HOST
+void MCNAOqiDCM::benchmarkCreateAliasPrepareCommand(AL::ALValue & command)
+{
+  createAliasPrepareCommand("benchmarkActuator", robot_module.setActuatorKeys, command);
+}
+#endif
+
 void MCNAOqiDCM::createLedAliases()
 {
   // RGB led groups
   for(int i = 0; i < robot_module.rgbLedGroups.size(); i++)
   {
     const rgbLedGroup & leds = robot_module.rgbLedGroups[i];
-    AL::ALValue redLedCommands;
-    AL::ALValue greenLedCommands;
-    AL::ALValue blueLedCommands;
-    std::string rName = leds.groupName + std::string("Red");
-    std::string gName = leds.groupName + std::string("Green");
-    std::string bName = leds.groupName + std::string("Blue");
-    createAliasPrepareCommand(rName, leds.redLedKeys, redLedCommands, "Merge");
-    createAliasPrepareCommand(gName, leds.greenLedKeys, greenLedCommands, "Merge");
-    createAliasPrepareCommand(bName, leds.blueLedKeys, blueLedCommands, "Merge");
+    // one alias for all colors: a whole group is set with a single setAlias
+    std::vector<std::string> rgbLedKeys(leds.redLedKeys);
+    rgbLedKeys.insert(rgbLedKeys.end(), leds.greenLedKeys.begin(), leds.greenLedKeys.end());
+    rgbLedKeys.insert(rgbLedKeys.end(), leds.blueLedKeys.begin(), leds.blueLedKeys.end());
     // map led group name to led commands
-    ledCmdMap[leds.groupName].clear();
-    ledCmdMap[leds.groupName].push_back(redLedCommands);
-    ledCmdMap[leds.groupName].push_back(greenLedCommands);
-    ledCmdMap[leds.groupName].push_back(blueLedCommands);
+    ledGroupHandles[leds.groupName] = ledCommands.size();
+    ledCommands.push_back(LedGroupCommand());
+    LedGroupCommand & rgbCmnds = ledCommands.back();
+    rgbCmnds.rgb = true;
+    rgbCmnds.numLeds = leds.redLedKeys.size();
+    createAliasPrepareCommand(leds.groupName + std::string("RGB"), rgbLedKeys, rgbCmnds.command, "Merge");
   }
 
   // Single channel led groups
   for(int i = 0; i < robot_module.iLedGroups.size(); i++)
   {
     const iLedGroup & leds = robot_module.iLedGroups[i];
-    AL::ALValue intensityLedCommands;
-    createAliasPrepareCommand(leds.groupName, leds.intensityLedKeys, intensityLedCommands, "Merge");
     // map led group name to led commands
-    ledCmdMap[leds.groupName].clear();
-    ledCmdMap[leds.groupName].push_back(intensityLedCommands);
+    ledGroupHandles[leds.groupName] = ledCommands.size();
+    ledCommands.push_back(LedGroupCommand());
+    LedGroupCommand & intensityCmnds = ledCommands.back();
+    intensityCmnds.rgb = false;
+    intensityCmnds.numLeds = leds.intensityLedKeys.size();
+    createAliasPrepareCommand(leds.groupName, leds.intensityLedKeys, intensityCmnds.command, "Merge");
   }
 }
 
 void MCNAOqiDCM::setWheelsStiffness(const float & stiffnessValue)
 {
-  int DCMtime;
-  try
+  if(preProcessConnected)
   {
-    DCMtime = dcmProxy->getTime(0);
-  }
-  catch(const AL::ALError & e)
-  {
-    throw ALERROR(getName(), "setStiffness()", "Error on DCM getTime : " + e.toString());
+    // sent by the DCM loop in its next cycle
+    AL::ALCriticalSection section(jointPositionCommandsMutex);
+    wheelsStiffnessTarget.writeBuffer() = stiffnessValue;
+    wheelsStiffnessTarget.publish();
+    return;
   }
 
+  int DCMtime = dcmClock.now();
+
   wheelsStiffnessCommands[4][0] = DCMtime;
   wheelsStiffnessCommands[5][0][0] = stiffnessValue;
   wheelsStiffnessCommands[5][1][0] = stiffnessValue;
@@ -411,16 +928,28 @@ void MCNAOqiDCM::setWheelsStiffness(const float & stiffnessValue)
 
 void MCNAOqiDCM::setWheelSpeed(const float & speed_fl, const float & speed_fr, const float & speed_b)
 {
-  int DCMtime;
-  try
-  {
-    DCMtime = dcmProxy->getTime(0);
-  }
-  catch(const AL::ALError & e)
+  if(preProcessConnected)
   {
-    throw ALERROR(getName(), "setWheelSpeed()", "Error on DCM getTime : " + e.toString());
+    if(loopWheelSpeeds.empty())
+    {
+      throw ALERROR(getName(), "setWheelSpeed()", robot_module.name + " has no wheels");
+    }
+    // sent by the DCM loop in its next cycle, the joint commands are left untouched
+    AL::ALCriticalSection section(jointPositionCommandsMutex);
+    float * wheelSpeeds = &jointPositionTargets[robot_module.actuators.size()];
+    wheelSpeeds[0] = speed_fl;
+    wheelSpeeds[1] = speed_fr;
+    wheelSpeeds[2] = speed_b;
+    WheelsFrame & frame = wheelSpeedCommands.writeBuffer();
+    std::copy(wheelSpeeds, wheelSpeeds + frame.speeds.size(), frame.speeds.begin());
+    frame.sequence = ++wheelSpeedsSequence;
+    wheelsStopped.store(false, boost::memory_order_release);
+    wheelSpeedCommands.publish();
+    return;
   }
 
+  int DCMtime = dcmClock.now();
+
   wheelsCommands[4][0] = DCMtime;
   wheelsCommands[5][0][0] = speed_fl;
   wheelsCommands[5][1][0] = speed_fr;
@@ -438,23 +967,63 @@ void MCNAOqiDCM::setWheelSpeed(const float & speed_fl, const float & speed_fr, c
 
 void MCNAOqiDCM::setStiffness(const float & stiffnessValue)
 {
-  int DCMtime;
-  // increase stiffness with the "jointStiffness" Alias created at initialisation
-  try
+  sendJointStiffness(std::vector<float>(robot_module.actuators.size(), stiffnessValue), 0, "setStiffness()");
+}
+
+void MCNAOqiDCM::setJointStiffness(const std::vector<float> & stiffnessValues)
+{
+  sendJointStiffness(stiffnessValues, 0, "setJointStiffness()");
+}
+
+void MCNAOqiDCM::setJointStiffnessRamp(const std::vector<float> & stiffnessValues, const int & durationMs)
+{
+  if(durationMs < 0)
   {
-    DCMtime = dcmProxy->getTime(0);
+    throw ALERROR(getName(), "setJointStiffnessRamp()", "Negative ramp duration");
   }
-  catch(const AL::ALError & e)
+  sendJointStiffness(stiffnessValues, durationMs, "setJointStiffnessRamp()");
+}
+
+void MCNAOqiDCM::sendJointStiffness(const std::vector<float> & stiffnessValues,
+                                    int durationMs,
+                                    const std::string & method)
+{
+  if(stiffnessValues.size() != robot_module.actuators.size())
   {
-    throw ALERROR(getName(), "setStiffness()", "Error on DCM getTime : " + e.toString());
+    throw ALERROR(getName(), method,
+                  "Expected " + to_string(robot_module.actuators.size()) + " stiffness values, got "
+                      + to_string(stiffnessValues.size()));
+  }
+  // NaN are rejected and values clamped to [0, 1], as positions in setJointTrajectory
+  std::vector<float> stiffness(stiffnessValues.size());
+  for(size_t i = 0; i < stiffness.size(); i++)
+  {
+    if(stiffnessValues[i] != stiffnessValues[i])
+    {
+      throw ALERROR(getName(), method, "Stiffness of " + robot_module.actuators[i] + " is NaN");
+    }
+    stiffness[i] = std::min(std::max(stiffnessValues[i], 0.0f), 1.0f);
   }
 
-  jointStiffnessCommands[4][0] = DCMtime;
+  AL::ALCriticalSection section(jointPositionCommandsMutex);
+  if(preProcessConnected)
+  {
+    // interpolated and sent by the DCM loop
+    StiffnessFrame & frame = jointStiffnessFrames.writeBuffer();
+    std::copy(stiffness.begin(), stiffness.end(), frame.stiffness.begin());
+    frame.durationMs = durationMs;
+    jointStiffnessFrames.publish();
+    return;
+  }
 
-  for(int i = 0; i < robot_module.actuators.size(); i++)
+  // the DCM interpolates from the current stiffness until the command time
+  jointStiffnessCommands[4][0] = dcmClock.now() + durationMs;
+  for(unsigned i = 0; i < stiffness.size(); i++)
   {
-    jointStiffnessCommands[5][i][0] = stiffnessValue;
+    jointStiffnessCommands[5][i][0] = stiffness[i];
   }
+  // the loop starts from this stiffness when it is connected
+  jointStiffnessRamp.reset(stiffness);
 
   try
   {
@@ -462,176 +1031,1164 @@ void MCNAOqiDCM::setStiffness(const float & stiffnessValue)
   }
   catch(const AL::ALError & e)
   {
-    throw ALERROR(getName(), "setStiffness()", "Error when sending stiffness to DCM : " + e.toString());
+    throw ALERROR(getName(), method, "Error when sending stiffness to DCM : " + e.toString());
   }
 }
 
 void MCNAOqiDCM::setJointAngles(std::vector<float> jointValues)
 {
-  // update values in the vector that is used to send joint commands every 12ms
-  jointPositionCommands = jointValues;
-}
-
-std::vector<std::string> MCNAOqiDCM::getJointOrder() const
-{
-  return robot_module.actuators;
-}
+  if(jointValues.size() != robot_module.actuators.size())
+  {
+    throw ALERROR(getName(), "setJointAngles()",
+                  "Expected " + to_string(robot_module.actuators.size()) + " joint values, got "
+                      + to_string(jointValues.size()));
+  }
 
-std::vector<std::string> MCNAOqiDCM::getSensorsOrder() const
-{
-  return robot_module.sensors;
+  // update values in the buffer that is used to send joint commands every 12ms
+  AL::ALCriticalSection section(jointPositionCommandsMutex);
+  std::copy(jointValues.begin(), jointValues.end(), jointPositionTargets.begin());
+  publishCommandFrame(false);
 }
 
-std::string MCNAOqiDCM::getRobotName() const
+void MCNAOqiDCM::setJointAnglesAndWheelSpeeds(const std::vector<float> & jointValues,
+                                              const std::vector<float> & wheelSpeeds)
 {
-  return robot_module.name;
-}
+  if(jointValues.size() != robot_module.actuators.size()
+     || jointValues.size() + wheelSpeeds.size() != jointPositionTargets.size())
+  {
+    throw ALERROR(getName(), "setJointAnglesAndWheelSpeeds()",
+                  "Expected " + to_string(robot_module.actuators.size()) + " joint values and "
+                      + to_string(jointPositionTargets.size() - robot_module.actuators.size()) + " wheel speeds");
+  }
 
-int MCNAOqiDCM::numSensors() const
-{
-  return robot_module.readSensorKeys.size();
+  AL::ALCriticalSection section(jointPositionCommandsMutex);
+  std::copy(jointValues.begin(), jointValues.end(), jointPositionTargets.begin());
+  std::copy(wheelSpeeds.begin(), wheelSpeeds.end(), jointPositionTargets.begin() + jointValues.size());
+  wheelsStopped.store(false, boost::memory_order_release);
+  publishCommandFrame(true);
 }
 
-std::vector<std::string> MCNAOqiDCM::bumperNames() const
+void MCNAOqiDCM::publishCommandFrame(bool withWheels)
 {
-  return robot_module.bumpers;
+  // the frame is copied in place, the buffers were preallocated in the constructor
+  JointCommandFrame & frame = jointPositionCommands.writeBuffer();
+  std::copy(jointPositionTargets.begin(), jointPositionTargets.end(), frame.values.begin());
+  frame.wheelsSequence = withWheels ? ++wheelSpeedsSequence : 0;
+  frame.trajectoryTimes.clear();
+  jointPositionCommandsTime.store(static_cast<unsigned int>(DCMClock::hostTime()), boost::memory_order_relaxed);
+  jointPositionCommands.publish();
 }
 
-std::vector<std::string> MCNAOqiDCM::tactileSensorNames() const
+void MCNAOqiDCM::setJointTrajectory(const std::vector<int> & timesMs, const AL::ALValue & points)
 {
-  return robot_module.tactile;
-}
+  size_t numJoints = robot_module.actuators.size();
+  if(timesMs.empty() || timesMs.size() > maxTrajectoryPoints || !points.isArray()
+     || points.getSize() != timesMs.size())
+  {
+    throw ALERROR(getName(), "setJointTrajectory()",
+                  "Expected between 1 and " + to_string(maxTrajectoryPoints) + " times and as many points");
+  }
+  for(size_t k = 0; k < timesMs.size(); k++)
+  {
+    if(timesMs[k] < 0 || (k > 0 && timesMs[k] <= timesMs[k - 1]))
+    {
+      throw ALERROR(getName(), "setJointTrajectory()", "Times must be positive and strictly increasing");
+    }
+    if(!points[k].isArray() || points[k].getSize() != numJoints)
+    {
+      throw ALERROR(getName(), "setJointTrajectory()",
+                    "Point " + to_string(k) + " does not have " + to_string(numJoints) + " joint values");
+    }
+  }
 
-std::vector<std::string> MCNAOqiDCM::wheelNames() const
-{
-  std::vector<std::string> wheelNames;
-  for(size_t i = 0; i < robot_module.specialJointGroups.size(); i++)
+  // multi-point command, allocated here rather than in the loop
+  AL::ALValue trajectory;
+  trajectory.arraySetSize(6);
+  trajectory[0] = std::string("jointActuator");
+  // replaces whatever the DCM still had to execute
+  trajectory[1] = std::string("ClearAll");
+  trajectory[2] = std::string("time-separate");
+  trajectory[3] = 0;
+  trajectory[4].arraySetSize(timesMs.size());
+  trajectory[5].arraySetSize(numJoints);
+  for(size_t i = 0; i < numJoints; i++)
   {
-    if(robot_module.specialJointGroups[i].groupName == "wheels")
+    trajectory[5][i].arraySetSize(timesMs.size());
+  }
+  // not seen by the joint limiter of the loop: NaN are rejected and positions clamped here
+  for(size_t k = 0; k < timesMs.size(); k++)
+  {
+    trajectory[4][k] = 0;
+    for(size_t i = 0; i < numJoints; i++)
     {
-      wheelNames = robot_module.specialJointGroups[i].jointsNames;
-      break;
+      float position = toFloat(points[k][i]);
+      if(position != position)
+      {
+        throw ALERROR(getName(), "setJointTrajectory()", "Point " + to_string(k) + " has a NaN value");
+      }
+      trajectory[5][i][k] =
+          std::min(std::max(position, robot_module.actuatorLowerLimits[i]), robot_module.actuatorUpperLimits[i]);
     }
   }
-  return wheelNames;
+
+  AL::ALCriticalSection section(jointPositionCommandsMutex);
+  // the loop holds the last point once the trajectory is over
+  const AL::ALValue & last = trajectory[5];
+  for(size_t i = 0; i < numJoints; i++)
+  {
+    jointPositionTargets[i] = toFloat(last[i][timesMs.size() - 1]);
+  }
+  JointCommandFrame & frame = jointPositionCommands.writeBuffer();
+  std::copy(jointPositionTargets.begin(), jointPositionTargets.end(), frame.values.begin());
+  frame.wheelsSequence = 0;
+  frame.trajectoryTimes.assign(timesMs.begin(), timesMs.end());
+  frame.trajectory = trajectory;
+  jointPositionCommandsTime.store(static_cast<unsigned int>(DCMClock::hostTime()), boost::memory_order_relaxed);
+  jointPositionCommands.publish();
 }
 
-// Method is not synchronized with DCM loop
-// Better approach might be to call GetValues on postprocess of DCM loop
-std::vector<float> MCNAOqiDCM::getSensors()
+void MCNAOqiDCM::setJointVelocities(const std::vector<float> & velocities, const int & expiryMs)
 {
-  // Get all values from ALMemory using fastaccess
-  fMemoryFastAccess->GetValues(sensorValues);
-  return sensorValues;
+  if(velocities.size() != robot_module.actuators.size() || expiryMs < 0)
+  {
+    throw ALERROR(getName(), "setJointVelocities()",
+                  "Expected " + to_string(robot_module.actuators.size()) + " joint velocities and a positive expiry");
+  }
+
+  AL::ALCriticalSection section(jointPositionCommandsMutex);
+  VelocityFrame & frame = jointVelocityCommands.writeBuffer();
+  std::copy(velocities.begin(), velocities.end(), frame.velocities.begin());
+  frame.expiryMs = expiryMs;
+  jointVelocityCommands.publish();
 }
 
-void MCNAOqiDCM::connectToDCMloop()
+void MCNAOqiDCM::integrateJointVelocities(int DCMtime)
 {
-  // Connect callback to the DCM pre proccess
-  try
+  if(loopVelocityExpires && DCMtime >= loopVelocityExpiry)
   {
-    //  onPreProcess is useful because it’s called just before the computation of orders sent to the chestboard (USB).
-    //  Sending commands at this level means that you have the shortest delay to your command.
-    fDCMPreProcessConnection = getParentBroker()->getProxy("DCM")->getModule()->atPreProcess(
-        boost::bind(&MCNAOqiDCM::synchronisedDCMcallback, this));
-    // what happens if I add it twice? add same callback while it is already added? try in python?
+    // integrate until the expiry, then hold
+    DCMtime = loopVelocityExpiry;
+    loopVelocityActive = false;
   }
-  catch(const AL::ALError & e)
+  float dt = static_cast<float>(DCMtime - loopVelocityTime) * 1e-3f;
+  loopVelocityTime = DCMtime;
+  for(size_t i = 0; i < loopJointPositions.size(); i++)
   {
-    throw ALERROR(getName(), "connectToDCMloop()", "Error when connecting to DCM preProccess: " + e.toString());
+    float position = loopJointPositions[i] + loopJointVelocities[i] * dt;
+    loopJointPositions[i] =
+        std::min(std::max(position, robot_module.actuatorLowerLimits[i]), robot_module.actuatorUpperLimits[i]);
   }
 }
 
-// using 'jointActuator' alias created 'command'
-// that will use data from 'jointPositionCommands' to send it to DCM every 12 ms
-void MCNAOqiDCM::synchronisedDCMcallback()
+void MCNAOqiDCM::sendJointTrajectory(JointCommandFrame & frame, int DCMtime)
 {
-  int DCMtime;
-
+  for(size_t k = 0; k < frame.trajectoryTimes.size(); k++)
+  {
+    frame.trajectory[4][k] = DCMtime + frame.trajectoryTimes[k];
+  }
+  loopTrajectoryActive = sendLoopCommand(frame.trajectory, LoopErrorJointCommand);
+  loopTrajectoryEnd = DCMtime + frame.trajectoryTimes.back();
+}
+
+void MCNAOqiDCM::interruptJointTrajectory()
+{
+  loopTrajectoryActive = false;
+  // the trajectory was interrupted somewhere between its points, restart the joint limiter from the encoders
+  int sensorsTime;
+  unsigned int sensorsCycle;
+  if(sensorSnapshots.readLatest(loopSensorValues, sensorsTime, sensorsCycle))
+  {
+    jointLimiter.hold(&loopSensorValues[0]);
+  }
+}
+
+int MCNAOqiDCM::resolveJointGroup(const std::vector<std::string> & jointNames)
+{
+  std::vector<unsigned int> indices(jointNames.size());
+  for(size_t i = 0; i < jointNames.size(); i++)
+  {
+    std::vector<std::string>::const_iterator it =
+        std::find(robot_module.actuators.begin(), robot_module.actuators.end(), jointNames[i]);
+    if(it == robot_module.actuators.end())
+    {
+      throw ALERROR(getName(), "resolveJointGroup()", "Unknown joint " + jointNames[i]);
+    }
+    indices[i] = it - robot_module.actuators.begin();
+  }
+
+  AL::ALCriticalSection section(jointPositionCommandsMutex);
+  for(size_t i = 0; i < jointGroups.size(); i++)
+  {
+    if(jointGroups[i] == indices)
+    {
+      return i;
+    }
+  }
+  jointGroups.push_back(indices);
+  return jointGroups.size() - 1;
+}
+
+void MCNAOqiDCM::setJointGroupAngles(const int & handle, const std::vector<float> & jointValues)
+{
+  AL::ALCriticalSection section(jointPositionCommandsMutex);
+  if(handle < 0 || handle >= static_cast<int>(jointGroups.size()))
+  {
+    throw ALERROR(getName(), "setJointGroupAngles()", "Invalid joint group handle " + to_string(handle));
+  }
+  const std::vector<unsigned int> & indices = jointGroups[handle];
+  if(jointValues.size() != indices.size())
+  {
+    throw ALERROR(getName(), "setJointGroupAngles()",
+                  "Expected " + to_string(indices.size()) + " joint values, got " + to_string(jointValues.size()));
+  }
+
+  for(size_t i = 0; i < indices.size(); i++)
+  {
+    jointPositionTargets[indices[i]] = jointValues[i];
+  }
+  publishCommandFrame(false);
+}
+
+std::vector<std::string> MCNAOqiDCM::getJointOrder() const
+{
+  return robot_module.actuators;
+}
+
+std::vector<std::string> MCNAOqiDCM::getSensorsOrder() const
+{
+  return robot_module.sensors;
+}
+
+std::string MCNAOqiDCM::getRobotName() const
+{
+  return robot_module.name;
+}
+
+int MCNAOqiDCM::numSensors() const
+{
+  return robot_module.readSensorKeys.size();
+}
+
+std::vector<std::string> MCNAOqiDCM::bumperNames() const
+{
+  return robot_module.bumpers;
+}
+
+std::vector<std::string> MCNAOqiDCM::tactileSensorNames() const
+{
+  return robot_module.tactile;
+}
+
+std::vector<std::string> MCNAOqiDCM::wheelNames() const
+{
+  std::vector<std::string> wheelNames;
+  for(size_t i = 0; i < robot_module.specialJointGroups.size(); i++)
+  {
+    if(robot_module.specialJointGroups[i].groupName == "wheels")
+    {
+      wheelNames = robot_module.specialJointGroups[i].jointsNames;
+      break;
+    }
+  }
+  return wheelNames;
+}
+
+void MCNAOqiDCM::readSensorSnapshot(std::vector<float> & sensorValues, int & DCMtime, unsigned int & cycle)
+{
+  // Latest snapshot taken by the DCM postprocess callback
+  if(preProcessConnected && sensorSnapshots.readLatest(sensorValues, DCMtime, cycle))
+  {
+    return;
+  }
+  // Loop not running: nothing refreshes the snapshots, read ALMemory directly
+  fMemoryFastAccess->GetValues(sensorValues);
+  DCMtime = dcmClock.now();
+  cycle = 0;
+}
+
+std::vector<float> MCNAOqiDCM::getSensors()
+{
+  std::vector<float> sensorValues;
+  int DCMtime;
+  unsigned int cycle;
+  readSensorSnapshot(sensorValues, DCMtime, cycle);
+  return sensorValues;
+}
+
+int MCNAOqiDCM::registerSensorProfile(const std::string & name, const std::vector<std::string> & sensors)
+{
+  boost::shared_ptr<SensorProfile> profile(new SensorProfile());
+  profile->name = name;
+  for(size_t i = 0; i < sensors.size(); i++)
+  {
+    const std::string & sensor = sensors[i];
+    bool isPrefix = !sensor.empty() && sensor[sensor.size() - 1] == '*';
+    std::string prefix = isPrefix ? sensor.substr(0, sensor.size() - 1) : sensor;
+    size_t selected = profile->indices.size();
+    for(size_t j = 0; j < robot_module.sensors.size(); j++)
+    {
+      if(isPrefix ? robot_module.sensors[j].compare(0, prefix.size(), prefix) == 0 : robot_module.sensors[j] == sensor)
+      {
+        profile->indices.push_back(j);
+      }
+    }
+    if(profile->indices.size() == selected)
+    {
+      throw ALERROR(getName(), "registerSensorProfile()", "No sensor matches " + sensor);
+    }
+  }
+
+  AL::ALCriticalSection section(sensorProfilesMutex);
+  for(size_t i = 0; i < sensorProfiles.size(); i++)
+  {
+    if(sensorProfiles[i]->name == name)
+    {
+      sensorProfiles[i] = profile;
+      return i;
+    }
+  }
+  sensorProfiles.push_back(profile);
+  return sensorProfiles.size() - 1;
+}
+
+boost::shared_ptr<const MCNAOqiDCM::SensorProfile> MCNAOqiDCM::sensorProfile(int id)
+{
+  AL::ALCriticalSection section(sensorProfilesMutex);
+  if(id < 0 || id >= static_cast<int>(sensorProfiles.size()))
+  {
+    throw ALERROR(getName(), "sensorProfile()", "Invalid sensor profile id " + to_string(id));
+  }
+  return sensorProfiles[id];
+}
+
+std::vector<std::string> MCNAOqiDCM::getSensorsProfileOrder(const int & id)
+{
+  boost::shared_ptr<const SensorProfile> profile = sensorProfile(id);
+  std::vector<std::string> names(profile->indices.size());
+  for(size_t i = 0; i < names.size(); i++)
+  {
+    names[i] = robot_module.sensors[profile->indices[i]];
+  }
+  return names;
+}
+
+std::vector<float> MCNAOqiDCM::getSensorsProfile(const int & id)
+{
+  boost::shared_ptr<const SensorProfile> profile = sensorProfile(id);
+  std::vector<float> values;
+  int DCMtime;
+  unsigned int cycle;
+  // only the values of the profile are copied out of the snapshot
+  if(preProcessConnected && sensorSnapshots.readLatest(profile->indices, values, DCMtime, cycle))
+  {
+    return values;
+  }
+  std::vector<float> sensorValues;
+  readSensorSnapshot(sensorValues, DCMtime, cycle);
+  values.resize(profile->indices.size());
+  for(size_t i = 0; i < values.size(); i++)
+  {
+    values[i] = sensorValues[profile->indices[i]];
+  }
+  return values;
+}
+
+AL::ALValue MCNAOqiDCM::setJointAnglesAndGetSensors(std::vector<float> jointValues)
+{
+  setJointAngles(jointValues);
+
+  std::vector<float> sensorValues;
+  int DCMtime;
+  unsigned int cycle;
+  readSensorSnapshot(sensorValues, DCMtime, cycle);
+
+  AL::ALValue snapshot;
+  snapshot.arraySetSize(3);
+  snapshot[0] = sensorValues;
+  snapshot[1] = DCMtime;
+  snapshot[2] = static_cast<int>(cycle);
+  return snapshot;
+}
+
+AL::ALValue MCNAOqiDCM::waitForNextCycle(const int & lastCycleId, const int & timeoutMs)
+{
+  if(!preProcessConnected)
+  {
+    throw ALERROR(getName(), "waitForNextCycle()", "The loop is not running, call startLoop first");
+  }
+
+  long long deadline = DCMClock::hostTime() + timeoutMs * 1000LL;
+  // registered before checking the cycle: the postprocess either sees the waiter or publishes first
+  cycleWaiters.fetch_add(1, boost::memory_order_seq_cst);
+  while(true)
+  {
+    unsigned int cycle = publishedCycle.load(boost::memory_order_seq_cst);
+    long long remaining = deadline - DCMClock::hostTime();
+    if(cycle != static_cast<unsigned int>(lastCycleId) || remaining <= 0)
+    {
+      break;
+    }
+    struct timespec timeout;
+    timeout.tv_sec = remaining / 1000000LL;
+    timeout.tv_nsec = (remaining % 1000000LL) * 1000;
+    // returns at once if publishedCycle changed since it was read
+    futex(publishedCycle, FUTEX_WAIT_PRIVATE, cycle, &timeout);
+  }
+  cycleWaiters.fetch_sub(1, boost::memory_order_seq_cst);
+
+  // on timeout this is still the snapshot of lastCycleId
+  std::vector<float> sensorValues;
+  int DCMtime;
+  unsigned int cycle;
+  readSensorSnapshot(sensorValues, DCMtime, cycle);
+
+  AL::ALValue snapshot;
+  snapshot.arraySetSize(3);
+  snapshot[0] = sensorValues;
+  snapshot[1] = DCMtime;
+  snapshot[2] = static_cast<int>(cycle);
+  return snapshot;
+}
+
+void MCNAOqiDCM::connectToDCMloop()
+{
+  // Connect callback to the DCM pre proccess
+  try
+  {
+    //  onPreProcess is useful because it’s called just before the computation of orders sent to the chestboard (USB).
+    //  Sending commands at this level means that you have the shortest delay to your command.
+    fDCMPreProcessConnection = getParentBroker()->getProxy("DCM")->getModule()->atPreProcess(
+        boost::bind(&MCNAOqiDCM::synchronisedDCMcallback, this));
+    // what happens if I add it twice? add same callback while it is already added? try in python?
+  }
+  catch(const AL::ALError & e)
+  {
+    throw ALERROR(getName(), "connectToDCMloop()", "Error when connecting to DCM preProccess: " + e.toString());
+  }
+
+  // Connect callback to the DCM post proccess
   try
   {
-    // Get absolute time, at 0 ms in the future ( i.e. now )
-    DCMtime = dcmProxy->getTime(0);
+    // onPostProcess is called right after the DCM updated ALMemory with the values read from the chestboard.
+    // Reading sensors at this level gives one consistent set of values per cycle.
+    fDCMPostProcessConnection = getParentBroker()->getProxy("DCM")->getModule()->atPostProcess(
+        boost::bind(&MCNAOqiDCM::synchronisedSensorsCallback, this));
   }
   catch(const AL::ALError & e)
   {
-    throw ALERROR(getName(), "synchronisedDCMcallback()", "Error on DCM getTime : " + e.toString());
+    fDCMPreProcessConnection.disconnect();
+    throw ALERROR(getName(), "connectToDCMloop()", "Error when connecting to DCM postProccess: " + e.toString());
   }
+}
+
+// using 'jointActuator' alias created 'command'
+// that will use data from 'jointPositionCommands' to send it to DCM every 12 ms
+void MCNAOqiDCM::synchronisedDCMcallback()
+{
+  long long startTime = DCMClock::hostTime();
+  int DCMtime = dcmClock.toDcmTime(startTime);
 
   commands[4][0] = DCMtime;
 
-  // XXX make this faster with memcpy?
-  for(unsigned i = 0; i < robot_module.actuators.size(); i++)
+  // Acquire the latest complete frame published by setJointAngles (wait-free)
+  bool newCommand = jointPositionCommands.update();
+  bool newTrajectory = false;
+  if(newCommand)
   {
-    // new actuator value = latest values from jointPositionCommands
-    commands[5][i][0] = jointPositionCommands[i];
+    JointCommandFrame & frame = jointPositionCommands.readBuffer();
+    std::copy(frame.values.begin(), frame.values.begin() + loopJointPositions.size(), loopJointPositions.begin());
+    if(frame.wheelsSequence != 0)
+    {
+      updateLoopWheelSpeeds(&frame.values[loopJointPositions.size()], frame.wheelsSequence);
+    }
+    loopJointPositionsTime = jointPositionCommandsTime.load(boost::memory_order_relaxed);
+    newTrajectory = !frame.trajectoryTimes.empty();
+    if(newTrajectory)
+    {
+      sendJointTrajectory(frame, DCMtime);
+    }
   }
 
-  try
+  // Wheel-only commands do not count as joint commands
+  if(wheelSpeedCommands.update())
   {
-    dcmProxy->setAlias(commands);
+    const WheelsFrame & frame = wheelSpeedCommands.readBuffer();
+    updateLoopWheelSpeeds(frame.speeds.empty() ? 0 : &frame.speeds[0], frame.sequence);
   }
-  catch(const AL::ALError & e)
+
+  // A frame written by a shared-memory client since the last cycle takes over
+  bool useSharedMemory = sharedMemoryActive.load(boost::memory_order_acquire);
+  if(useSharedMemory && sharedMemoryChannel.readJointPositions(&loopJointPositions[0], sharedJointPositionsSequence))
+  {
+    newCommand = true;
+    newTrajectory = false;
+    loopJointPositionsTime = static_cast<unsigned int>(startTime);
+  }
+
+  // Joint positions are not sent while the DCM executes a trajectory, a new position command cancels it
+  if(newCommand && !newTrajectory && loopTrajectoryActive)
+  {
+    interruptJointTrajectory();
+  }
+  // as well as the velocity mode
+  if(newCommand)
+  {
+    loopVelocityActive = false;
+  }
+
+  // A velocity command starts or updates the velocity mode
+  if(jointVelocityCommands.update())
+  {
+    const VelocityFrame & frame = jointVelocityCommands.readBuffer();
+    if(!loopVelocityActive)
+    {
+      // start from the encoders (first values of the sensors), the previous command may be far from them
+      int sensorsTime;
+      unsigned int sensorsCycle;
+      if(sensorSnapshots.readLatest(loopSensorValues, sensorsTime, sensorsCycle))
+      {
+        std::copy(loopSensorValues.begin(), loopSensorValues.begin() + loopJointPositions.size(),
+                  loopJointPositions.begin());
+      }
+      loopVelocityTime = DCMtime;
+    }
+    if(loopTrajectoryActive)
+    {
+      interruptJointTrajectory();
+    }
+    std::copy(frame.velocities.begin(), frame.velocities.end(), loopJointVelocities.begin());
+    loopVelocityExpires = frame.expiryMs > 0;
+    loopVelocityExpiry = DCMtime + frame.expiryMs;
+    loopVelocityActive = true;
+    newCommand = true;
+    loopJointPositionsTime = static_cast<unsigned int>(startTime);
+  }
+  if(loopVelocityActive)
+  {
+    integrateJointVelocities(DCMtime);
+  }
+  if(loopTrajectoryActive && DCMtime >= loopTrajectoryEnd)
+  {
+    // the DCM reached the last point, held by loopJointPositions
+    loopTrajectoryActive = false;
+    jointLimiter.hold(&loopJointPositions[0]);
+  }
+  if(useSharedMemory && !loopWheelSpeeds.empty()
+     && sharedMemoryChannel.readWheelSpeeds(&loopWheelSpeeds[0], sharedWheelSpeedsSequence))
+  {
+    wheelsStopped.store(false, boost::memory_order_release);
+  }
+
+  // Fallback policy when the client stopped sending commands, a running trajectory counts as commands
+  if(watchdog.update(newCommand || loopTrajectoryActive || loopVelocityActive, loopJointPositions))
+  {
+    applyWatchdogPolicy(DCMtime);
+  }
+
+  // In-loop controllers refine the command, their output goes through the same limits
+  const float * jointTargets = &loopJointPositions[0];
+  if(!plugins.empty())
+  {
+    runPlugins(DCMtime);
+    jointTargets = &loopPluginCommands[0];
+  }
+
+  // A dead client is only held for a bounded time
+  Watchdog::Policy watchdogPolicy = watchdog.policy();
+  bool holdExpired = watchdog.tripped()
+                     && (watchdogPolicy == Watchdog::Hold || watchdogPolicy == Watchdog::ExtrapolateHold)
+                     && DCMtime >= watchdogHoldEnd;
+  if(!loopTrajectoryActive && !holdExpired)
+  {
+    // NaN, position and velocity limits, whatever the source of the command
+    jointLimiter.apply(jointTargets, &loopSentJointPositions[0]);
+    for(unsigned i = 0; i < robot_module.actuators.size(); i++)
+    {
+      commands[5][i][0] = loopSentJointPositions[i];
+    }
+
+    sendLoopCommand(commands, LoopErrorJointCommand);
+  }
+
+#ifdef PEPPER
+  // wheel speeds are sent every cycle, time-aligned with the joint positions
+  const float * wheelSpeeds = plugins.empty() ? &loopWheelSpeeds[0] : &loopPluginCommands[loopJointPositions.size()];
+  bool bumperLatched = bumperReflexLatched.load(boost::memory_order_acquire);
+  if(bumperLatched || wheelsStopped.load(boost::memory_order_acquire))
+  {
+    // the next wheel command sets all speeds again
+    std::fill(loopWheelSpeeds.begin(), loopWheelSpeeds.end(), 0.0f);
+    wheelSpeeds = &loopWheelSpeeds[0];
+  }
+  loopWheelsCommands[4][0] = DCMtime;
+  for(unsigned i = 0; i < loopWheelSpeeds.size(); i++)
+  {
+    loopWheelsCommands[5][i][0] = wheelSpeeds[i];
+  }
+  sendLoopCommand(loopWheelsCommands, LoopErrorWheelsCommand);
+
+  // wheels stiffness stays off while the bumper reflex is latched
+  if(wheelsStiffnessTarget.update() && !bumperLatched)
+  {
+    float stiffness = wheelsStiffnessTarget.readBuffer();
+    loopWheelsStiffnessCommands[4][0] = DCMtime;
+    for(unsigned i = 0; i < loopWheelSpeeds.size(); i++)
+    {
+      loopWheelsStiffnessCommands[5][i][0] = stiffness;
+    }
+    sendLoopCommand(loopWheelsStiffnessCommands, LoopErrorWheelsCommand);
+  }
+#endif
+
+  // Stiffness steps and ramps, the latest command wins
+  if(jointStiffnessFrames.update())
+  {
+    const StiffnessFrame & frame = jointStiffnessFrames.readBuffer();
+    jointStiffnessRamp.start(frame.stiffness, frame.durationMs, DCMtime);
+  }
+  if(useSharedMemory)
+  {
+    sendSharedMemoryCommands(DCMtime);
+  }
+  if(jointStiffnessRamp.update(DCMtime))
   {
-    throw ALERROR(getName(), "synchronisedDCMcallback()", "Error when sending command to DCM : " + e.toString());
+    const std::vector<float> & stiffness = jointStiffnessRamp.values();
+    loopJointStiffnessCommands[4][0] = DCMtime;
+    for(unsigned i = 0; i < robot_module.actuators.size(); i++)
+    {
+      loopJointStiffnessCommands[5][i][0] = stiffness[i];
+    }
+    sendLoopCommand(loopJointStiffnessCommands, LoopErrorStiffnessCommand);
   }
+
+  loopStats.recordTick(startTime, DCMClock::hostTime(), loopJointPositionsTime, newCommand);
 }
 
-void MCNAOqiDCM::sayText(const std::string & toSay)
+void MCNAOqiDCM::updateLoopWheelSpeeds(const float * speeds, unsigned int sequence)
 {
+  // setJointAnglesAndWheelSpeeds and setWheelSpeed publish in two buffers, keep the newest speeds
+  if(static_cast<int>(sequence - loopWheelSpeedsSequence) > 0)
+  {
+    std::copy(speeds, speeds + loopWheelSpeeds.size(), loopWheelSpeeds.begin());
+    loopWheelSpeedsSequence = sequence;
+  }
+}
+
+void MCNAOqiDCM::runPlugins(int DCMtime)
+{
+  // sensors of the previous postprocess
+  int sensorsTime;
+  unsigned int sensorsCycle;
+  sensorSnapshots.readLatest(loopSensorValues, sensorsTime, sensorsCycle);
+
+  std::copy(loopJointPositions.begin(), loopJointPositions.end(), loopPluginCommands.begin());
+  std::copy(loopWheelSpeeds.begin(), loopWheelSpeeds.end(), loopPluginCommands.begin() + loopJointPositions.size());
+  float dt = loopPluginTime == 0 ? robot_module.dcmPeriod * 1e-6f : (DCMtime - loopPluginTime) * 1e-3f;
+  loopPluginTime = DCMtime;
+  for(size_t i = 0; i < plugins.size(); i++)
+  {
+    plugins[i]->step(&loopSensorValues[0], &loopPluginCommands[0], dt);
+  }
+}
+
+void MCNAOqiDCM::loadPlugin(const std::string & name, const std::string & path, const int & budgetUs)
+{
+  // held until the plugin is loaded, startLoop waits for it
+  AL::ALCriticalSection loopSection(loopMutex);
+  if(preProcessConnected)
+  {
+    throw ALERROR(getName(), "loadPlugin()", "The loop is running, stop it first");
+  }
+  if(budgetUs <= 0)
+  {
+    throw ALERROR(getName(), "loadPlugin()", "The time budget must be positive");
+  }
+  AL::ALCriticalSection section(pluginsMutex);
+  for(size_t i = 0; i < plugins.size(); i++)
+  {
+    if(plugins[i]->name() == name)
+    {
+      throw ALERROR(getName(), "loadPlugin()", "A plugin named " + name + " is already loaded");
+    }
+  }
   try
   {
-    AL::ALTextToSpeechProxy tts(getParentBroker());
-    tts.say(toSay);
+    plugins.push_back(boost::shared_ptr<ControllerPlugin>(
+        new ControllerPlugin(name, path, budgetUs, robot_module.name, robot_module.dcmPeriod, robot_module.actuators,
+                             wheelNames(), robot_module.sensors)));
   }
-  catch(const AL::ALError &)
+  catch(const std::exception & e)
   {
-    qiLogError("module.example") << "Could not get proxy to ALTextToSpeech" << std::endl;
+    throw ALERROR(getName(), "loadPlugin()", e.what());
   }
 }
 
-void MCNAOqiDCM::setLeds(std::string ledGroupName, const float & r, const float & g, const float & b)
+void MCNAOqiDCM::unloadPlugin(const std::string & name)
 {
-  int DCMtime;
+  AL::ALCriticalSection loopSection(loopMutex);
+  if(preProcessConnected)
+  {
+    throw ALERROR(getName(), "unloadPlugin()", "The loop is running, stop it first");
+  }
+  AL::ALCriticalSection section(pluginsMutex);
+  plugins.erase(std::find(plugins.begin(), plugins.end(), plugin(name, "unloadPlugin()")));
+}
+
+boost::shared_ptr<ControllerPlugin> MCNAOqiDCM::plugin(const std::string & name, const std::string & method)
+{
+  for(size_t i = 0; i < plugins.size(); i++)
+  {
+    if(plugins[i]->name() == name)
+    {
+      return plugins[i];
+    }
+  }
+  throw ALERROR(getName(), method, "No plugin named " + name);
+}
+
+void MCNAOqiDCM::setPluginParameter(const std::string & name, const std::string & parameter, const float & value)
+{
+  AL::ALCriticalSection section(pluginsMutex);
   try
   {
-    DCMtime = dcmProxy->getTime(0);
+    plugin(name, "setPluginParameter()")->setParameter(parameter, value);
   }
-  catch(const AL::ALError & e)
+  catch(const std::runtime_error & e)
+  {
+    throw ALERROR(getName(), "setPluginParameter()", e.what());
+  }
+}
+
+void MCNAOqiDCM::setPluginEnabled(const std::string & name, const bool & enabled)
+{
+  AL::ALCriticalSection section(pluginsMutex);
+  plugin(name, "setPluginEnabled()")->setEnabled(enabled);
+}
+
+AL::ALValue MCNAOqiDCM::getPlugins()
+{
+  AL::ALCriticalSection section(pluginsMutex);
+  AL::ALValue status;
+  status.arraySetSize(plugins.size());
+  for(size_t i = 0; i < plugins.size(); i++)
+  {
+    const ControllerPlugin & p = *plugins[i];
+    status[i].arraySetSize(9);
+    status[i][0] = p.name();
+    status[i][1] = p.path();
+    status[i][2] = p.enabled();
+    status[i][3] = static_cast<int>(p.budget());
+    status[i][4] = static_cast<int>(p.steps.load(boost::memory_order_relaxed));
+    status[i][5] = static_cast<int>(p.overruns.load(boost::memory_order_relaxed));
+    status[i][6] = static_cast<int>(p.failures.load(boost::memory_order_relaxed));
+    status[i][7] = static_cast<int>(p.maxDuration.load(boost::memory_order_relaxed));
+    status[i][8] = static_cast<int>(p.refusedParameters.load(boost::memory_order_relaxed));
+  }
+  return status;
+}
+
+void MCNAOqiDCM::applyWatchdogPolicy(int DCMtime)
+{
+  if(watchdog.policy() == Watchdog::StiffnessOff)
   {
-    throw ALERROR(getName(), "changeShouldersLeds()", "Error on DCM getTime : " + e.toString());
+    // interpolated by the loop from the current stiffness, like setJointStiffnessRamp
+    jointStiffnessRamp.start(zeroJointStiffness, static_cast<int>(watchdog.durationMs()), DCMtime);
   }
+  watchdogHoldEnd = DCMtime + static_cast<int>(watchdog.durationMs());
+
+  // never keep driving the base without a client, the wheels are stopped in this cycle
+  wheelsStopped.store(true, boost::memory_order_release);
+}
 
-  if(ledCmdMap.find(ledGroupName) != ledCmdMap.end())
+void MCNAOqiDCM::setWatchdog(const int & policy, const int & missedCycles, const int & durationMs)
+{
+  if(policy < Watchdog::Off || policy > Watchdog::StiffnessOff)
+  {
+    throw ALERROR(getName(), "setWatchdog()", "Unknown watchdog policy " + to_string(policy));
+  }
+  if(missedCycles < 1 || durationMs < 0)
   {
-    std::vector<AL::ALValue> & rgbCmnds = ledCmdMap[ledGroupName];
+    throw ALERROR(getName(), "setWatchdog()", "missedCycles must be positive and durationMs non-negative");
+  }
+  watchdog.configure(static_cast<Watchdog::Policy>(policy), missedCycles, durationMs);
+}
 
-    qiLogInfo("rgbCmnds[0].getSize()") << rgbCmnds[0].getSize() << std::endl;
-    qiLogInfo("rgbCmnds[0][5].getSize()") << rgbCmnds[0][5].getSize() << std::endl;
+AL::ALValue MCNAOqiDCM::getWatchdogStatus()
+{
+  AL::ALValue status;
+  status.arraySetSize(7);
+  status[0] = static_cast<int>(watchdog.policy());
+  status[1] = static_cast<int>(watchdog.missedCycles());
+  status[2] = static_cast<int>(watchdog.durationMs());
+  status[3] = watchdog.tripped();
+  status[4] = static_cast<int>(watchdog.trips());
+  status[5] = static_cast<int>(watchdog.cyclesSinceCommand());
+  status[6] = static_cast<int>(watchdog.maxCyclesSinceCommand());
+  return status;
+}
 
-    rgbCmnds[0][4][0] = DCMtime;
-    rgbCmnds[1][4][0] = DCMtime;
-    rgbCmnds[2][4][0] = DCMtime;
+void MCNAOqiDCM::resetWatchdogCounters()
+{
+  watchdog.resetCounters();
+}
 
-    // set RGB values for every memory key of this led group
-    for(int i = 0; i < rgbCmnds[0][5].getSize(); i++)
+AL::ALValue MCNAOqiDCM::getJointLimitViolations()
+{
+  AL::ALValue violations;
+  violations.arraySetSize(jointLimiter.numJoints());
+  for(unsigned int i = 0; i < jointLimiter.numJoints(); i++)
+  {
+    violations[i].arraySetSize(4);
+    violations[i][0] = robot_module.actuators[i];
+    violations[i][1] = static_cast<int>(jointLimiter.count(i, JointLimiter::ViolationNaN));
+    violations[i][2] = static_cast<int>(jointLimiter.count(i, JointLimiter::ViolationPosition));
+    violations[i][3] = static_cast<int>(jointLimiter.count(i, JointLimiter::ViolationStep));
+  }
+  return violations;
+}
+
+void MCNAOqiDCM::resetJointLimitViolations()
+{
+  jointLimiter.resetCounters();
+}
+
+void MCNAOqiDCM::holdJointLimiterAtEncoders(const std::vector<float> & sensorValues)
+{
+  // encoders are the first sensors, only called while the loop is not connected
+  jointLimiter.hold(&sensorValues[0]);
+  std::copy(sensorValues.begin(), sensorValues.begin() + loopSentJointPositions.size(),
+            loopSentJointPositions.begin());
+}
+
+void MCNAOqiDCM::sendSharedMemoryCommands(int DCMtime)
+{
+  if(!sharedMemoryChannel.readJointStiffness(&sharedJointStiffness[0], sharedJointStiffnessSequence))
+  {
+    return;
+  }
+  // same checks as sendJointStiffness, a frame with a NaN is dropped as a whole
+  for(size_t i = 0; i < sharedJointStiffness.size(); i++)
+  {
+    if(sharedJointStiffness[i] != sharedJointStiffness[i])
     {
-      rgbCmnds[0][5][i][0] = r;
-      rgbCmnds[1][5][i][0] = g;
-      rgbCmnds[2][5][i][0] = b;
+      reportLoopError(LoopErrorSharedMemoryStiffness);
+      return;
     }
+    sharedJointStiffness[i] = std::min(std::max(sharedJointStiffness[i], 0.0f), 1.0f);
+  }
+  // sent with the other stiffness commands of this cycle
+  jointStiffnessRamp.start(sharedJointStiffness, 0, DCMtime);
+}
+
+void MCNAOqiDCM::reportLoopError(LoopError error)
+{
+  loopErrorCounts[error].fetch_add(1, boost::memory_order_relaxed);
+  lastLoopError.store(error, boost::memory_order_relaxed);
+}
+
+bool MCNAOqiDCM::sendLoopCommand(const AL::ALValue & command, LoopError error)
+{
+  // Nothing may propagate to the DCM thread, and the error message of the
+  // exception is deliberately not copied
+  try
+  {
+    dcmProxy->setAlias(command);
+  }
+  catch(...)
+  {
+    reportLoopError(error);
+    return false;
+  }
+  return true;
+}
+
+AL::ALValue MCNAOqiDCM::getLoopErrors()
+{
+  AL::ALValue errors;
+  errors.arraySetSize(2);
+  errors[0] = lastLoopError.load(boost::memory_order_relaxed);
+  errors[1].arraySetSize(LoopErrorCount);
+  for(int i = 0; i < LoopErrorCount; i++)
+  {
+    errors[1][i] = static_cast<int>(loopErrorCounts[i].load(boost::memory_order_relaxed));
+  }
+  return errors;
+}
 
+void MCNAOqiDCM::resetLoopErrors()
+{
+  for(int i = 0; i < LoopErrorCount; i++)
+  {
+    loopErrorCounts[i].store(0, boost::memory_order_relaxed);
+  }
+  lastLoopError.store(LoopErrorNone, boost::memory_order_relaxed);
+}
+
+namespace
+{
+AL::ALValue histogramToALValue(const Histogram & histogram)
+{
+  AL::ALValue value;
+  value.arraySetSize(3);
+  value[0] = static_cast<int>(histogram.bucketWidth());
+  value[1].arraySetSize(histogram.numBuckets());
+  for(unsigned int i = 0; i < histogram.numBuckets(); i++)
+  {
+    value[1][i] = static_cast<int>(histogram.count(i));
+  }
+  value[2] = static_cast<int>(histogram.max());
+  return value;
+}
+
+AL::ALValue namedValue(const std::string & name, const AL::ALValue & value)
+{
+  AL::ALValue pair;
+  pair.arraySetSize(2);
+  pair[0] = name;
+  pair[1] = value;
+  return pair;
+}
+} // namespace
+
+AL::ALValue MCNAOqiDCM::getLoopStats()
+{
+  AL::ALValue stats;
+  stats.arrayPush(namedValue("callbackDuration", histogramToALValue(loopStats.duration)));
+  stats.arrayPush(namedValue("period", histogramToALValue(loopStats.period)));
+  stats.arrayPush(namedValue("commandAge", histogramToALValue(loopStats.commandAge)));
+  stats.arrayPush(namedValue("ticks", static_cast<int>(loopStats.ticks.load())));
+  stats.arrayPush(namedValue("overruns", static_cast<int>(loopStats.overruns.load())));
+  stats.arrayPush(namedValue("lateTicks", static_cast<int>(loopStats.lateTicks.load())));
+  stats.arrayPush(namedValue("missedUpdates", static_cast<int>(loopStats.missedUpdates.load())));
+  return stats;
+}
+
+void MCNAOqiDCM::resetLoopStats()
+{
+  loopStats.reset();
+}
+
+// read all 'readSensorKeys' once per DCM cycle into the next snapshot of 'sensorSnapshots'
+void MCNAOqiDCM::synchronisedSensorsCallback()
+{
+  int DCMtime = dcmClock.now();
+
+  // values are read in place into the preallocated slot
+  std::vector<float> & sensorValues = sensorSnapshots.beginWrite();
+  try
+  {
+    fMemoryFastAccess->GetValues(sensorValues);
+  }
+  catch(...)
+  {
+    // keep the previous snapshot as the latest one
+    sensorSnapshots.abortWrite();
+    reportLoopError(LoopErrorSensors);
+    return;
+  }
+  ++dcmCycle;
+  sensorSnapshots.endWrite(DCMtime, dcmCycle);
+
+  // the slot is not reused before several cycles, it can still be read here
+  if(sharedMemoryActive.load(boost::memory_order_acquire))
+  {
+    sharedMemoryChannel.writeSensors(&sensorValues[0], DCMtime, dcmCycle);
+  }
+
+  // ring the doorbell of waitForNextCycle, lock-free: only enter the kernel if a client is actually waiting
+  publishedCycle.store(dcmCycle, boost::memory_order_seq_cst);
+  if(cycleWaiters.load(boost::memory_order_seq_cst) > 0)
+  {
+    futex(publishedCycle, FUTEX_WAKE_PRIVATE, INT_MAX, NULL);
+  }
+
+  checkBumperReflex(sensorValues, DCMtime);
+
+  // commands sent in the preprocess of this cycle and the sensors read after it
+  flightRecorder.record(DCMtime, dcmCycle, loopSentJointPositions, jointStiffnessRamp.values(), loopWheelSpeeds,
+                        sensorValues);
+
+  readSensorTiers(DCMtime);
+}
+
+void MCNAOqiDCM::readSensorTiers(int DCMtime)
+{
+  for(size_t i = 0; i < sensorTierReaders.size(); i++)
+  {
+    SensorTierReader & reader = *sensorTierReaders[i];
+    if(dcmCycle % robot_module.sensorTiers[i].decimation != reader.phase)
+    {
+      continue;
+    }
+    std::vector<float> & values = reader.snapshots.beginWrite();
     try
     {
-      dcmProxy->setAlias(rgbCmnds[0]);
-      dcmProxy->setAlias(rgbCmnds[1]);
-      dcmProxy->setAlias(rgbCmnds[2]);
+      reader.fastAccess->GetValues(values);
     }
-    catch(const AL::ALError & e)
+    catch(...)
     {
-      throw ALERROR(getName(), "changeShouldersLeds()", "Error when sending command to DCM : " + e.toString());
+      reader.snapshots.abortWrite();
+      reportLoopError(LoopErrorSensors);
+      continue;
     }
+    reader.snapshots.endWrite(DCMtime, dcmCycle);
+  }
+}
+
+AL::ALValue MCNAOqiDCM::getSensorTiers() const
+{
+  AL::ALValue tiers;
+  tiers.arraySetSize(robot_module.sensorTiers.size());
+  for(size_t i = 0; i < robot_module.sensorTiers.size(); i++)
+  {
+    const SensorTier & tier = robot_module.sensorTiers[i];
+    tiers[i].arraySetSize(3);
+    tiers[i][0] = tier.name;
+    tiers[i][1] = static_cast<int>(tier.decimation);
+    tiers[i][2] = tier.sensors;
   }
+  return tiers;
+}
+
+AL::ALValue MCNAOqiDCM::getTierSensors(const std::string & tierName)
+{
+  for(size_t i = 0; i < robot_module.sensorTiers.size(); i++)
+  {
+    if(robot_module.sensorTiers[i].name != tierName)
+    {
+      continue;
+    }
+    SensorTierReader & reader = *sensorTierReaders[i];
+    std::vector<float> values;
+    int DCMtime;
+    unsigned int cycle;
+    // Loop not running or tier not read yet: read ALMemory directly
+    if(!preProcessConnected || !reader.snapshots.readLatest(values, DCMtime, cycle))
+    {
+      reader.fastAccess->GetValues(values);
+      DCMtime = dcmClock.now();
+      cycle = 0;
+    }
+
+    AL::ALValue snapshot;
+    snapshot.arraySetSize(3);
+    snapshot[0] = values;
+    snapshot[1] = DCMtime;
+    snapshot[2] = static_cast<int>(cycle);
+    return snapshot;
+  }
+  throw ALERROR(getName(), "getTierSensors()", "Unknown sensor tier " + tierName);
+}
+
+void MCNAOqiDCM::sayText(const std::string & toSay)
+{
+  try
+  {
+    AL::ALTextToSpeechProxy tts(getParentBroker());
+    tts.say(toSay);
+  }
+  catch(const AL::ALError &)
+  {
+    qiLogError("module.example") << "Could not get proxy to ALTextToSpeech" << std::endl;
+  }
+}
+
+void MCNAOqiDCM::fillLedCommand(LedGroupCommand & leds, int DCMtime, float r, float g, float b)
+{
+  leds.command[4][0] = DCMtime;
+  if(leds.rgb)
+  {
+    // set RGB values for every memory key of this led group
+    for(unsigned int i = 0; i < leds.numLeds; i++)
+    {
+      leds.command[5][i][0] = r;
+      leds.command[5][leds.numLeds + i][0] = g;
+      leds.command[5][2 * leds.numLeds + i][0] = b;
+    }
+  }
+  else
+  {
+    // set intensity values for every memory key of this led group
+    for(unsigned int i = 0; i < leds.numLeds; i++)
+    {
+      leds.command[5][i][0] = r;
+    }
+  }
+}
+
+void MCNAOqiDCM::sendLedCommand(const LedGroupCommand & leds)
+{
+  try
+  {
+    dcmProxy->setAlias(leds.command);
+  }
+  catch(const AL::ALError & e)
+  {
+    throw ALERROR(getName(), "sendLedCommand()", "Error when sending command to DCM : " + e.toString());
+  }
+}
+
+int MCNAOqiDCM::findLedGroup(const std::string & ledGroupName) const
+{
+  std::map<std::string, int>::const_iterator it = ledGroupHandles.find(ledGroupName);
+  if(it == ledGroupHandles.end())
+  {
+    return -1;
+  }
+  return it->second;
+}
+
+MCNAOqiDCM::LedGroupCommand & MCNAOqiDCM::ledGroup(int handle, const std::string & method)
+{
+  if(handle < 0 || handle >= static_cast<int>(ledCommands.size()))
+  {
+    throw ALERROR(getName(), method, "Invalid led group handle " + to_string(handle));
+  }
+  return ledCommands[handle];
+}
+
+void MCNAOqiDCM::setLedsAt(LedGroupCommand & leds, int DCMtime, float r, float g, float b)
+{
+  if(!leds.rgb)
+  {
+    throw ALERROR(getName(), "setLeds()", "Single channel led group, use isetLeds");
+  }
+
+  AL::ALCriticalSection section(ledsMutex);
+  fillLedCommand(leds, DCMtime, r, g, b);
+  sendLedCommand(leds);
+}
+
+int MCNAOqiDCM::resolveLedGroup(const std::string & ledGroupName)
+{
+  int handle = findLedGroup(ledGroupName);
+  if(handle < 0)
+  {
+    throw ALERROR(getName(), "resolveLedGroup()", "Unknown led group " + ledGroupName);
+  }
+  return handle;
+}
+
+void MCNAOqiDCM::setLedsHandle(const int & handle, const float & r, const float & g, const float & b)
+{
+  setLedsAt(ledGroup(handle, "setLedsHandle()"), dcmClock.now(), r, g, b);
+}
+
+void MCNAOqiDCM::isetLedsHandle(const int & handle, const float & intensity)
+{
+  LedGroupCommand & leds = ledGroup(handle, "isetLedsHandle()");
+  int DCMtime = dcmClock.now();
+  AL::ALCriticalSection section(ledsMutex);
+  // same intensity on all channels of RGB groups
+  fillLedCommand(leds, DCMtime, intensity, intensity, intensity);
+  sendLedCommand(leds);
+}
+
+// The name-based led setters below are kept for compatibility, they silently ignore unknown groups
+
+void MCNAOqiDCM::setLeds(std::string ledGroupName, const float & r, const float & g, const float & b)
+{
+  setLedsDelay(ledGroupName, r, g, b, 0);
 }
 
 void MCNAOqiDCM::setLedsDelay(std::string ledGroupName,
@@ -640,79 +2197,220 @@ void MCNAOqiDCM::setLedsDelay(std::string ledGroupName,
                               const float & b,
                               const int & delay)
 {
-  int DCMtime;
-  try
+  int handle = findLedGroup(ledGroupName);
+  if(handle < 0)
   {
-    DCMtime = dcmProxy->getTime(delay);
+    return;
   }
-  catch(const AL::ALError & e)
+  setLedsAt(ledCommands[handle], dcmClock.now() + delay, r, g, b);
+}
+
+void MCNAOqiDCM::isetLeds(std::string ledGroupName, const float & intensity)
+{
+  int handle = findLedGroup(ledGroupName);
+  if(handle < 0)
   {
-    throw ALERROR(getName(), "changeShouldersLeds()", "Error on DCM getTime : " + e.toString());
+    return;
   }
+  isetLedsHandle(handle, intensity);
+}
 
-  if(ledCmdMap.find(ledGroupName) != ledCmdMap.end())
+void MCNAOqiDCM::setLedsBatch(const AL::ALValue & entries)
+{
+  if(!entries.isArray())
   {
-    std::vector<AL::ALValue> & rgbCmnds = ledCmdMap[ledGroupName];
-
-    qiLogInfo("rgbCmnds[0].getSize()") << rgbCmnds[0].getSize() << std::endl;
-    qiLogInfo("rgbCmnds[0][5].getSize()") << rgbCmnds[0][5].getSize() << std::endl;
-
-    rgbCmnds[0][4][0] = DCMtime;
-    rgbCmnds[1][4][0] = DCMtime;
-    rgbCmnds[2][4][0] = DCMtime;
+    throw ALERROR(getName(), "setLedsBatch()", "Expected an array of led entries");
+  }
 
-    // set RGB values for every memory key of this led group
-    for(int i = 0; i < rgbCmnds[0][5].getSize(); i++)
+  // check every entry first so that an invalid frame sends nothing
+  std::vector<LedGroupCommand *> groups(entries.getSize());
+  for(unsigned int i = 0; i < entries.getSize(); i++)
+  {
+    const AL::ALValue & entry = entries[i];
+    if(!entry.isArray() || (entry.getSize() != 2 && entry.getSize() != 4)
+       || !(entry[0].isString() || entry[0].isInt()))
+    {
+      throw ALERROR(getName(), "setLedsBatch()",
+                    "Entry " + to_string(i) + " is not [ledGroup, r, g, b] nor [ledGroup, intensity]");
+    }
+    // led group given by handle or by name
+    int handle = entry[0].isInt() ? static_cast<const int &>(entry[0])
+                                  : findLedGroup(static_cast<const std::string &>(entry[0]));
+    if(handle < 0 || handle >= static_cast<int>(ledCommands.size()))
+    {
+      throw ALERROR(getName(), "setLedsBatch()", "Unknown led group in entry " + to_string(i));
+    }
+    groups[i] = &ledCommands[handle];
+    if(groups[i]->rgb != (entry.getSize() == 4))
     {
-      rgbCmnds[0][5][i][0] = r;
-      rgbCmnds[1][5][i][0] = g;
-      rgbCmnds[2][5][i][0] = b;
+      throw ALERROR(getName(), "setLedsBatch()", "Wrong number of channels in entry " + to_string(i));
     }
+    for(unsigned int k = 1; k < entry.getSize(); k++)
+    {
+      if(!entry[k].isFloat() && !entry[k].isInt())
+      {
+        throw ALERROR(getName(), "setLedsBatch()", "Channel values of entry " + to_string(i) + " are not numbers");
+      }
+    }
+  }
 
-    try
+  // one time for the whole frame
+  int DCMtime = dcmClock.now();
+  AL::ALCriticalSection section(ledsMutex);
+  for(unsigned int i = 0; i < entries.getSize(); i++)
+  {
+    const AL::ALValue & entry = entries[i];
+    if(groups[i]->rgb)
     {
-      dcmProxy->setAlias(rgbCmnds[0]);
-      dcmProxy->setAlias(rgbCmnds[1]);
-      dcmProxy->setAlias(rgbCmnds[2]);
+      fillLedCommand(*groups[i], DCMtime, toFloat(entry[1]), toFloat(entry[2]), toFloat(entry[3]));
     }
-    catch(const AL::ALError & e)
+    else
     {
-      throw ALERROR(getName(), "changeShouldersLeds()", "Error when sending command to DCM : " + e.toString());
+      fillLedCommand(*groups[i], DCMtime, toFloat(entry[1]), 0.0f, 0.0f);
     }
+    sendLedCommand(*groups[i]);
   }
 }
 
-void MCNAOqiDCM::isetLeds(std::string ledGroupName, const float & intensity)
+void MCNAOqiDCM::uploadLedAnimation(const std::string & name,
+                                    const AL::ALValue & keyframes,
+                                    const int & durationMs,
+                                    const int & loops)
 {
-  int DCMtime;
-  try
+  // bounds the size of the commands queued in the DCM
+  const int maxPointsPerGroup = 1024;
+
+  if(!keyframes.isArray() || durationMs <= 0 || loops < 1)
   {
-    DCMtime = dcmProxy->getTime(0);
+    throw ALERROR(getName(), "uploadLedAnimation()",
+                  "Expected an array of keyframes, a positive duration and at least one loop");
   }
-  catch(const AL::ALError & e)
+
+  // keyframe indices of every animated group, in time order
+  std::map<std::string, std::vector<unsigned int> > groupKeyframes;
+  int previousTime = 0;
+  for(unsigned int i = 0; i < keyframes.getSize(); i++)
   {
-    throw ALERROR(getName(), "changeShouldersLeds()", "Error on DCM getTime : " + e.toString());
+    const AL::ALValue & keyframe = keyframes[i];
+    if(!keyframe.isArray() || (keyframe.getSize() != 3 && keyframe.getSize() != 5) || !keyframe[0].isInt()
+       || !keyframe[1].isString())
+    {
+      throw ALERROR(getName(), "uploadLedAnimation()",
+                    "Keyframe " + to_string(i)
+                        + " is not [timeMs, ledGroupName, r, g, b] nor [timeMs, ledGroupName, intensity]");
+    }
+    int time = keyframe[0];
+    if(time < previousTime || time >= durationMs)
+    {
+      throw ALERROR(getName(), "uploadLedAnimation()",
+                    "Keyframe " + to_string(i) + " is not sorted by time or not within [0, durationMs)");
+    }
+    previousTime = time;
+    const std::string & ledGroupName = keyframe[1];
+    int handle = findLedGroup(ledGroupName);
+    if(handle < 0)
+    {
+      throw ALERROR(getName(), "uploadLedAnimation()", "Unknown led group " + ledGroupName);
+    }
+    if(ledCommands[handle].rgb != (keyframe.getSize() == 5))
+    {
+      throw ALERROR(getName(), "uploadLedAnimation()", "Wrong number of channels for led group " + ledGroupName);
+    }
+    // the DCM expects strictly increasing times for each key
+    std::vector<unsigned int> & indices = groupKeyframes[ledGroupName];
+    if(!indices.empty() && static_cast<const int &>(keyframes[indices.back()][0]) >= time)
+    {
+      throw ALERROR(getName(), "uploadLedAnimation()",
+                    "Keyframe " + to_string(i) + " has the same time as the previous one of " + ledGroupName);
+    }
+    indices.push_back(i);
   }
 
-  std::vector<AL::ALValue> & intensityCmnds = ledCmdMap[ledGroupName];
-  // assert if intensityCmnds.size()==1, indeed single channel led group
+  std::vector<LedAnimationTrack> tracks;
+  for(std::map<std::string, std::vector<unsigned int> >::const_iterator it = groupKeyframes.begin();
+      it != groupKeyframes.end(); ++it)
+  {
+    const LedGroupCommand & leds = ledCommands[findLedGroup(it->first)];
+    const std::vector<unsigned int> & indices = it->second;
+    int numPoints = static_cast<int>(indices.size()) * loops;
+    if(numPoints > maxPointsPerGroup)
+    {
+      throw ALERROR(getName(), "uploadLedAnimation()",
+                    "Too many keyframes for led group " + it->first + " (max " + to_string(maxPointsPerGroup) + ")");
+    }
+
+    tracks.push_back(LedAnimationTrack());
+    LedAnimationTrack & track = tracks.back();
+    // same alias as the group, with one time slot per keyframe
+    track.command = leds.command;
+    track.command[4].arraySetSize(numPoints);
+    unsigned int numKeys = track.command[5].getSize();
+    for(unsigned int k = 0; k < numKeys; k++)
+    {
+      track.command[5][k].arraySetSize(numPoints);
+    }
 
-  intensityCmnds[0][4][0] = DCMtime;
+    int point = 0;
+    for(int loop = 0; loop < loops; loop++)
+    {
+      for(size_t j = 0; j < indices.size(); j++, point++)
+      {
+        const AL::ALValue & keyframe = keyframes[indices[j]];
+        track.times.push_back(loop * durationMs + static_cast<const int &>(keyframe[0]));
+        track.command[4][point] = 0;
+        for(unsigned int k = 0; k < numKeys; k++)
+        {
+          // RGB groups keys are all red keys, then all green keys, then all blue keys
+          unsigned int channel = leds.rgb ? 2 + k / leds.numLeds : 2;
+          track.command[5][k][point] = toFloat(keyframe[channel]);
+        }
+      }
+    }
+  }
 
-  // set intensity values for every memory key of this led group
-  for(int i = 0; i < intensityCmnds[0][5].getSize(); i++)
+  AL::ALCriticalSection section(ledsMutex);
+  ledAnimations[name] = tracks;
+}
+
+void MCNAOqiDCM::playLedAnimation(const std::string & name)
+{
+  AL::ALCriticalSection section(ledsMutex);
+  std::map<std::string, std::vector<LedAnimationTrack> >::iterator it = ledAnimations.find(name);
+  if(it == ledAnimations.end())
   {
-    intensityCmnds[0][5][i][0] = intensity;
+    throw ALERROR(getName(), "playLedAnimation()", "Unknown led animation " + name);
   }
 
-  try
+  // all tracks share the same start time
+  int DCMtime = dcmClock.now();
+  for(size_t i = 0; i < it->second.size(); i++)
   {
-    dcmProxy->setAlias(intensityCmnds[0]);
+    LedAnimationTrack & track = it->second[i];
+    for(size_t j = 0; j < track.times.size(); j++)
+    {
+      track.command[4][j] = DCMtime + track.times[j];
+    }
+    try
+    {
+      dcmProxy->setAlias(track.command);
+    }
+    catch(const AL::ALError & e)
+    {
+      throw ALERROR(getName(), "playLedAnimation()", "Error when sending command to DCM : " + e.toString());
+    }
   }
-  catch(const AL::ALError & e)
+}
+
+std::vector<std::string> MCNAOqiDCM::getLedAnimations()
+{
+  AL::ALCriticalSection section(ledsMutex);
+  std::vector<std::string> names;
+  for(std::map<std::string, std::vector<LedAnimationTrack> >::const_iterator it = ledAnimations.begin();
+      it != ledAnimations.end(); ++it)
   {
-    throw ALERROR(getName(), "changeShouldersLeds()", "Error when sending command to DCM : " + e.toString());
+    names.push_back(it->first);
   }
+  return names;
 }
 
 void MCNAOqiDCM::blink()
@@ -0,0 +1,188 @@
+# Benchmark the MCNAOqiDCM module on a running robot
+#
+# 1. Per-call latency of the bound methods used by a controller
+# 2. End-to-end control loop (command + sensors) at the DCM rate, with tail latencies
+# 3. Timing of the DCM callback itself, as measured by the module (getLoopStats)
+# 4. Phase alignment with the DCM: polling at the control period versus lockstep on waitForNextCycle
+#
+# Results are printed as JSON so that runs can be compared across commits:
+#   python benchmark_rpc.py --ip 127.0.0.1 --out results.json
+#
+# The robot stays limp: joint stiffness is set to 0 and the current joint
+# positions are sent back as commands.
+
+from __future__ import print_function
+
+import argparse
+import json
+import sys
+import time
+
+import qi
+
+parser = argparse.ArgumentParser()
+parser.add_argument("--ip", default="127.0.0.1", help="Robot IP address")
+parser.add_argument("--port", type=int, default=9559, help="Naoqi port number")
+parser.add_argument("--calls", type=int, default=1000, help="Number of calls per method")
+parser.add_argument("--cycles", type=int, default=2000, help="Number of control loop cycles")
+parser.add_argument("--period", type=float, default=0.012, help="Control loop period (s)")
+parser.add_argument("--out", default="", help="Write the JSON results to this file")
+args = parser.parse_args()
+
+# Connect to Naoqi session
+session = qi.Session()
+try:
+    session.connect("tcp://" + args.ip + ":" + str(args.port))
+except RuntimeError:
+    print("Can't connect to Naoqi at ip \"" + args.ip + "\" on port " + str(args.port) + ".\n"
+          "Please check your script arguments. Run with -h option for help.")
+    sys.exit(1)
+
+# Access the module
+mcnaoqidcm_service = session.service("MCNAOqiDCM")
+
+
+def summary(samples):
+    """Latency summary in microseconds"""
+    samples = sorted(samples)
+    n = len(samples)
+
+    def pct(p):
+        return samples[min(n - 1, int(p * n))] * 1e6
+
+    return {"count": n,
+            "mean_us": sum(samples) / n * 1e6,
+            "p50_us": pct(0.5),
+            "p99_us": pct(0.99),
+            "p999_us": pct(0.999),
+            "max_us": samples[-1] * 1e6}
+
+
+def histogram_percentile(histogram, p):
+    """Upper bound (us) of the bucket containing the p-th percentile of a getLoopStats histogram"""
+    width, counts, _ = histogram
+    total = sum(counts)
+    acc = 0
+    for i, c in enumerate(counts):
+        acc += c
+        if total and acc >= p * total:
+            return (i + 1) * width
+    return len(counts) * width
+
+
+def time_calls(call, n):
+    samples = []
+    for _ in range(n):
+        start = time.time()
+        call()
+        samples.append(time.time() - start)
+    return summary(samples)
+
+
+robot = mcnaoqidcm_service.getRobotName()
+num_joints = len(mcnaoqidcm_service.getJointOrder())
+mcnaoqidcm_service.setStiffness(0.0)
+encoders = mcnaoqidcm_service.getSensors()[:num_joints]
+led_group = "eyesLeds" if robot == "nao" else "eyesCenter"
+
+results = {"robot": robot,
+           "joints": num_joints,
+           "sensors": mcnaoqidcm_service.numSensors(),
+           "timestamp": time.time(),
+           "calls": {}}
+
+# 1. Per-call latency
+calls = results["calls"]
+calls["getSensors"] = time_calls(lambda: mcnaoqidcm_service.getSensors(), args.calls)
+calls["setJointAngles"] = time_calls(lambda: mcnaoqidcm_service.setJointAngles(encoders), args.calls)
+calls["setJointAnglesAndGetSensors"] = time_calls(
+    lambda: mcnaoqidcm_service.setJointAnglesAndGetSensors(encoders), args.calls)
+calls["setStiffness"] = time_calls(lambda: mcnaoqidcm_service.setStiffness(0.0), args.calls)
+calls["setLeds"] = time_calls(lambda: mcnaoqidcm_service.setLeds(led_group, 1.0, 1.0, 1.0), args.calls)
+
+# 2. End-to-end control loop, with and without the single round-trip call
+was_connected = mcnaoqidcm_service.isPreProccessConnected()
+if not was_connected:
+    mcnaoqidcm_service.startLoop()
+mcnaoqidcm_service.resetLoopStats()
+
+
+def control_loop(step):
+    samples = []
+    overruns = 0
+    next_tick = time.time()
+    for _ in range(args.cycles):
+        start = time.time()
+        step()
+        samples.append(time.time() - start)
+        next_tick += args.period
+        delay = next_tick - time.time()
+        if delay > 0:
+            time.sleep(delay)
+        else:
+            overruns += 1
+    result = summary(samples)
+    result["overruns"] = overruns
+    return result
+
+
+def two_calls():
+    mcnaoqidcm_service.setJointAngles(encoders)
+    mcnaoqidcm_service.getSensors()
+
+
+results["loop"] = {"period_s": args.period,
+                   "setJointAngles+getSensors": control_loop(two_calls),
+                   "setJointAnglesAndGetSensors": control_loop(
+                       lambda: mcnaoqidcm_service.setJointAnglesAndGetSensors(encoders))}
+
+# 3. DCM callback timing measured by the module during the loops
+results["dcmCallback"] = dict(mcnaoqidcm_service.getLoopStats())
+
+
+
+# 4. Phase alignment: a polling client drifts with respect to the DCM, it sees some cycles
+# twice and misses others, and its commands wait up to a full period for the next preprocess
+def phase_loop(step):
+    mcnaoqidcm_service.resetLoopStats()
+    repeated = 0
+    skipped = 0
+    last = -1
+    for _ in range(args.cycles):
+        cycle = step(last)
+        if last >= 0:
+            if cycle == last:
+                repeated += 1
+            elif cycle > last + 1:
+                skipped += cycle - last - 1
+        last = cycle
+    age = dict(mcnaoqidcm_service.getLoopStats())["commandAge"]
+    return {"repeated_cycles": repeated,
+            "skipped_cycles": skipped,
+            "command_age_p50_us": histogram_percentile(age, 0.5),
+            "command_age_p99_us": histogram_percentile(age, 0.99),
+            "command_age_max_us": age[2]}
+
+
+def polling_step(last):
+    time.sleep(args.period)
+    return mcnaoqidcm_service.setJointAnglesAndGetSensors(encoders)[2]
+
+
+def lockstep_step(last):
+    cycle = mcnaoqidcm_service.waitForNextCycle(last, 100)[2]
+    mcnaoqidcm_service.setJointAngles(encoders)
+    return cycle
+
+
+results["phase"] = {"polling": phase_loop(polling_step),
+                    "lockstep": phase_loop(lockstep_step)}
+
+if not was_connected:
+    mcnaoqidcm_service.stopLoop()
+
+output = json.dumps(results, indent=2, sort_keys=True)
+print(output)
+if args.out:
+    with open(args.out, "w") as f:
+        f.write(output)
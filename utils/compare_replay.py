@@ -0,0 +1,78 @@
+# Compare the commands captured by a replay with the commands of the recording
+# Usage: python compare_replay.py dump.bin commands.csv [tolerance]
+#
+# dump.bin is the flight recorder dump replayed by the fake DCM of the host
+# build (FakeDCM::replay) and commands.csv the command log it wrote
+# (FakeDCM::saveCommandLog). The joint commands sent at every cycle
+# (jointActuator) and the wheel speed commands are compared with the recorded
+# ones, trajectories and stiffness commands are not.
+
+from __future__ import print_function
+
+import csv
+import struct
+import sys
+
+from flight_recorder_to_csv import SUPPORTED_VERSION, read_names
+
+
+def read_recording(dump):
+    """Return the joint and wheel names and {cycle: (positions, speeds)}"""
+    with open(dump, "rb") as f:
+        if f.read(4) != b"MCFR":
+            raise RuntimeError(dump + " is not a flight recorder dump")
+        version, _, joints, wheels, sensors, records = struct.unpack("<6I", f.read(24))
+        if version != SUPPORTED_VERSION:
+            raise RuntimeError("Unsupported flight recorder version " + str(version))
+        joint_names = read_names(f, joints)
+        wheel_names = read_names(f, wheels)
+        read_names(f, sensors)
+        record = struct.Struct("<iI" + str(2 * joints + wheels + sensors) + "f")
+        cycles = {}
+        for _ in range(records):
+            values = record.unpack(f.read(record.size))
+            cycles[values[1]] = (values[2:2 + joints], values[2 + 2 * joints:2 + 2 * joints + wheels])
+    return joint_names, wheel_names, cycles
+
+
+def compare(dump, commands, tolerance):
+    joint_names, wheel_names, cycles = read_recording(dump)
+    compared = 0
+    mismatches = 0
+    max_error = {}
+    with open(commands) as f:
+        for row in csv.DictReader(f):
+            if len(row["times"].split(";")) != 1:
+                continue
+            cycle = int(row["cycle"])
+            if row["alias"] == "jointActuator":
+                names, recorded = joint_names, cycles[cycle][0] if cycle in cycles else None
+            elif row["alias"].endswith("Speed") and wheel_names:
+                names, recorded = wheel_names, cycles[cycle][1] if cycle in cycles else None
+            else:
+                continue
+            if recorded is None:
+                continue
+            values = [float(v) for v in row["values"].split(";")]
+            compared += 1
+            mismatch = False
+            for name, value, expected in zip(names, values, recorded):
+                error = abs(value - expected)
+                max_error[name] = max(max_error.get(name, 0.0), error)
+                mismatch = mismatch or error > tolerance
+            if mismatch:
+                mismatches += 1
+                print("cycle {}: {} differs from the recording".format(cycle, row["alias"]))
+    for name in joint_names + wheel_names:
+        if name in max_error:
+            print("{:>20} max error {:.6g}".format(name, max_error[name]))
+    print("{} commands compared, {} differ by more than {}".format(compared, mismatches, tolerance))
+    return mismatches == 0
+
+
+if __name__ == "__main__":
+    if len(sys.argv) not in (3, 4):
+        print("Usage: python compare_replay.py dump.bin commands.csv [tolerance]")
+        sys.exit(1)
+    tolerance = float(sys.argv[3]) if len(sys.argv) == 4 else 1e-5
+    sys.exit(0 if compare(sys.argv[1], sys.argv[2], tolerance) else 1)
@@ -0,0 +1,56 @@
+# Convert a flight recorder dump written by MCNAOqiDCM.dumpFlightRecorder to CSV
+# Usage: python flight_recorder_to_csv.py dump.bin [out.csv]
+#
+# The dump is written on the robot, copy it first, e.g.
+#   scp nao@<robot>:/home/nao/dump.bin .
+# Dumps are little-endian whatever the host (see include/FlightRecorder.h).
+
+from __future__ import print_function
+
+import struct
+import sys
+
+SUPPORTED_VERSION = 1
+
+
+def read_names(f, count):
+    names = []
+    for _ in range(count):
+        length, = struct.unpack("<I", f.read(4))
+        names.append(f.read(length).decode("utf-8"))
+    return names
+
+
+def convert(dump, out):
+    with open(dump, "rb") as f:
+        if f.read(4) != b"MCFR":
+            raise RuntimeError(dump + " is not a flight recorder dump")
+        version, period, joints, wheels, sensors, records = struct.unpack("<6I", f.read(24))
+        if version != SUPPORTED_VERSION:
+            raise RuntimeError("Unsupported flight recorder version " + str(version))
+        joint_names = read_names(f, joints)
+        wheel_names = read_names(f, wheels)
+        sensor_names = read_names(f, sensors)
+
+        header = (["DCMtime", "cycle"]
+                  + ["Position" + n for n in joint_names]
+                  + ["Stiffness" + n for n in joint_names]
+                  + ["Speed" + n for n in wheel_names]
+                  + sensor_names)
+        record = struct.Struct("<iI" + str(2 * joints + wheels + sensors) + "f")
+        out.write(",".join(header) + "\n")
+        for _ in range(records):
+            values = record.unpack(f.read(record.size))
+            out.write(",".join(repr(v) for v in values) + "\n")
+    print("{} cycles of {} us".format(records, period), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    if len(sys.argv) not in (2, 3):
+        print("Usage: python flight_recorder_to_csv.py dump.bin [out.csv]")
+        sys.exit(1)
+    if len(sys.argv) == 3:
+        with open(sys.argv[2], "w") as out:
+            convert(sys.argv[1], out)
+    else:
+        convert(sys.argv[1], sys.stdout)
@@ -0,0 +1,41 @@
+# Print timing statistics of the MCNAOqiDCM preprocess callback
+# Usage: python print_loop_stats.py [--reset]
+
+import qi
+import sys
+
+# Connect to Naoqi session
+session = qi.Session()
+try:
+    session.connect("tcp://127.0.0.1:9559")
+except RuntimeError:
+    print ("Can't connect to Naoqi at \"tcp://127.0.0.1:9559\".\n"
+           "Please check that naoqi is running.")
+    sys.exit(1)
+
+# Access the module
+mcnaoqidcm_service = session.service("MCNAOqiDCM")
+
+def percentile(counts, width, p):
+    """Upper bound (us) of the bucket containing the p-th percentile"""
+    total = sum(counts)
+    if total == 0:
+        return 0
+    acc = 0
+    for i, c in enumerate(counts):
+        acc += c
+        if acc >= p * total:
+            return (i + 1) * width
+    return len(counts) * width
+
+stats = dict(mcnaoqidcm_service.getLoopStats())
+for name in ["callbackDuration", "period", "commandAge"]:
+    width, counts, maximum = stats[name]
+    print "%-16s p50 < %6d us  p99 < %6d us  p99.9 < %6d us  max %6d us" % (
+        name, percentile(counts, width, 0.5), percentile(counts, width, 0.99),
+        percentile(counts, width, 0.999), maximum)
+for name in ["ticks", "overruns", "lateTicks", "missedUpdates"]:
+    print "%-16s %d" % (name, stats[name])
+
+if "--reset" in sys.argv:
+    mcnaoqidcm_service.resetLoopStats()